@@ -0,0 +1,422 @@
+/**
+ * @file autotune.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-29
+ */
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <cpuid.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "compact.h"
+#include "sha256.h"
+#include "ripemd160.h"
+#include "hash_backends.h"
+#include "instrinsic_one.h"
+#include "instrinsic_two.h"
+
+namespace fingera {
+
+// what the cpu and the os support, from cpuid and xgetbv
+struct cpu_features {
+    bool sse41;
+    bool avx2;
+    bool avx512f;
+    bool sha;
+    bool bmi2;
+    char brand[49];
+
+    static const cpu_features &get() {
+        static const cpu_features features = detect();
+        return features;
+    }
+
+    static cpu_features detect() {
+        cpu_features f;
+        memset(&f, 0, sizeof(f));
+        unsigned int a, b, c, d;
+        if (!__get_cpuid(1, &a, &b, &c, &d)) {
+            return f;
+        }
+        bool ssse3 = (c >> 9) & 1;
+        f.sse41 = (c >> 19) & 1;
+
+        // ymm / zmm state enabled by the os
+        uint64_t xcr0 = 0;
+        if ((c >> 27) & 1) {
+            uint32_t lo, hi;
+            __asm__("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+            xcr0 = (uint64_t)hi << 32 | lo;
+        }
+        bool ymm = (xcr0 & 0x06) == 0x06;
+        bool zmm = (xcr0 & 0xE6) == 0xE6;
+
+        if (__get_cpuid_count(7, 0, &a, &b, &c, &d)) {
+            f.avx2 = ymm && ((b >> 5) & 1);
+            f.avx512f = zmm && ((b >> 16) & 1);
+            f.sha = ssse3 && f.sse41 && ((b >> 29) & 1);
+            f.bmi2 = (b >> 8) & 1;
+        }
+
+        unsigned int brand[12];
+        if (__get_cpuid(0x80000000, &a, &b, &c, &d) && a >= 0x80000004) {
+            for (unsigned int i = 0; i < 3; i++) {
+                __get_cpuid(0x80000002 + i, &brand[i * 4], &brand[i * 4 + 1], &brand[i * 4 + 2], &brand[i * 4 + 3]);
+            }
+            memcpy(f.brand, brand, 48);
+        }
+        return f;
+    }
+};
+
+// the backends of one algorithm available on this cpu, and the one to use
+// for each batch size. a batch uses the choice of the largest tuned batch
+// size not above its own
+class hash_dispatch {
+public:
+    using function = void (*)(void *out, const void *const *data, const size_t *sizes, size_t count);
+
+    struct backend {
+        const char *name;
+        size_t way;
+        function hash;
+    };
+
+    enum { slots = 6 };
+
+    static inline size_t batch_size(size_t slot) {
+        static const size_t sizes[slots] = { 1, 2, 4, 8, 16, 64 };
+        return sizes[slot];
+    }
+
+    hash_dispatch(const char *algorithm, size_t hash_size, const std::vector<backend> &backends)
+            : algorithm_(algorithm), hash_size_(hash_size), backends_(backends) {
+        for (size_t i = 0; i < slots; i++) {
+            choice_[i] = -1;
+        }
+    }
+
+    const char *algorithm() const {
+        return algorithm_;
+    }
+    size_t hash_size() const {
+        return hash_size_;
+    }
+    const std::vector<backend> &backends() const {
+        return backends_;
+    }
+
+    // true when every batch size has a backend
+    bool tuned() const {
+        for (size_t i = 0; i < slots; i++) {
+            if (choice_[i] < 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    int find(const std::string &name) const {
+        for (size_t i = 0; i < backends_.size(); i++) {
+            if (name == backends_[i].name) {
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+
+    // false when the backend is not available here
+    bool choose(size_t slot, const std::string &name) {
+        int index = find(name);
+        if (index < 0 || slot >= slots) {
+            return false;
+        }
+        choice_[slot] = index;
+        return true;
+    }
+    bool choose_all(const std::string &name) {
+        if (find(name) < 0) {
+            return false;
+        }
+        for (size_t i = 0; i < slots; i++) {
+            choose(i, name);
+        }
+        return true;
+    }
+
+    const backend &select(size_t count) const {
+        size_t slot = 0;
+        while (slot + 1 < slots && batch_size(slot + 1) <= count) {
+            slot++;
+        }
+        return backends_[choice_[slot] < 0 ? 0 : choice_[slot]];
+    }
+
+    void hash(void *out, const void *const *data, const size_t *sizes, size_t count) const {
+        select(count).hash(out, data, sizes, count);
+    }
+
+    // times every backend on every batch size of message_size byte messages
+    void tune(size_t message_size = 64) {
+        size_t max_batch = batch_size(slots - 1);
+        std::vector<uint8_t> messages(message_size * max_batch);
+        std::vector<uint8_t> digests(hash_size_ * max_batch);
+        std::vector<const void *> data(max_batch);
+        std::vector<size_t> sizes(max_batch, message_size);
+        for (size_t i = 0; i < messages.size(); i++) {
+            messages[i] = (uint8_t)(i * 131 + 7);
+        }
+        for (size_t i = 0; i < max_batch; i++) {
+            data[i] = messages.data() + i * message_size;
+        }
+
+        for (size_t slot = 0; slot < slots; slot++) {
+            double best = 0;
+            for (size_t i = 0; i < backends_.size(); i++) {
+                double rate = measure(backends_[i].hash, digests.data(), data.data(), sizes.data(), batch_size(slot));
+                if (rate > best) {
+                    best = rate;
+                    choice_[slot] = (int)i;
+                }
+            }
+        }
+    }
+
+    // profile lines: <algorithm> <batch size> <backend>
+    std::string profile() const {
+        std::string text;
+        for (size_t i = 0; i < slots; i++) {
+            if (choice_[i] >= 0) {
+                text += std::string(algorithm_) + " " + std::to_string(batch_size(i)) + " " +
+                    backends_[choice_[i]].name + "\n";
+            }
+        }
+        return text;
+    }
+    // takes the lines of this algorithm, false when one names an unknown backend
+    bool load_profile(const std::string &line) {
+        char algorithm[32], name[32];
+        unsigned long batch;
+        if (sscanf(line.c_str(), "%31s %lu %31s", algorithm, &batch, name) != 3 || algorithm_ != std::string(algorithm)) {
+            return true;
+        }
+        for (size_t i = 0; i < slots; i++) {
+            if (batch_size(i) == batch) {
+                return choose(i, name);
+            }
+        }
+        return false;
+    }
+
+private:
+    // best of three runs, batches per second
+    static double measure(function hash, void *out, const void *const *data, const size_t *sizes, size_t count) {
+        using clock = std::chrono::steady_clock;
+        double best = 0;
+        for (int run = 0; run < 3; run++) {
+            size_t calls = 0;
+            double seconds = 0;
+            auto begin = clock::now();
+            do {
+                hash(out, data, sizes, count);
+                calls++;
+                seconds = std::chrono::duration<double>(clock::now() - begin).count();
+            } while (seconds < 0.002);
+            best = calls / seconds > best ? calls / seconds : best;
+        }
+        return best;
+    }
+
+    const char *algorithm_;
+    size_t hash_size_;
+    std::vector<backend> backends_;
+    int choice_[slots];
+};
+
+// process wide sha256 / ripemd160 dispatch
+//
+// on first use the profile is loaded from $FINGERA_HASH_PROFILE, or
+// $XDG_CACHE_HOME/fingera-hash.profile, or ~/.cache/fingera-hash.profile.
+// a missing profile, one from another cpu or one naming a backend not
+// available here is replaced by tuning and saving a new one.
+//
+// $FINGERA_HASH_BACKEND overrides the profile for every batch size, either
+// one backend for all algorithms ("avx2") or per algorithm
+// ("sha256=shani,ripemd160=avx512")
+class autotuner {
+public:
+    static autotuner &get() {
+        static autotuner tuner;
+        return tuner;
+    }
+
+    hash_dispatch &sha256() {
+        return sha256_;
+    }
+    hash_dispatch &ripemd160() {
+        return ripemd160_;
+    }
+
+    static std::string profile_path() {
+        const char *path = getenv("FINGERA_HASH_PROFILE");
+        if (path && *path) {
+            return path;
+        }
+        const char *cache = getenv("XDG_CACHE_HOME");
+        if (cache && *cache) {
+            return std::string(cache) + "/fingera-hash.profile";
+        }
+        const char *home = getenv("HOME");
+        return std::string(home ? home : ".") + "/.cache/fingera-hash.profile";
+    }
+
+    bool load(const std::string &path) {
+        FILE *file = fopen(path.c_str(), "r");
+        if (!file) {
+            return false;
+        }
+        bool ok = false;
+        char line[256];
+        while (fgets(line, sizeof(line), file)) {
+            std::string text(line);
+            if (text[0] == '#') {
+                continue;
+            }
+            if (text.compare(0, 4, "cpu ") == 0) {
+                ok = text.substr(4) == std::string(cpu_features::get().brand) + "\n";
+            } else if (ok) {
+                ok = sha256_.load_profile(text) && ripemd160_.load_profile(text);
+            }
+            if (!ok) {
+                break;
+            }
+        }
+        fclose(file);
+        return ok && sha256_.tuned() && ripemd160_.tuned();
+    }
+
+    // written to a temporary file and renamed, concurrent first runs are fine
+    // the directories of path are created first
+    bool save(const std::string &path) const {
+        if (!make_dirs(path)) {
+            return false;
+        }
+        std::string tmp = path + "." + std::to_string(getpid());
+        FILE *file = fopen(tmp.c_str(), "w");
+        if (!file) {
+            return false;
+        }
+        std::string text = "# fingera hash backend profile\n";
+        text += std::string("cpu ") + cpu_features::get().brand + "\n";
+        text += sha256_.profile() + ripemd160_.profile();
+        bool ok = fwrite(text.data(), 1, text.size(), file) == text.size();
+        ok = fclose(file) == 0 && ok;
+        if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+            unlink(tmp.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    void tune() {
+        sha256_.tune();
+        ripemd160_.tune();
+    }
+
+private:
+    autotuner() : sha256_("sha256", 32, sha256_backends()), ripemd160_("ripemd160", 20, ripemd160_backends()) {
+        std::string path = profile_path();
+        if (!load(path)) {
+            tune();
+            if (!save(path)) {
+                fprintf(stderr, "fingera: warning: can not save hash profile %s, tuning again next run\n", path.c_str());
+            }
+        }
+        override(getenv("FINGERA_HASH_BACKEND"));
+    }
+
+    // mkdir -p of the directory part of path
+    static bool make_dirs(const std::string &path) {
+        for (size_t slash = path.find('/', 1); slash != std::string::npos; slash = path.find('/', slash + 1)) {
+            if (mkdir(path.substr(0, slash).c_str(), 0755) != 0 && errno != EEXIST) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void override(const char *value) {
+        if (!value) {
+            return;
+        }
+        std::string text(value);
+        size_t begin = 0;
+        while (begin <= text.size()) {
+            size_t end = text.find(',', begin);
+            end = end == std::string::npos ? text.size() : end;
+            std::string item = text.substr(begin, end - begin);
+            size_t eq = item.find('=');
+            if (eq == std::string::npos) {
+                sha256_.choose_all(item);
+                ripemd160_.choose_all(item);
+            } else if (item.substr(0, eq) == sha256_.algorithm()) {
+                sha256_.choose_all(item.substr(eq + 1));
+            } else if (item.substr(0, eq) == ripemd160_.algorithm()) {
+                ripemd160_.choose_all(item.substr(eq + 1));
+            }
+            begin = end + 1;
+        }
+    }
+
+    static std::vector<hash_dispatch::backend> sha256_backends() {
+        const cpu_features &cpu = cpu_features::get();
+        std::vector<hash_dispatch::backend> list;
+        list.push_back({ "one", 1, hash_batch<fingera::sha256<instrinsic_one> > });
+        list.push_back({ "two", 2, hash_batch<fingera::sha256<instrinsic_two> > });
+        if (cpu.sse41) {
+            list.push_back({ "sse4", 4, sha256_batch_sse4 });
+        }
+        if (cpu.avx2) {
+            list.push_back({ "avx2", 8, sha256_batch_avx2 });
+        }
+        if (cpu.avx512f) {
+            list.push_back({ "avx512", 16, sha256_batch_avx512 });
+        }
+        if (cpu.sha) {
+            list.push_back({ "shani", 2, sha256_batch_shani });
+        }
+        if (cpu.avx2 && cpu.bmi2) {
+            list.push_back({ "rorx", 1, sha256_batch_rorx });
+        }
+        return list;
+    }
+    static std::vector<hash_dispatch::backend> ripemd160_backends() {
+        const cpu_features &cpu = cpu_features::get();
+        std::vector<hash_dispatch::backend> list;
+        list.push_back({ "one", 1, hash_batch<fingera::ripemd160<instrinsic_one> > });
+        list.push_back({ "two", 2, hash_batch<fingera::ripemd160<instrinsic_two> > });
+        if (cpu.sse41) {
+            list.push_back({ "sse4", 4, ripemd160_batch_sse4 });
+        }
+        if (cpu.avx2) {
+            list.push_back({ "avx2", 8, ripemd160_batch_avx2 });
+        }
+        if (cpu.avx512f) {
+            list.push_back({ "avx512", 16, ripemd160_batch_avx512 });
+        }
+        return list;
+    }
+
+    hash_dispatch sha256_;
+    hash_dispatch ripemd160_;
+};
+
+} // namespace fingera
@@ -0,0 +1,281 @@
+/**
+ * @file base58.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-01
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include "compact.h"
+#include "sha256_scatter.h"
+
+namespace fingera {
+
+// the bitcoin alphabet both ways, 32 bit entries for vector_gather
+struct base58_alphabet {
+    enum { invalid = 0x100 };
+
+    uint32_t chars[58];
+    uint32_t digits[256];
+
+    base58_alphabet() {
+        const char *alphabet = "123456789ABCDEFGHJKLMNPQRSTUVWXYZabcdefghijkmnopqrstuvwxyz";
+        for (int i = 0; i < 256; i++) {
+            digits[i] = invalid;
+        }
+        for (int i = 0; i < 58; i++) {
+            chars[i] = (uint8_t)alphabet[i];
+            digits[(uint8_t)alphabet[i]] = i;
+        }
+    }
+
+    static const base58_alphabet &get() {
+        static const base58_alphabet alphabet;
+        return alphabet;
+    }
+};
+
+// base58check of way() strings per kernel call, one number per lane
+//
+// the checksum is the first word of the multi lane sha256d. the radix
+// conversion runs on all lanes at once with numbers right aligned to the
+// longest lane: leading zeros do not change a number, the leading zero
+// bytes and '1' characters of each lane are counted on their own
+template<typename Instrinsic>
+class base58_check {
+public:
+    using type = typename Instrinsic::type;
+    using scatter = sha256d_scatter<Instrinsic>;
+
+    enum {
+        max_payload = 124,
+        max_bytes = max_payload + 4,
+        // log(256) / log(58) < 1.38
+        max_digits = max_bytes * 138 / 100 + 1,
+        // with the terminating zero
+        max_encoded = max_digits + 1,
+        // 24 bits per limb, log2(58) < 6 bits per digit
+        max_limbs = max_digits / 4 + 2,
+    };
+
+    static inline size_t way() {
+        return scatter::way();
+    }
+
+    // first digest word of sha256d(payloads[i]) in lane i, n <= way()
+    static inline type checksums(const uint8_t *const *payloads, const size_t *sizes, size_t n) {
+        enum { lanes = sizeof(type) / sizeof(uint32_t) };
+        scatter_message messages[lanes];
+        uint32_t order[lanes];
+        for (size_t l = 0; l < lanes; l++) {
+            order[l] = (uint32_t)l;
+        }
+        for (size_t l = 0; l < n; l++) {
+            messages[l].add(payloads[l], sizes[l]);
+        }
+        type s[8];
+        scatter::hash_lanes(s, messages, order, n);
+        return s[0];
+    }
+
+    // n <= way() payloads of sizes[i] <= max_payload bytes
+    // out[i]: max_encoded bytes, a zero terminated string
+    static void encode_lanes(char *const *out, const uint8_t *const *payloads, const size_t *sizes, size_t n) {
+        enum { lanes = sizeof(type) / sizeof(uint32_t) };
+        uint32_t bytes[lanes][max_bytes];
+        uint32_t chars[lanes][max_digits];
+        size_t zeros[lanes];
+
+        const type check = checksums(payloads, sizes, n);
+        size_t length = 0;
+        for (size_t l = 0; l < n; l++) {
+            length = sizes[l] + 4 > length ? sizes[l] + 4 : length;
+        }
+        for (size_t l = 0; l < lanes; l++) {
+            memset(bytes[l], 0, length * sizeof(uint32_t));
+        }
+        for (size_t l = 0; l < n; l++) {
+            uint32_t *row = bytes[l] + length - sizes[l] - 4;
+            for (size_t k = 0; k < sizes[l]; k++) {
+                row[k] = payloads[l][k];
+            }
+            uint32_t sum = Instrinsic::extract(check, l);
+            for (size_t k = 0; k < 4; k++) {
+                row[sizes[l] + k] = (sum >> (24 - 8 * k)) & 0xFF;
+            }
+            for (zeros[l] = 0; zeros[l] < sizes[l] + 4 && row[zeros[l]] == 0; zeros[l]++) {
+            }
+        }
+
+        // digits little end first: d = d * 256 + byte, x / 58 as x * 36158 >> 21
+        // which is exact for x < 2^15, digit * 256 + carry stays below 15000
+        type d[max_digits];
+        const size_t count = length * 138 / 100 + 1;
+        for (size_t j = 0; j < count; j++) {
+            d[j] = Instrinsic::vector_mirror(0);
+        }
+        const type reciprocal = Instrinsic::vector_mirror(36158);
+        const type minus_base = Instrinsic::vector_mirror((uint32_t)-58);
+        for (size_t k = 0; k < length; k++) {
+            type carry = Instrinsic::load_le(bytes, k * 4, sizeof(bytes[0]));
+            size_t limit = (k + 1) * 138 / 100 + 1;
+            limit = limit < count ? limit : count;
+            for (size_t j = 0; j < limit; j++) {
+                type x = Instrinsic::vector_add(Instrinsic::template vector_shl<8>(d[j]), carry);
+                carry = Instrinsic::template vector_shr<21>(Instrinsic::vector_mullo(x, reciprocal));
+                d[j] = Instrinsic::vector_add(x, Instrinsic::vector_mullo(carry, minus_base));
+            }
+        }
+        const uint32_t *alphabet = base58_alphabet::get().chars;
+        for (size_t j = 0; j < count; j++) {
+            Instrinsic::save_le(chars, j * 4, Instrinsic::vector_gather(alphabet, d[j]), sizeof(chars[0]));
+        }
+
+        for (size_t l = 0; l < n; l++) {
+            size_t top = count;
+            while (top && chars[l][top - 1] == '1') {
+                top--;
+            }
+            char *p = out[l];
+            for (size_t k = 0; k < zeros[l]; k++) {
+                *p++ = '1';
+            }
+            while (top) {
+                *p++ = (char)chars[l][--top];
+            }
+            *p = 0;
+        }
+    }
+
+    // n <= way() zero terminated strings, out[i]: max_payload bytes
+    // sizes[i]: the payload size, 0 when invalid
+    // returns bit i set when string i decodes and its checksum matches
+    static uint32_t decode_lanes(uint8_t *const *out, size_t *sizes, const char *const *strings, size_t n) {
+        enum { lanes = sizeof(type) / sizeof(uint32_t) };
+        static const uint8_t zero[4] = { 0 };
+        uint32_t chars[lanes][max_digits];
+        uint32_t limbs[lanes][max_limbs];
+        uint8_t bytes[lanes][max_digits];
+        size_t ones[lanes], totals[lanes];
+        uint32_t valid = (uint32_t)((1ull << n) - 1);
+
+        size_t length = 0;
+        for (size_t l = 0; l < n; l++) {
+            size_t size = strnlen(strings[l], max_digits + 1);
+            if (size > max_digits) {
+                valid &= ~(1u << l);
+                size = 0;
+            }
+            totals[l] = size;
+            length = size > length ? size : length;
+        }
+        // pad with '1', the zero digit
+        for (size_t l = 0; l < lanes; l++) {
+            for (size_t k = 0; k < length; k++) {
+                chars[l][k] = '1';
+            }
+        }
+        for (size_t l = 0; l < n; l++) {
+            uint32_t *row = chars[l] + length - totals[l];
+            for (size_t k = 0; k < totals[l]; k++) {
+                row[k] = (uint8_t)strings[l][k];
+            }
+            for (ones[l] = 0; ones[l] < totals[l] && row[ones[l]] == '1'; ones[l]++) {
+            }
+        }
+
+        // limbs little end first: limb = limb * 58 + digit
+        type limb[max_limbs];
+        const size_t count = length / 4 + 2;
+        for (size_t j = 0; j < count; j++) {
+            limb[j] = Instrinsic::vector_mirror(0);
+        }
+        const uint32_t *digits = base58_alphabet::get().digits;
+        const type base = Instrinsic::vector_mirror(58);
+        const type low = Instrinsic::vector_mirror(0xFFFFFF);
+        type bad = Instrinsic::vector_mirror(0);
+        for (size_t k = 0; k < length; k++) {
+            type carry = Instrinsic::vector_gather(digits, Instrinsic::load_le(chars, k * 4, sizeof(chars[0])));
+            bad = Instrinsic::vector_or(bad, carry);
+            size_t limit = (k + 1) / 4 + 1;
+            limit = limit < count ? limit : count;
+            for (size_t j = 0; j < limit; j++) {
+                type x = Instrinsic::vector_add(Instrinsic::vector_mullo(limb[j], base), carry);
+                limb[j] = Instrinsic::vector_and(x, low);
+                carry = Instrinsic::template vector_shr<24>(x);
+            }
+        }
+        valid &= Instrinsic::vector_mask_eq(
+            Instrinsic::vector_and(bad, Instrinsic::vector_mirror(base58_alphabet::invalid)), Instrinsic::vector_mirror(0));
+        for (size_t j = 0; j < count; j++) {
+            Instrinsic::save_le(limbs, j * 4, limb[j], sizeof(limbs[0]));
+        }
+
+        // big endian bytes: one zero per leading '1', then the number
+        const uint8_t *payloads[lanes];
+        const void *sums[lanes];
+        for (size_t l = 0; l < lanes; l++) {
+            size_t total = 0;
+            if (l < n) {
+                memset(bytes[l], 0, ones[l]);
+                total = ones[l];
+                bool lead = true;
+                for (size_t j = count; j--;) {
+                    for (int b = 16; b >= 0; b -= 8) {
+                        uint8_t byte = (uint8_t)(limbs[l][j] >> b);
+                        if (lead && byte == 0) {
+                            continue;
+                        }
+                        lead = false;
+                        if (total < max_digits) {
+                            bytes[l][total] = byte;
+                        }
+                        total++;
+                    }
+                }
+            }
+            if (total < 4 || total > max_bytes) {
+                valid &= ~(1u << l);
+                total = 4;
+            }
+            totals[l] = total - 4;
+            payloads[l] = bytes[l];
+            sums[l] = l < n ? bytes[l] + totals[l] : zero;
+        }
+
+        type check = checksums(payloads, totals, n);
+        valid &= Instrinsic::vector_mask_eq(check, Instrinsic::load_lanes(sums, 0));
+        valid &= (uint32_t)((1ull << n) - 1);
+        for (size_t l = 0; l < n; l++) {
+            sizes[l] = (valid >> l) & 1 ? totals[l] : 0;
+            memcpy(out[l], bytes[l], sizes[l]);
+        }
+        return valid;
+    }
+
+    // any number of payloads, out[i]: max_encoded bytes
+    static void encode(char *const *out, const uint8_t *const *payloads, const size_t *sizes, size_t count) {
+        for (size_t begin = 0; begin < count; begin += way()) {
+            size_t n = count - begin < way() ? count - begin : way();
+            encode_lanes(out + begin, payloads + begin, sizes + begin, n);
+        }
+    }
+
+    // any number of strings, valid[i] 1 when string i is well formed
+    // returns the number of valid strings
+    static size_t decode(uint8_t *const *out, size_t *sizes, const char *const *strings, size_t count, uint8_t *valid) {
+        size_t total = 0;
+        for (size_t begin = 0; begin < count; begin += way()) {
+            size_t n = count - begin < way() ? count - begin : way();
+            uint32_t mask = decode_lanes(out + begin, sizes + begin, strings + begin, n);
+            for (size_t i = 0; i < n; i++) {
+                valid[begin + i] = (mask >> i) & 1;
+            }
+            total += __builtin_popcount(mask);
+        }
+        return total;
+    }
+};
+
+} // namespace fingera
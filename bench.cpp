@@ -0,0 +1,279 @@
+/**
+ * @file bench.cpp
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-28
+ *
+ * single core throughput of every sha256 kernel, of the ripemd160 ones,
+ * of content defined chunking, of hash_drbg, of the SPHINCS+ WOTS+
+ * primitives and of merkle mountain range appends
+ *
+ * usage: bench [blocks per message] [streaming working set MB]
+ */
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include "compact.h"
+#include "sha256.h"
+#include "sha256_shani.h"
+#include "sha256_rorx.h"
+#include "sha256_pipeline.h"
+#include "fastcdc.h"
+#include "hash_drbg.h"
+#include "sphincs_sha256.h"
+#include "merkle_mountain.h"
+#include "ripemd160.h"
+#include "trunk_arena.h"
+#include "instrinsic_one.h"
+#include "instrinsic_two.h"
+#include "instrinsic_sse4.h"
+#include "instrinsic_avx2.h"
+#include "instrinsic_avx512.h"
+#include "instrinsic_vec.h"
+
+using namespace fingera;
+
+// MB/s of message blocks hashed by Hash::process_trunk
+template<typename Hash>
+double measure(const char *name, int blocks) {
+    data_trunk trunk(64 * Hash::way() * blocks);
+    std::vector<uint8_t> out(32 * Hash::way());
+    for (size_t i = 0; i < trunk.size(); i++) {
+        trunk[i] = (uint8_t)(i * 131 + 7);
+    }
+
+    using clock = std::chrono::steady_clock;
+    size_t calls = 0;
+    auto begin = clock::now();
+    double seconds = 0;
+    do {
+        for (int i = 0; i < 64; i++) {
+            Hash::process_trunk(out.data(), trunk.data(), blocks);
+            trunk[0] ^= out[0];
+        }
+        calls += 64;
+        seconds = std::chrono::duration<double>(clock::now() - begin).count();
+    } while (seconds < 0.5);
+
+    double mb = (double)calls * Hash::way() * blocks * 64 / (1 << 20);
+    printf("%-16s %3d lanes %10.1f MB/s %12.0f msg/s\n", name, (int)Hash::way(),
+        mb / seconds, calls * Hash::way() / seconds);
+    return mb / seconds;
+}
+
+// MB/s of a batch of messages larger than the caches, messages of
+// blocks * 64 - 9 bytes, through trunk_arena and through sha256_pipeline
+template<typename Instrinsic>
+void measure_stream(const char *name, int blocks, size_t megabytes) {
+    using hash = sha256<Instrinsic>;
+    const size_t size = 64 * blocks - 9;
+    const size_t count = (megabytes << 20) / size;
+    std::vector<uint8_t> data(size * count);
+    std::vector<uint8_t> out(32 * count);
+    for (size_t i = 0; i < data.size(); i += 64) {
+        data[i] = (uint8_t)i;
+    }
+
+    using clock = std::chrono::steady_clock;
+    double arena = 0, pipeline = 0;
+    for (int run = 0; run < 3; run++) {
+        auto begin = clock::now();
+        trunk_arena<hash> trunk(blocks);
+        for (size_t i = 0; i < count;) {
+            size_t first = i;
+            trunk.clear();
+            while (i < count && trunk.add(&data[size * i], size)) {
+                i++;
+            }
+            trunk.process();
+            memcpy(&out[32 * first], trunk.digest(), 32 * (i - first));
+        }
+        double seconds = std::chrono::duration<double>(clock::now() - begin).count();
+        arena = megabytes / seconds > arena ? megabytes / seconds : arena;
+
+        begin = clock::now();
+        sha256_pipeline<Instrinsic>::process(out.data(), data.data(), size, count);
+        seconds = std::chrono::duration<double>(clock::now() - begin).count();
+        pipeline = megabytes / seconds > pipeline ? megabytes / seconds : pipeline;
+    }
+    printf("%-16s %6zu MB  arena %8.1f MB/s  pipeline %8.1f MB/s\n", name, megabytes, arena, pipeline);
+}
+
+// MB/s of gear_chunker alone and of cdc_pipeline, chunking and sha256 of
+// every chunk, over megabytes of random bytes in memory
+template<typename Instrinsic>
+void measure_cdc(const char *name, const std::vector<uint8_t> &data) {
+    using clock = std::chrono::steady_clock;
+    gear_chunker<Instrinsic> chunker;
+    std::vector<uint32_t> lengths;
+    auto begin = clock::now();
+    chunker.cut(data.data(), data.size(), true, lengths);
+    double cut = std::chrono::duration<double>(clock::now() - begin).count();
+
+    cdc_pipeline<Instrinsic> pipeline;
+    size_t chunks = 0;
+    begin = clock::now();
+    pipeline.run(data.data(), data.size(), [&chunks](const chunk_record &) {
+        chunks++;
+    });
+    double both = std::chrono::duration<double>(clock::now() - begin).count();
+
+    double mb = (double)data.size() / (1 << 20);
+    printf("%-16s chunking %8.1f MB/s  chunking + sha256 %8.1f MB/s %8zu chunks\n", name, mb / cut, mb / both, chunks);
+}
+
+// MB/s of hash_drbg output next to one block messages through process_trunk,
+// the 32 byte digests of a trunk counted as output
+template<typename Instrinsic>
+void measure_drbg(const char *name) {
+    using hash = sha256<Instrinsic>;
+    using clock = std::chrono::steady_clock;
+    uint8_t seed[48] = { 0 };
+    hash_drbg<Instrinsic> drbg(seed, sizeof(seed));
+    std::vector<uint8_t> out(1 << 20);
+    size_t bytes = 0;
+    auto begin = clock::now();
+    double seconds = 0;
+    do {
+        drbg.generate(out.data(), out.size());
+        bytes += out.size();
+        seconds = std::chrono::duration<double>(clock::now() - begin).count();
+    } while (seconds < 0.5);
+    double generate = (double)bytes / (1 << 20) / seconds;
+
+    data_trunk trunk(64 * hash::way());
+    for (size_t l = 0; l < hash::way(); l++) {
+        hash::fill_lane(trunk.data(), l, out.data(), 55, hash::way());
+    }
+    bytes = 0;
+    begin = clock::now();
+    do {
+        for (size_t i = 0; i < (1 << 20); i += 32 * hash::way()) {
+            hash::process_trunk(&out[i], trunk.data(), 1);
+        }
+        bytes += out.size();
+        seconds = std::chrono::duration<double>(clock::now() - begin).count();
+    } while (seconds < 0.5);
+    double blocks = (double)bytes / (1 << 20) / seconds;
+    printf("%-16s generate %8.1f MB/s  process_trunk %8.1f MB/s\n", name, generate, blocks);
+}
+
+// WOTS+ keys/s of sphincs_sha256::wots_pkgen, 64 keypairs a call, and
+// the F calls/s they amount to, 560 of the 606 compressions of a key
+template<typename Instrinsic>
+void measure_wots(const char *name) {
+    using clock = std::chrono::steady_clock;
+    using spx = sphincs_sha256<Instrinsic>;
+    uint8_t pk_seed[16] = { 1 }, sk_seed[16] = { 2 };
+    spx engine(pk_seed);
+    sphincs_address address;
+    std::vector<uint8_t> leaves(64 * spx::n);
+    size_t keys = 0;
+    auto begin = clock::now();
+    double seconds = 0;
+    do {
+        engine.wots_pkgen(leaves.data(), sk_seed, address, (uint32_t)keys, 64);
+        keys += 64;
+        seconds = std::chrono::duration<double>(clock::now() - begin).count();
+    } while (seconds < 0.5);
+    printf("%-16s %10.0f keys/s %12.0f F/s\n", name, keys / seconds, keys * spx::len * (spx::w - 1) / seconds);
+}
+
+// appends/s of merkle_mountain_range into a file under /tmp, flushed
+// once per 4096 leaves and flushed after every leaf
+template<typename Instrinsic>
+void measure_mmr(const char *name) {
+    using clock = std::chrono::steady_clock;
+    const char *path = "/tmp/fingera-bench.mmr";
+    double rate[2];
+    for (int each = 1; each >= 0; each--) {
+        unlink(path);
+        merkle_mountain_range<Instrinsic> range;
+        if (!range.open(path)) {
+            printf("%-16s %s: can not open\n", name, path);
+            return;
+        }
+        uint8_t leaf[32] = { 0 };
+        auto begin = clock::now();
+        double seconds = 0;
+        do {
+            for (int i = 0; i < 4096; i++) {
+                write_le32(leaf, 0, (uint32_t)range.leaves());
+                range.append(leaf);
+                if (each) {
+                    range.flush();
+                }
+            }
+            range.flush();
+            seconds = std::chrono::duration<double>(clock::now() - begin).count();
+        } while (seconds < 0.5);
+        rate[each] = range.leaves() / seconds;
+    }
+    unlink(path);
+    printf("%-16s batched %10.0f appends/s  one by one %10.0f appends/s\n", name, rate[0], rate[1]);
+}
+
+int main(int argc, char const *argv[]) {
+    int blocks = argc > 1 ? atoi(argv[1]) : 1;
+    if (blocks <= 0) {
+        fprintf(stderr, "usage: %s [blocks per message] [streaming working set MB]\n", argv[0]);
+        return 2;
+    }
+    printf("sha256, %d block(s) per message\n", blocks);
+    measure<sha256<instrinsic_one> >("one", blocks);
+    measure<sha256_rorx>("rorx", blocks);
+    measure<sha256<instrinsic_two> >("two", blocks);
+    measure<sha256<instrinsic_sse4> >("sse4", blocks);
+    measure<sha256<instrinsic_avx2> >("avx2", blocks);
+    measure<sha256<instrinsic_avx512> >("avx512", blocks);
+    measure<sha256<instrinsic_vec<2> > >("vec<2>", blocks);
+    measure<sha256<instrinsic_vec<8> > >("vec<8>", blocks);
+    measure<sha256<instrinsic_vec<16> > >("vec<16>", blocks);
+    measure<sha256<instrinsic_vec<32> > >("vec<32>", blocks);
+    measure<sha256_shani>("shani", blocks);
+
+    std::vector<uint8_t> stream(64 << 20);
+    for (size_t i = 0; i < stream.size(); i++) {
+        stream[i] = (uint8_t)((i * 0x9e3779b1ul) >> 13);
+    }
+    printf("content defined chunking, 8 KB average\n");
+    measure_cdc<instrinsic_one>("one", stream);
+    measure_cdc<instrinsic_sse4>("sse4", stream);
+    measure_cdc<instrinsic_avx2>("avx2", stream);
+    measure_cdc<instrinsic_avx512>("avx512", stream);
+
+    printf("hash_drbg output\n");
+    measure_drbg<instrinsic_one>("one");
+    measure_drbg<instrinsic_sse4>("sse4");
+    measure_drbg<instrinsic_avx2>("avx2");
+    measure_drbg<instrinsic_avx512>("avx512");
+
+    printf("SPHINCS+-SHA2-128 WOTS+ key generation\n");
+    measure_wots<instrinsic_one>("one");
+    measure_wots<instrinsic_sse4>("sse4");
+    measure_wots<instrinsic_avx2>("avx2");
+    measure_wots<instrinsic_avx512>("avx512");
+
+    printf("merkle mountain range appends\n");
+    measure_mmr<instrinsic_one>("one");
+    measure_mmr<instrinsic_avx2>("avx2");
+    measure_mmr<instrinsic_avx512>("avx512");
+
+    // a single message only has the 1 way path, the lanes need a batch
+    printf("ripemd160, %d block(s) per message\n", blocks);
+    measure<ripemd160<instrinsic_one> >("one", blocks);
+    measure<ripemd160<instrinsic_two> >("two", blocks);
+    measure<ripemd160<instrinsic_sse4> >("sse4", blocks);
+    measure<ripemd160<instrinsic_avx2> >("avx2", blocks);
+    measure<ripemd160<instrinsic_avx512> >("avx512", blocks);
+
+    if (argc > 2) {
+        size_t megabytes = strtoul(argv[2], nullptr, 10);
+        printf("sha256 streaming, %zu byte messages\n", (size_t)(64 * blocks - 9));
+        measure_stream<instrinsic_sse4>("sse4", blocks, megabytes);
+        measure_stream<instrinsic_avx2>("avx2", blocks, megabytes);
+        measure_stream<instrinsic_avx512>("avx512", blocks, megabytes);
+    }
+    return 0;
+}
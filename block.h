@@ -0,0 +1,273 @@
+/**
+ * @file block.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-31
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "compact.h"
+#include "sha256_scatter.h"
+
+namespace fingera {
+
+// read only mapping of a whole file
+class mapped_file {
+public:
+    mapped_file() : data_(nullptr), size_(0) {}
+    ~mapped_file() {
+        close();
+    }
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    bool open(const std::string &path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        madvise(p, st.st_size, MADV_SEQUENTIAL);
+        data_ = (const uint8_t *)p;
+        size_ = st.st_size;
+        return true;
+    }
+    void close() {
+        if (data_) {
+            munmap((void *)data_, size_);
+            data_ = nullptr;
+            size_ = 0;
+        }
+    }
+
+    const uint8_t *data() const {
+        return data_;
+    }
+    size_t size() const {
+        return size_;
+    }
+
+private:
+    const uint8_t *data_;
+    size_t size_;
+};
+
+// where the parts of one serialized transaction are, offsets into the block
+struct tx_layout {
+    size_t offset;      // whole transaction, what the wtxid hashes
+    size_t size;
+    size_t body_offset; // inputs and outputs, after the segwit marker and flag
+    size_t body_size;
+    size_t lock_offset; // 4 byte lock time
+    bool witness;
+};
+
+// a serialized block parsed in place, the transactions are not copied
+class block_view {
+public:
+    enum { header_size = 80 };
+
+    block_view() : data_(nullptr), size_(0) {}
+
+    // data: a raw block, or one blk*.dat record (network magic and size first)
+    // false when the block is truncated or malformed
+    bool parse(const void *data, size_t size) {
+        data_ = (const uint8_t *)data;
+        size_ = size;
+        txs_.clear();
+        if (size_ >= 8 && is_magic(read_le32(data_, 0))) {
+            size_t record = read_le32(data_, 4);
+            if (record > size_ - 8) {
+                return false;
+            }
+            data_ += 8;
+            size_ = record;
+        }
+
+        size_t pos = header_size;
+        uint64_t count;
+        if (pos > size_ || !read_varint(pos, count) || count > size_) {
+            return false;
+        }
+        txs_.reserve(count);
+        for (uint64_t i = 0; i < count; i++) {
+            tx_layout tx;
+            if (!parse_tx(pos, tx)) {
+                return false;
+            }
+            txs_.push_back(tx);
+        }
+        return pos == size_;
+    }
+
+    const uint8_t *data() const {
+        return data_;
+    }
+    size_t size() const {
+        return size_;
+    }
+    const uint8_t *header() const {
+        return data_;
+    }
+    size_t tx_count() const {
+        return txs_.size();
+    }
+    const tx_layout &tx(size_t i) const {
+        return txs_[i];
+    }
+
+    // txid and wtxid of every transaction in one batched sha256d pass, 32
+    // bytes each in internal byte order. the witness commitment takes the
+    // coinbase wtxid as zero, this returns its hash like any other
+    template<typename Instrinsic>
+    void hash_transactions(uint8_t *txids, uint8_t *wtxids) const {
+        std::vector<scatter_message> messages;
+        std::vector<uint8_t *> out;
+        messages.reserve(txs_.size() * 2);
+        out.reserve(txs_.size() * 2);
+
+        for (size_t i = 0; i < txs_.size(); i++) {
+            const tx_layout &tx = txs_[i];
+            scatter_message m;
+            if (tx.witness) {
+                // version, inputs and outputs, lock time: no marker, flag and witnesses
+                m.add(data_ + tx.offset, 4);
+                m.add(data_ + tx.body_offset, tx.body_size);
+                m.add(data_ + tx.lock_offset, 4);
+            } else {
+                m.add(data_ + tx.offset, tx.size);
+            }
+            messages.push_back(m);
+            out.push_back(txids + 32 * i);
+
+            if (tx.witness) {
+                m.clear();
+                m.add(data_ + tx.offset, tx.size);
+                messages.push_back(m);
+                out.push_back(wtxids + 32 * i);
+            }
+        }
+        sha256d_scatter<Instrinsic>::process(out.data(), messages.data(), messages.size());
+
+        // without witness the two ids are the same hash
+        for (size_t i = 0; i < txs_.size(); i++) {
+            if (!txs_[i].witness) {
+                memcpy(wtxids + 32 * i, txids + 32 * i, 32);
+            }
+        }
+    }
+
+private:
+    static bool is_magic(uint32_t magic) {
+        // main, testnet3, regtest, signet
+        return magic == 0xD9B4BEF9ul || magic == 0x0709110Bul || magic == 0xDAB5BFFAul || magic == 0x40CF030Aul;
+    }
+
+    bool skip(size_t &pos, uint64_t n) const {
+        if (n > size_ - pos) {
+            return false;
+        }
+        pos += n;
+        return true;
+    }
+    bool read_varint(size_t &pos, uint64_t &value) const {
+        if (pos >= size_) {
+            return false;
+        }
+        uint8_t first = data_[pos++];
+        size_t bytes = first < 0xFD ? 0 : first == 0xFD ? 2 : first == 0xFE ? 4 : 8;
+        if (bytes > size_ - pos) {
+            return false;
+        }
+        value = first;
+        if (bytes == 2) {
+            value = data_[pos] | (uint64_t)data_[pos + 1] << 8;
+        } else if (bytes == 4) {
+            value = read_le32(data_, pos);
+        } else if (bytes == 8) {
+            value = read_le64(data_, pos);
+        }
+        pos += bytes;
+        return true;
+    }
+    bool skip_script(size_t &pos) const {
+        uint64_t n;
+        return read_varint(pos, n) && skip(pos, n);
+    }
+
+    bool parse_tx(size_t &pos, tx_layout &tx) const {
+        tx.offset = pos;
+        if (!skip(pos, 4)) {
+            return false;
+        }
+        tx.witness = size_ - pos >= 2 && data_[pos] == 0 && data_[pos + 1] == 1;
+        if (tx.witness) {
+            pos += 2;
+        }
+        tx.body_offset = pos;
+
+        uint64_t inputs, outputs;
+        if (!read_varint(pos, inputs)) {
+            return false;
+        }
+        for (uint64_t i = 0; i < inputs; i++) {
+            // previous output, script, sequence
+            if (!skip(pos, 36) || !skip_script(pos) || !skip(pos, 4)) {
+                return false;
+            }
+        }
+        if (!read_varint(pos, outputs)) {
+            return false;
+        }
+        for (uint64_t i = 0; i < outputs; i++) {
+            // value, script
+            if (!skip(pos, 8) || !skip_script(pos)) {
+                return false;
+            }
+        }
+        tx.body_size = pos - tx.body_offset;
+
+        if (tx.witness) {
+            for (uint64_t i = 0; i < inputs; i++) {
+                uint64_t items;
+                if (!read_varint(pos, items)) {
+                    return false;
+                }
+                for (uint64_t k = 0; k < items; k++) {
+                    if (!skip_script(pos)) {
+                        return false;
+                    }
+                }
+            }
+        }
+        tx.lock_offset = pos;
+        if (!skip(pos, 4)) {
+            return false;
+        }
+        tx.size = pos - tx.offset;
+        return true;
+    }
+
+    const uint8_t *data_;
+    size_t size_;
+    std::vector<tx_layout> txs_;
+};
+
+} // namespace fingera
@@ -1,28 +1,88 @@
 #pragma once
 
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
 #include <vector>
 #include <endian.h>
 
 namespace fingera {
 
 inline void write_be32(void* ptr, int offset, uint32_t x) {
-    *(uint32_t *)((char *)ptr + offset) = htobe32(x);
+    x = htobe32(x);
+    memcpy((char *)ptr + offset, &x, sizeof(x));
 }
 inline uint32_t read_be32(const void *ptr, int offset) {
-    return be32toh(*(uint32_t *)((char *)ptr + offset));
+    uint32_t x;
+    memcpy(&x, (const char *)ptr + offset, sizeof(x));
+    return be32toh(x);
 }
 inline void write_le32(void* ptr, int offset, uint32_t x) {
-    *(uint32_t *)((char *)ptr + offset) = htole32(x);
+    x = htole32(x);
+    memcpy((char *)ptr + offset, &x, sizeof(x));
 }
 inline uint32_t read_le32(const void *ptr, int offset) {
-    return le32toh(*(uint32_t *)((char *)ptr + offset));
+    uint32_t x;
+    memcpy(&x, (const char *)ptr + offset, sizeof(x));
+    return le32toh(x);
 }
 inline void write_be64(void* ptr, int offset, uint64_t x) {
-    *(uint32_t *)((char *)ptr + offset) = htobe64(x);
+    x = htobe64(x);
+    memcpy((char *)ptr + offset, &x, sizeof(x));
 }
+inline uint64_t read_be64(const void *ptr, int offset) {
+    uint64_t x;
+    memcpy(&x, (const char *)ptr + offset, sizeof(x));
+    return be64toh(x);
+}
+inline void write_le64(void* ptr, int offset, uint64_t x) {
+    x = htole64(x);
+    memcpy((char *)ptr + offset, &x, sizeof(x));
+}
+inline uint64_t read_le64(const void *ptr, int offset) {
+    uint64_t x;
+    memcpy(&x, (const char *)ptr + offset, sizeof(x));
+    return le64toh(x);
+}
+
+template<typename T, size_t Align = 64>
+class aligned_allocator {
+public:
+    using value_type = T;
+
+    template<typename U>
+    struct rebind {
+        using other = aligned_allocator<U, Align>;
+    };
+
+    aligned_allocator() {}
+    template<typename U>
+    aligned_allocator(const aligned_allocator<U, Align> &) {}
+
+    T *allocate(size_t n) {
+        void *ptr = nullptr;
+        if (posix_memalign(&ptr, Align, n ? n * sizeof(T) : Align)) {
+            throw std::bad_alloc();
+        }
+        return (T *)ptr;
+    }
+    void deallocate(T *ptr, size_t) {
+        free(ptr);
+    }
+
+    template<typename U>
+    bool operator==(const aligned_allocator<U, Align> &) const {
+        return true;
+    }
+    template<typename U>
+    bool operator!=(const aligned_allocator<U, Align> &) const {
+        return false;
+    }
+};
 
-typedef std::vector<uint8_t> data_trunk;
+// cache line aligned, vector loads of a trunk never split a line
+typedef std::vector<uint8_t, aligned_allocator<uint8_t, 64> > data_trunk;
 
 
 } // namespace fingera
@@ -0,0 +1,346 @@
+/**
+ * @file digest_cache.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-02
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace fingera {
+
+// what a cached digest is valid for: the file, its size and times, the algorithm
+struct file_identity {
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime_ns;
+    int64_t ctime_ns;
+    uint32_t algorithm;
+
+    // false when fd cannot be stat'ed
+    bool stat(int fd, uint32_t algorithm_id) {
+        struct stat st;
+        if (fstat(fd, &st) != 0) {
+            return false;
+        }
+        assign(st, algorithm_id);
+        return true;
+    }
+    void assign(const struct stat &st, uint32_t algorithm_id) {
+        device = st.st_dev;
+        inode = st.st_ino;
+        size = st.st_size;
+        mtime_ns = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+        ctime_ns = (int64_t)st.st_ctim.tv_sec * 1000000000 + st.st_ctim.tv_nsec;
+        algorithm = algorithm_id;
+    }
+
+    bool same_file(const file_identity &other) const {
+        return device == other.device && inode == other.inode && algorithm == other.algorithm;
+    }
+    bool operator==(const file_identity &other) const {
+        return same_file(other) && size == other.size &&
+            mtime_ns == other.mtime_ns && ctime_ns == other.ctime_ns;
+    }
+    bool operator!=(const file_identity &other) const {
+        return !(*this == other);
+    }
+};
+
+// file digests that survive across runs, one memory mapped file
+//
+// a 64 byte header and a power of two number of fixed size slots, open
+// addressing with linear probing on (device, inode, algorithm), so a lookup
+// reads the mapping in place. a slot is replaced when its file changes
+// instead of piling up stale entries. the entry is only trusted when
+//   size, mtime and ctime still match: ctime can not be set back by hand
+//   the slot checksum matches: a torn write after a crash is a miss
+//   the file was older than racy_ns when it was hashed: a write in the
+//     same timestamp tick would otherwise keep the old digest
+// a file of another version, a wrong size or one left mid rebuild is reset.
+// one process at a time: open takes an exclusive lock and fails when it
+// is held, the caller then runs without a cache
+class digest_cache {
+public:
+    enum {
+        max_digest = 32,
+        version = 1,
+    };
+    static const int64_t racy_ns = 2000000000;
+
+    digest_cache() : fd_(-1), map_(nullptr), map_size_(0) {}
+    ~digest_cache() {
+        close();
+    }
+    digest_cache(const digest_cache &) = delete;
+    digest_cache &operator=(const digest_cache &) = delete;
+
+    // stable id of an algorithm name, FNV-1a
+    static uint32_t algorithm_id(const char *name) {
+        uint32_t h = 2166136261u;
+        for (; *name; name++) {
+            h = (h ^ (uint8_t)*name) * 16777619u;
+        }
+        return h;
+    }
+
+    // nanoseconds since the epoch, the clock mtime is on
+    static int64_t now_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    // maps path, created with slots entries when missing or unusable
+    // false when it can not be created or another process holds it
+    bool open(const std::string &path, size_t slots = 1 << 14) {
+        close();
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd_ < 0) {
+            return false;
+        }
+        if (flock(fd_, LOCK_EX | LOCK_NB) != 0) {
+            close();
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd_, &st) != 0) {
+            close();
+            return false;
+        }
+        if (st.st_size >= (off_t)sizeof(header) && map((size_t)st.st_size) && valid()) {
+            return true;
+        }
+        size_t count = 16;
+        while (count < slots) {
+            count <<= 1;
+        }
+        if (!reset(count)) {
+            close();
+            return false;
+        }
+        return true;
+    }
+    void close() {
+        unmap();
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+    }
+
+    bool is_open() const {
+        return map_ != nullptr;
+    }
+    size_t size() const {
+        return map_ ? head()->used : 0;
+    }
+    size_t capacity() const {
+        return map_ ? head()->slots : 0;
+    }
+
+    // digest_size bytes of the digest of id, false when there is no valid entry
+    bool lookup(const file_identity &id, void *digest, size_t digest_size) const {
+        if (!map_) {
+            return false;
+        }
+        const slot *s = find(id);
+        if (s->digest_size != digest_size || !s->matches(id) || s->check != s->checksum()) {
+            return false;
+        }
+        memcpy(digest, s->digest, digest_size);
+        return true;
+    }
+
+    // id was taken before the file was read and again after, equal both times
+    // started_ns: now_ns() before the file was read
+    // false when the entry is not stored, the file is too fresh to trust
+    bool store(const file_identity &id, const void *digest, size_t digest_size, int64_t started_ns) {
+        if (!map_ || digest_size == 0 || digest_size > max_digest || id.mtime_ns + racy_ns > started_ns ||
+                id.ctime_ns + racy_ns > started_ns) {
+            return false;
+        }
+        slot *s = find(id);
+        if (!s->empty()) {
+            // the same file, replaced in place
+            s->digest_size = 0;
+        } else {
+            if ((head()->used + 1) * 4 > head()->slots * 3) {
+                if (!grow()) {
+                    return false;
+                }
+                s = find(id);
+            }
+            head()->used++;
+        }
+        // the checksum covers every field, a slot torn by a crash is a miss
+        s->device = id.device;
+        s->inode = id.inode;
+        s->size = id.size;
+        s->mtime_ns = id.mtime_ns;
+        s->ctime_ns = id.ctime_ns;
+        s->algorithm = id.algorithm;
+        memset(s->digest, 0, sizeof(s->digest));
+        memcpy(s->digest, digest, digest_size);
+        s->digest_size = (uint32_t)digest_size;
+        s->check = s->checksum();
+        return true;
+    }
+
+private:
+    enum { clean = 0, rebuilding = 1 };
+    static const uint64_t magic = 0x6568636163646766ull; // "fgdcache" as written on little endian
+
+    struct header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t slot_size;
+        uint64_t slots;
+        uint64_t used;
+        uint32_t state;
+        uint8_t reserved[28];
+    };
+
+    struct slot {
+        uint64_t device;
+        uint64_t inode;
+        uint64_t size;
+        int64_t mtime_ns;
+        int64_t ctime_ns;
+        uint32_t algorithm;
+        uint32_t digest_size;   // 0: empty
+        uint64_t check;
+        uint8_t digest[max_digest];
+
+        bool empty() const {
+            return digest_size == 0;
+        }
+        bool matches(const file_identity &id) const {
+            return size == id.size && mtime_ns == id.mtime_ns && ctime_ns == id.ctime_ns;
+        }
+        uint64_t checksum() const {
+            uint64_t h = mix(device ^ mix(inode ^ mix(size ^ mix(mtime_ns ^ mix(ctime_ns)))));
+            h = mix(h ^ ((uint64_t)algorithm << 32 | digest_size));
+            for (size_t i = 0; i < max_digest; i += 8) {
+                uint64_t word;
+                memcpy(&word, digest + i, 8);
+                h = mix(h ^ word);
+            }
+            return h | 1;
+        }
+    };
+
+    static inline uint64_t mix(uint64_t x) {
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    header *head() const {
+        return (header *)map_;
+    }
+    slot *slots() const {
+        return (slot *)(map_ + sizeof(header));
+    }
+
+    // the slot of id's file, or the empty slot that ends its probe
+    slot *find(const file_identity &id) const {
+        uint64_t mask = head()->slots - 1;
+        uint64_t i = mix(id.device ^ mix(id.inode ^ ((uint64_t)id.algorithm << 32))) & mask;
+        for (;; i = (i + 1) & mask) {
+            slot *s = slots() + i;
+            if (s->empty() || (s->device == id.device && s->inode == id.inode && s->algorithm == id.algorithm)) {
+                return s;
+            }
+        }
+    }
+
+    bool valid() const {
+        const header *h = head();
+        return h->magic == magic && h->version == version && h->slot_size == sizeof(slot) &&
+            h->state == clean && h->slots >= 16 && (h->slots & (h->slots - 1)) == 0 &&
+            map_size_ == sizeof(header) + h->slots * sizeof(slot) && h->used * 4 <= h->slots * 3;
+    }
+
+    bool map(size_t size) {
+        unmap();
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        map_ = (uint8_t *)p;
+        map_size_ = size;
+        return true;
+    }
+    void unmap() {
+        if (map_) {
+            munmap(map_, map_size_);
+            map_ = nullptr;
+            map_size_ = 0;
+        }
+    }
+
+    // an empty table of count slots, the header is marked clean last
+    bool reset(size_t count) {
+        size_t size = sizeof(header) + count * sizeof(slot);
+        unmap();
+        if (ftruncate(fd_, 0) != 0 || ftruncate(fd_, size) != 0 || !map(size)) {
+            return false;
+        }
+        header *h = head();
+        h->magic = magic;
+        h->version = version;
+        h->slot_size = sizeof(slot);
+        h->slots = count;
+        h->used = 0;
+        h->state = clean;
+        return true;
+    }
+
+    // twice the slots, live entries inserted again
+    bool grow() {
+        std::vector<slot> live;
+        live.reserve(head()->used);
+        for (uint64_t i = 0; i < head()->slots; i++) {
+            const slot &s = slots()[i];
+            if (!s.empty() && s.check == s.checksum()) {
+                live.push_back(s);
+            }
+        }
+        size_t count = head()->slots * 2;
+        size_t size = sizeof(header) + count * sizeof(slot);
+        head()->state = rebuilding;
+        unmap();
+        if (ftruncate(fd_, size) != 0 || !map(size)) {
+            return false;
+        }
+        memset(map_ + sizeof(header), 0, size - sizeof(header));
+        head()->slots = count;
+        head()->used = live.size();
+        for (size_t i = 0; i < live.size(); i++) {
+            file_identity id;
+            id.device = live[i].device;
+            id.inode = live[i].inode;
+            id.algorithm = live[i].algorithm;
+            *find(id) = live[i];
+        }
+        head()->state = clean;
+        return true;
+    }
+
+    int fd_;
+    uint8_t *map_;
+    size_t map_size_;
+};
+
+} // namespace fingera
@@ -0,0 +1,79 @@
+/**
+ * @file digest_filter.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-25
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include "compact.h"
+
+namespace fingera {
+
+// accepts the lanes whose digest starts with the given bits
+template<typename Hash>
+class prefix_filter {
+public:
+    using type = typename Hash::type;
+    using instrinsic = typename Hash::instrinsic;
+
+    prefix_filter(const void *prefix, size_t bits) {
+        uint8_t value[Hash::hash_size], mask[Hash::hash_size];
+        if (bits > Hash::hash_size * 8) {
+            bits = Hash::hash_size * 8;
+        }
+        memset(value, 0, sizeof(value));
+        memset(mask, 0, sizeof(mask));
+        memset(mask, 0xFF, bits / 8);
+        if (bits % 8) {
+            mask[bits / 8] = (uint8_t)(0xFF00 >> (bits % 8));
+        }
+        for (size_t i = 0; i < (bits + 7) / 8; i++) {
+            value[i] = ((const uint8_t *)prefix)[i] & mask[i];
+        }
+
+        words_ = (int)((bits + 31) / 32);
+        for (int i = 0; i < words_; i++) {
+            value_[i] = instrinsic::vector_mirror(Hash::digest_word(value, i));
+            mask_[i] = instrinsic::vector_mirror(Hash::digest_word(mask, i));
+        }
+    }
+
+    // s: Hash::state_size state vectors, returns bit i set when lane i matches
+    inline uint32_t operator()(const type *s) const {
+        uint32_t lanes = (uint32_t)((1ull << Hash::way()) - 1);
+        for (int i = 0; i < words_; i++) {
+            lanes &= instrinsic::vector_mask_eq(instrinsic::vector_and(s[i], mask_[i]), value_[i]);
+        }
+        return lanes;
+    }
+
+private:
+    int words_;
+    type value_[Hash::state_size];
+    type mask_[Hash::state_size];
+};
+
+// same as Hash::process_trunk, but only the lanes accepted by filter are
+// extracted from the state: out gets their digests packed, lanes their index
+// returns the number of accepted lanes
+template<typename Hash, typename Filter>
+size_t process_trunk_if(void *out, uint32_t *lanes, const void *blocks, int count, const Filter &filter) {
+    typename Hash::type s[Hash::state_size];
+    Hash::init(s);
+    Hash::process_blocks(s, blocks, count);
+
+    uint32_t mask = filter(s);
+    size_t n = 0;
+    while (mask) {
+        uint32_t lane = __builtin_ctz(mask);
+        mask &= mask - 1;
+        lanes[n] = lane;
+        Hash::save_lane((uint8_t *)out + n * Hash::hash_size, s, lane);
+        n++;
+    }
+    return n;
+}
+
+} // namespace fingera
@@ -0,0 +1,122 @@
+/**
+ * @file digest_index.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-26
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <array>
+#include <vector>
+#include "compact.h"
+#include "digest_filter.h"
+
+namespace fingera {
+
+// set of watched digests, queried straight from the state vectors of a kernel
+//
+// a blocked bloom filter screens the lanes: the first digest word picks a
+// 64 byte block, the second one picks two words in that block and two bits
+// in each, all looked up with vector gathers. lanes passing the bloom
+// filter get an exact binary search in the sorted digest list.
+template<typename Hash>
+class digest_index {
+public:
+    using type = typename Hash::type;
+    using instrinsic = typename Hash::instrinsic;
+    using digest = std::array<uint8_t, Hash::hash_size>;
+
+    explicit digest_index(size_t expected, size_t bits_per_digest = 16) {
+        size_t blocks = 1;
+        while (blocks * 512 < expected * bits_per_digest && blocks < (1u << 26)) {
+            blocks <<= 1;
+        }
+        block_mask_ = (uint32_t)(blocks - 1);
+        bits_.assign(blocks * 16, 0);
+
+        // two bits out of 32 for each 10 bit pattern index
+        patterns_.resize(1024);
+        for (uint32_t i = 0; i < 1024; i++) {
+            patterns_[i] = (1u << (i & 31)) | (1u << (i >> 5));
+        }
+        digests_.reserve(expected);
+    }
+
+    // call sort() after the last insert
+    void insert(const void *d) {
+        uint32_t h1 = Hash::digest_word(d, 0);
+        uint32_t h2 = Hash::digest_word(d, 1);
+        uint32_t base = (h1 & block_mask_) << 4;
+        bits_[base | (h2 & 15)] |= patterns_[(h2 >> 8) & 1023];
+        bits_[base | ((h2 >> 4) & 15)] |= patterns_[(h2 >> 18) & 1023];
+
+        digest item;
+        memcpy(item.data(), d, Hash::hash_size);
+        digests_.push_back(item);
+    }
+    void sort() {
+        std::sort(digests_.begin(), digests_.end());
+        digests_.erase(std::unique(digests_.begin(), digests_.end()), digests_.end());
+    }
+
+    size_t size() const {
+        return digests_.size();
+    }
+
+    bool contains(const void *d) const {
+        digest item;
+        memcpy(item.data(), d, Hash::hash_size);
+        return std::binary_search(digests_.begin(), digests_.end(), item);
+    }
+
+    // bloom filter on Hash::state_size state vectors, bit i set when lane i may be watched
+    inline uint32_t operator()(const type *s) const {
+        type h2 = s[1];
+        type base = instrinsic::template vector_shl<4>(
+            instrinsic::vector_and(s[0], instrinsic::vector_mirror(block_mask_)));
+        type low = instrinsic::vector_mirror(15);
+        type pattern = instrinsic::vector_mirror(1023);
+
+        type i1 = instrinsic::vector_or(base, instrinsic::vector_and(h2, low));
+        type i2 = instrinsic::vector_or(base,
+            instrinsic::vector_and(instrinsic::template vector_shr<4>(h2), low));
+        type p1 = instrinsic::vector_gather(patterns_.data(),
+            instrinsic::vector_and(instrinsic::template vector_shr<8>(h2), pattern));
+        type p2 = instrinsic::vector_gather(patterns_.data(),
+            instrinsic::vector_and(instrinsic::template vector_shr<18>(h2), pattern));
+
+        type w1 = instrinsic::vector_gather(bits_.data(), i1);
+        type w2 = instrinsic::vector_gather(bits_.data(), i2);
+        return instrinsic::vector_mask_eq(instrinsic::vector_and(w1, p1), p1) &
+            instrinsic::vector_mask_eq(instrinsic::vector_and(w2, p2), p2);
+    }
+
+    // hashes one trunk, keeps the lanes whose digest is in the set
+    // out/lanes as for process_trunk_if, returns the number of matches
+    size_t process_trunk(void *out, uint32_t *lanes, const void *blocks, int count = 1) const {
+        size_t candidates = process_trunk_if<Hash>(out, lanes, blocks, count, *this);
+        size_t n = 0;
+        for (size_t i = 0; i < candidates; i++) {
+            const uint8_t *d = (const uint8_t *)out + i * Hash::hash_size;
+            if (!contains(d)) {
+                continue;
+            }
+            if (n != i) {
+                memmove((uint8_t *)out + n * Hash::hash_size, d, Hash::hash_size);
+                lanes[n] = lanes[i];
+            }
+            n++;
+        }
+        return n;
+    }
+
+private:
+    uint32_t block_mask_;
+    std::vector<uint32_t, aligned_allocator<uint32_t, 64> > bits_;
+    std::vector<uint32_t> patterns_;
+    std::vector<digest> digests_;
+};
+
+} // namespace fingera
@@ -0,0 +1,446 @@
+/**
+ * @file fastcdc.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-03
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <errno.h>
+#include <unistd.h>
+#include "compact.h"
+#include "sha256_refill.h"
+
+namespace fingera {
+
+// one chunk of the stream and its sha256
+struct chunk_record {
+    uint64_t offset;
+    uint32_t length;
+    uint8_t digest[32];
+};
+
+// FastCDC sizes, avg_size a power of two, min_size at least 64
+struct cdc_params {
+    size_t min_size;
+    size_t avg_size;
+    size_t max_size;
+
+    cdc_params(size_t min = 2048, size_t avg = 8192, size_t max = 65536)
+        : min_size(min), avg_size(avg), max_size(max) {}
+};
+
+// the gear table, fixed: boundaries must not move between versions
+struct gear_table {
+    uint32_t gear[256];
+
+    gear_table() {
+        uint64_t x = 0x6765617274626c65ull;
+        for (int i = 0; i < 256; i++) {
+            // splitmix64
+            uint64_t z = (x += 0x9e3779b97f4a7c15ull);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            gear[i] = (uint32_t)((z ^ (z >> 31)) >> 32);
+        }
+    }
+
+    static const gear_table &get() {
+        static const gear_table table;
+        return table;
+    }
+};
+
+// content defined chunking, FastCDC with normalized chunking on a 32 bit gear hash
+//
+// h = (h << 1) + gear[byte] forgets a byte after 32 steps and the masks
+// take the top bits, so the hash at a position only depends on the 32
+// bytes up to it. that lets way() lanes hash separate stretches of the
+// buffer at once, each starting 32 bytes early, into a bitmap of the
+// positions that pass the large mask. the small mask holds the large one,
+// its rare candidates are checked again from the bytes. the cut rules then
+// run over the bitmap, a word at a time
+template<typename Instrinsic>
+class gear_chunker {
+public:
+    using type = typename Instrinsic::type;
+
+    static inline size_t way() {
+        return sizeof(type) / sizeof(uint32_t);
+    }
+
+    explicit gear_chunker(const cdc_params &params = cdc_params()) : params_(params) {
+        int bits = 0;
+        while (((size_t)1 << bits) < params.avg_size) {
+            bits++;
+        }
+        // normalization level 2
+        mask_small_ = ~0u << (32 - (bits + 2));
+        mask_large_ = ~0u << (32 - (bits - 2));
+    }
+
+    const cdc_params &params() const {
+        return params_;
+    }
+
+    // chunk lengths of data, a chunk starts at data
+    // eof: the data ends the stream, else the unfinished last chunk is left
+    // returns the bytes the chunks cover
+    size_t cut(const uint8_t *data, size_t size, bool eof, std::vector<uint32_t> &lengths) {
+        bits_.assign((size + 31) / 32, 0);
+        candidates(data, size, bits_.data());
+
+        size_t start = 0;
+        while (start < size) {
+            size_t left = size - start;
+            size_t n = left < params_.max_size ? left : params_.max_size;
+            bool complete = eof || left >= params_.max_size;
+            size_t length = 0;
+            if (n <= params_.min_size) {
+                length = complete ? n : 0;
+            } else {
+                size_t normal = n < params_.avg_size ? n : params_.avg_size;
+                length = find_small(data, start + params_.min_size, start + normal);
+                if (!length && (complete || normal < n)) {
+                    length = find(start + normal, start + n);
+                }
+                if (length) {
+                    length -= start;
+                } else if (complete) {
+                    length = n;
+                }
+            }
+            if (!length) {
+                break;
+            }
+            lengths.push_back((uint32_t)length);
+            start += length;
+        }
+        return start;
+    }
+
+    // bit i % 32 of bits[i / 32] set when the hash up to byte i passes the large mask
+    // positions below 32 are hashed from the start of data
+    void candidates(const uint8_t *data, size_t size, uint32_t *bits) const {
+        size_t words = size / 32;
+        size_t per_lane = words > 1 ? (words - 1) / way() : 0;
+        if (per_lane) {
+            candidates_lanes(data, per_lane, bits);
+        }
+        candidates_scalar(data, 0, 32 < size ? 32 : size, bits);
+        candidates_scalar(data, 32 * (1 + per_lane * way()), size, bits);
+    }
+
+private:
+    // lane l: words 1 + l * per_lane on, after 32 bytes of warm up
+    void candidates_lanes(const uint8_t *data, size_t per_lane, uint32_t *bits) const {
+        enum { lanes = sizeof(type) / sizeof(uint32_t) };
+        const uint32_t *gear = gear_table::get().gear;
+        const void *ptrs[lanes];
+        for (size_t l = 0; l < lanes; l++) {
+            ptrs[l] = data + 32 * l * per_lane;
+        }
+        const type low = Instrinsic::vector_mirror(0xFF);
+        const type mask = Instrinsic::vector_mirror(mask_large_);
+        const type minus_one = Instrinsic::vector_mirror(0xFFFFFFFFul);
+        const type top = Instrinsic::vector_mirror(0x80000000ul);
+        type h = Instrinsic::vector_mirror(0);
+
+        for (size_t k = 0; k <= per_lane; k++) {
+            type acc = Instrinsic::vector_mirror(0);
+            for (int q = 0; q < 8; q++) {
+                // 4 bytes, the first one in the top bits
+                type word = Instrinsic::load_lanes(ptrs, (int)(32 * k + 4 * q));
+                step(h, acc, Instrinsic::template vector_shr<24>(word), gear, mask, minus_one, top);
+                step(h, acc, Instrinsic::vector_and(Instrinsic::template vector_shr<16>(word), low), gear, mask, minus_one, top);
+                step(h, acc, Instrinsic::vector_and(Instrinsic::template vector_shr<8>(word), low), gear, mask, minus_one, top);
+                step(h, acc, Instrinsic::vector_and(word, low), gear, mask, minus_one, top);
+            }
+            // word 0 of a lane is the warm up
+            if (k) {
+                Instrinsic::save_le(bits + 1, (int)(4 * (k - 1)), acc, 4 * per_lane);
+            }
+        }
+    }
+
+    // acc takes one bit per byte from the top, set when h & mask is 0
+    static inline void step(type &h, type &acc, type byte, const uint32_t *gear,
+            type mask, type minus_one, type top) {
+        h = Instrinsic::vector_add(Instrinsic::template vector_shl<1>(h), Instrinsic::vector_gather(gear, byte));
+        type x = Instrinsic::vector_and(h, mask);
+        // (x - 1) & ~x has the top bit only when x is 0
+        type zero = Instrinsic::vector_and(Instrinsic::vector_andnot(x, Instrinsic::vector_add(x, minus_one)), top);
+        acc = Instrinsic::vector_or(Instrinsic::template vector_shr<1>(acc), zero);
+    }
+
+    void candidates_scalar(const uint8_t *data, size_t from, size_t to, uint32_t *bits) const {
+        if (from >= to) {
+            return;
+        }
+        uint32_t h = hash_before(data, from);
+        for (size_t i = from; i < to; i++) {
+            h = (h << 1) + gear_table::get().gear[data[i]];
+            if (!(h & mask_large_)) {
+                bits[i / 32] |= 1u << (i % 32);
+            }
+        }
+    }
+
+    // the hash over the up to 31 bytes before position
+    static inline uint32_t hash_before(const uint8_t *data, size_t position) {
+        const uint32_t *gear = gear_table::get().gear;
+        uint32_t h = 0;
+        for (size_t i = position > 31 ? position - 31 : 0; i < position; i++) {
+            h = (h << 1) + gear[data[i]];
+        }
+        return h;
+    }
+
+    // one past the first large candidate in [from, to), 0 when none
+    size_t find(size_t from, size_t to) const {
+        size_t i = from;
+        while (i < to) {
+            uint32_t word = bits_[i / 32] >> (i % 32);
+            if (!word) {
+                i = (i / 32 + 1) * 32;
+                continue;
+            }
+            i += __builtin_ctz(word);
+            return i < to ? i + 1 : 0;
+        }
+        return 0;
+    }
+    // the same for candidates that pass the small mask too
+    size_t find_small(const uint8_t *data, size_t from, size_t to) const {
+        for (size_t i = find(from, to); i; i = find(i, to)) {
+            uint32_t h = (hash_before(data, i - 1) << 1) + gear_table::get().gear[data[i - 1]];
+            if (!(h & mask_small_)) {
+                return i;
+            }
+        }
+        return 0;
+    }
+
+    cdc_params params_;
+    uint32_t mask_small_;
+    uint32_t mask_large_;
+    std::vector<uint32_t> bits_;
+};
+
+// chunks of a stream and their sha256, chunking and hashing on two threads
+//
+// the calling thread reads the stream into segments and cuts them, the
+// hashing thread feeds the chunks to sha256_refill and hands the records
+// back in stream order. a segment goes back to the reader once all of its
+// chunks are hashed, the unfinished last chunk is copied to the next one
+template<typename Instrinsic>
+class cdc_pipeline {
+public:
+    using callback = std::function<void(const chunk_record &)>;
+
+    // segment_size: at least 4 * max_size
+    explicit cdc_pipeline(const cdc_params &params = cdc_params(), size_t segment_size = 8 << 20, size_t segments = 4)
+            : chunker_(params), segment_size_(segment_size), segments_(segments) {
+        if (segment_size_ < 4 * params.max_size) {
+            segment_size_ = 4 * params.max_size;
+        }
+    }
+
+    // the whole of fd, done runs on the hashing thread, false on a read error
+    bool run(int fd, callback done) {
+        return run(done, false, [fd, this](segment &seg, size_t carry) {
+            size_t size = carry;
+            while (size < segment_size_) {
+                ssize_t n = read(fd, seg.buffer.data() + size, segment_size_ - size);
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (n < 0) {
+                    return -1;
+                }
+                if (n == 0) {
+                    seg.size = size;
+                    return 1;
+                }
+                size += n;
+            }
+            seg.size = size;
+            return 0;
+        });
+    }
+
+    // size bytes at data, read in place
+    void run(const void *data, size_t size, callback done) {
+        const uint8_t *begin = (const uint8_t *)data;
+        run(done, true, [begin, size, this](segment &seg, size_t) {
+            size_t left = size - seg.offset;
+            seg.data = begin + seg.offset;
+            seg.size = left < segment_size_ ? left : segment_size_;
+            return seg.size == left ? 1 : 0;
+        });
+    }
+
+private:
+    struct segment {
+        uint64_t id;
+        std::vector<uint8_t> buffer;
+        const uint8_t *data;
+        size_t size;
+        uint64_t offset;
+        std::vector<chunk_record> chunks;
+        size_t submitted;
+        size_t pending;
+        bool last;
+    };
+
+    // fill(seg, carry): the segment from seg.offset on, carry bytes already in
+    // the buffer. 1 at the end of the stream, 0 when there is more, -1 on error
+    // in_place: fill points seg.data at the stream, nothing is copied
+    template<typename Fill>
+    bool run(callback done, bool in_place, Fill fill) {
+        pool_.assign(segments_, segment());
+        free_.clear();
+        ready_.clear();
+        for (size_t i = 0; i < pool_.size(); i++) {
+            pool_[i].id = i;
+            free_.push_back(&pool_[i]);
+        }
+        std::thread hasher(&cdc_pipeline::hash, this, done);
+
+        bool ok = true;
+        uint64_t offset = 0;
+        std::vector<uint8_t> carry;
+        std::vector<uint32_t> lengths;
+        for (;;) {
+            segment *seg = take(free_);
+            seg->offset = offset;
+            if (!in_place) {
+                seg->buffer.resize(segment_size_);
+                seg->data = seg->buffer.data();
+                memcpy(seg->buffer.data(), carry.data(), carry.size());
+            }
+            int status = fill(*seg, carry.size());
+            if (status < 0) {
+                ok = false;
+                status = 1;
+            }
+
+            lengths.clear();
+            size_t used = chunker_.cut(seg->data, seg->size, status == 1, lengths);
+            seg->chunks.resize(lengths.size());
+            uint64_t at = offset;
+            for (size_t i = 0; i < lengths.size(); i++) {
+                seg->chunks[i].offset = at;
+                seg->chunks[i].length = lengths[i];
+                at += lengths[i];
+            }
+            seg->submitted = 0;
+            seg->pending = lengths.size();
+            seg->last = status == 1;
+            if (!in_place) {
+                carry.assign(seg->data + used, seg->data + seg->size);
+            }
+            offset += used;
+            give(ready_, seg);
+            if (status == 1) {
+                break;
+            }
+        }
+        hasher.join();
+        return ok;
+    }
+
+    void hash(callback done) {
+        sha256_refill<Instrinsic> engine;
+        std::deque<segment *> inflight;
+        auto finished = [this](uint64_t tag, const uint8_t *digest) {
+            segment *seg = &pool_[tag >> 32];
+            memcpy(seg->chunks[(uint32_t)tag].digest, digest, 32);
+            seg->pending--;
+        };
+
+        bool last = false;
+        for (;;) {
+            // records leave in order, a segment once all of its chunks did
+            while (!inflight.empty() && inflight.front()->submitted == inflight.front()->chunks.size() &&
+                    inflight.front()->pending == 0) {
+                segment *seg = inflight.front();
+                for (size_t i = 0; i < seg->chunks.size(); i++) {
+                    done(seg->chunks[i]);
+                }
+                last = seg->last;
+                inflight.pop_front();
+                give(free_, seg);
+            }
+            if (last) {
+                return;
+            }
+
+            // keep every lane busy, wait for the reader only with nothing to hash
+            segment *seg = inflight.empty() ? nullptr : inflight.back();
+            while (!engine.full()) {
+                if (!seg || seg->submitted == seg->chunks.size()) {
+                    if (seg && seg->last) {
+                        break;
+                    }
+                    segment *next = engine.idle() ? take(ready_) : try_take(ready_);
+                    if (!next) {
+                        break;
+                    }
+                    inflight.push_back(next);
+                    seg = next;
+                    continue;
+                }
+                // tag: the segment in the pool and the chunk in the segment
+                const chunk_record &c = seg->chunks[seg->submitted];
+                engine.submit(seg->data + (c.offset - seg->offset), c.length, seg->id << 32 | seg->submitted);
+                seg->submitted++;
+            }
+            if (!engine.idle()) {
+                engine.step(finished);
+            }
+        }
+    }
+
+    segment *take(std::deque<segment *> &queue) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cond_.wait(lock, [&queue] { return !queue.empty(); });
+        segment *seg = queue.front();
+        queue.pop_front();
+        return seg;
+    }
+    segment *try_take(std::deque<segment *> &queue) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (queue.empty()) {
+            return nullptr;
+        }
+        segment *seg = queue.front();
+        queue.pop_front();
+        return seg;
+    }
+    void give(std::deque<segment *> &queue, segment *seg) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            queue.push_back(seg);
+        }
+        cond_.notify_all();
+    }
+
+    gear_chunker<Instrinsic> chunker_;
+    size_t segment_size_;
+    size_t segments_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::vector<segment> pool_;
+    std::deque<segment *> free_;
+    std::deque<segment *> ready_;
+};
+
+} // namespace fingera
@@ -0,0 +1,149 @@
+/**
+ * @file hash_backends.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-04
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include "trunk_arena.h"
+
+namespace fingera {
+
+enum {
+    // blocks per lane of a batch trunk, 64KB: longer messages go through
+    // it a window at a time
+    max_batch_blocks = 1024,
+};
+
+// n <= way() messages with more than max_batch_blocks blocks, digest i at out[i]
+//
+// the lanes advance together a window of max_batch_blocks blocks at a time,
+// so the trunk stays at the size of one window however long the messages
+// are. a window ends where a lane does, to save that lane's state. with a
+// one lane kernel the full blocks are hashed in place, the message is
+// streamed from where it is (a file mapping) without a copy
+template<typename Hash>
+void hash_window(uint8_t *const *out, const void *const *data, const size_t *sizes, size_t n) {
+    using type = typename Hash::type;
+    enum { lanes = sizeof(type) / sizeof(uint32_t) };
+    const size_t way = Hash::way();
+    uint8_t tails[lanes][128];
+    size_t full[lanes], counts[lanes], total = 0;
+    for (size_t l = 0; l < n; l++) {
+        full[l] = sizes[l] / 64;
+        counts[l] = full[l] + Hash::pad_tail(tails[l], (const uint8_t *)data[l] + 64 * full[l], sizes[l]);
+        total = counts[l] > total ? counts[l] : total;
+    }
+
+    trunk_arena<Hash> arena(max_batch_blocks);
+    uint8_t *trunk = arena.trunk();
+    if (way > 1) {
+        // lanes unused or done early hash whatever is in the trunk, let it be zeros
+        memset(trunk, 0, arena.trunk_size());
+    }
+    type s[Hash::state_size];
+    Hash::init(s);
+    for (size_t done = 0; done < total;) {
+        size_t end = done + max_batch_blocks < total ? done + max_batch_blocks : total;
+        for (size_t l = 0; l < n; l++) {
+            end = counts[l] > done && counts[l] < end ? counts[l] : end;
+        }
+        if (way == 1 && done < full[0]) {
+            end = end < full[0] ? end : full[0];
+            Hash::process_blocks(s, (const uint8_t *)data[0] + 64 * done, (int)(end - done));
+        } else {
+            for (size_t i = done; i < end; i++) {
+                for (size_t l = 0; l < n; l++) {
+                    uint8_t *block = trunk + 64 * ((i - done) * way + l);
+                    if (i < full[l]) {
+                        memcpy(block, (const uint8_t *)data[l] + 64 * i, 64);
+                    } else if (i < counts[l]) {
+                        memcpy(block, tails[l] + 64 * (i - full[l]), 64);
+                    }
+                }
+            }
+            Hash::process_blocks(s, trunk, (int)(end - done));
+        }
+
+        bool saved = false;
+        for (size_t l = 0; l < n; l++) {
+            if (counts[l] != end) {
+                continue;
+            }
+            if (!saved) {
+                Hash::save_state(arena.digest(), s);
+                saved = true;
+            }
+            memcpy(out[l], arena.digest(l), Hash::hash_size);
+        }
+        done = end;
+    }
+}
+
+// count messages of any length, digests packed in out
+//
+// the messages go to the lanes in order of size, so the lanes of a kernel
+// call carry messages of close lengths and few blocks are padding
+template<typename Hash>
+void hash_batch(void *out, const void *const *data, const size_t *sizes, size_t count) {
+    enum { lanes = sizeof(typename Hash::type) / sizeof(uint32_t) };
+    std::vector<uint32_t> order(count);
+    for (size_t i = 0; i < count; i++) {
+        order[i] = (uint32_t)i;
+    }
+    std::sort(order.begin(), order.end(), [sizes](uint32_t x, uint32_t y) {
+        return sizes[x] < sizes[y];
+    });
+
+    for (size_t begin = 0; begin < count; begin += Hash::way()) {
+        size_t n = count - begin < Hash::way() ? count - begin : Hash::way();
+        const uint32_t *lane = order.data() + begin;
+        // the longest is last
+        size_t blocks = Hash::block_count(sizes[lane[n - 1]]);
+        if (blocks > max_batch_blocks) {
+            const void *ptrs[lanes];
+            size_t lengths[lanes];
+            uint8_t *digests[lanes];
+            for (size_t i = 0; i < n; i++) {
+                ptrs[i] = data[lane[i]];
+                lengths[i] = sizes[lane[i]];
+                digests[i] = (uint8_t *)out + lane[i] * Hash::hash_size;
+            }
+            hash_window<Hash>(digests, ptrs, lengths, n);
+            continue;
+        }
+
+        trunk_arena<Hash> arena((int)blocks);
+        for (size_t i = 0; i < n; i++) {
+            arena.add(data[lane[i]], sizes[lane[i]]);
+        }
+        arena.process();
+        for (size_t i = 0; i < n; i++) {
+            memcpy((uint8_t *)out + lane[i] * Hash::hash_size, arena.digest(i), Hash::hash_size);
+        }
+    }
+}
+
+// hash_batch of the vector backends, each in a translation unit of its own
+// built with the flags of its instruction set (hash_backends_*.cpp), the
+// rest of the program stays on the baseline. only call the ones
+// cpu_features reports.
+//
+// such a file includes the headers with fingera defined to a namespace of
+// its own, so none of its inline code shares a name with another copy and
+// the linker can not pick it for code that runs without the instruction set
+void sha256_batch_sse4(void *out, const void *const *data, const size_t *sizes, size_t count);
+void sha256_batch_avx2(void *out, const void *const *data, const size_t *sizes, size_t count);
+void sha256_batch_avx512(void *out, const void *const *data, const size_t *sizes, size_t count);
+void sha256_batch_shani(void *out, const void *const *data, const size_t *sizes, size_t count);
+void sha256_batch_rorx(void *out, const void *const *data, const size_t *sizes, size_t count);
+
+void ripemd160_batch_sse4(void *out, const void *const *data, const size_t *sizes, size_t count);
+void ripemd160_batch_avx2(void *out, const void *const *data, const size_t *sizes, size_t count);
+void ripemd160_batch_avx512(void *out, const void *const *data, const size_t *sizes, size_t count);
+
+} // namespace fingera
@@ -0,0 +1,25 @@
+/**
+ * @file hash_backends_avx2.cpp
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-29
+ *
+ * built with -mavx2, see hash_backends.h
+ */
+#define fingera fingera_avx2
+#include "hash_backends.h"
+#include "sha256.h"
+#include "ripemd160.h"
+#include "instrinsic_avx2.h"
+#undef fingera
+
+namespace fingera {
+
+void sha256_batch_avx2(void *out, const void *const *data, const size_t *sizes, size_t count) {
+    fingera_avx2::hash_batch<fingera_avx2::sha256<fingera_avx2::instrinsic_avx2> >(out, data, sizes, count);
+}
+
+void ripemd160_batch_avx2(void *out, const void *const *data, const size_t *sizes, size_t count) {
+    fingera_avx2::hash_batch<fingera_avx2::ripemd160<fingera_avx2::instrinsic_avx2> >(out, data, sizes, count);
+}
+
+} // namespace fingera
@@ -0,0 +1,25 @@
+/**
+ * @file hash_backends_avx512.cpp
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-29
+ *
+ * built with -mavx512f, see hash_backends.h
+ */
+#define fingera fingera_avx512
+#include "hash_backends.h"
+#include "sha256.h"
+#include "ripemd160.h"
+#include "instrinsic_avx512.h"
+#undef fingera
+
+namespace fingera {
+
+void sha256_batch_avx512(void *out, const void *const *data, const size_t *sizes, size_t count) {
+    fingera_avx512::hash_batch<fingera_avx512::sha256<fingera_avx512::instrinsic_avx512> >(out, data, sizes, count);
+}
+
+void ripemd160_batch_avx512(void *out, const void *const *data, const size_t *sizes, size_t count) {
+    fingera_avx512::hash_batch<fingera_avx512::ripemd160<fingera_avx512::instrinsic_avx512> >(out, data, sizes, count);
+}
+
+} // namespace fingera
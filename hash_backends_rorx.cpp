@@ -0,0 +1,19 @@
+/**
+ * @file hash_backends_rorx.cpp
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-02
+ *
+ * built with -mavx2 -mbmi2, see hash_backends.h
+ */
+#define fingera fingera_rorx
+#include "hash_backends.h"
+#include "sha256_rorx.h"
+#undef fingera
+
+namespace fingera {
+
+void sha256_batch_rorx(void *out, const void *const *data, const size_t *sizes, size_t count) {
+    fingera_rorx::hash_batch<fingera_rorx::sha256_rorx>(out, data, sizes, count);
+}
+
+} // namespace fingera
@@ -0,0 +1,19 @@
+/**
+ * @file hash_backends_shani.cpp
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-29
+ *
+ * built with -msse4.1 -msha, see hash_backends.h
+ */
+#define fingera fingera_shani
+#include "hash_backends.h"
+#include "sha256_shani.h"
+#undef fingera
+
+namespace fingera {
+
+void sha256_batch_shani(void *out, const void *const *data, const size_t *sizes, size_t count) {
+    fingera_shani::hash_batch<fingera_shani::sha256_shani>(out, data, sizes, count);
+}
+
+} // namespace fingera
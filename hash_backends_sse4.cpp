@@ -0,0 +1,25 @@
+/**
+ * @file hash_backends_sse4.cpp
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-29
+ *
+ * built with -msse4.1, see hash_backends.h
+ */
+#define fingera fingera_sse4
+#include "hash_backends.h"
+#include "sha256.h"
+#include "ripemd160.h"
+#include "instrinsic_sse4.h"
+#undef fingera
+
+namespace fingera {
+
+void sha256_batch_sse4(void *out, const void *const *data, const size_t *sizes, size_t count) {
+    fingera_sse4::hash_batch<fingera_sse4::sha256<fingera_sse4::instrinsic_sse4> >(out, data, sizes, count);
+}
+
+void ripemd160_batch_sse4(void *out, const void *const *data, const size_t *sizes, size_t count) {
+    fingera_sse4::hash_batch<fingera_sse4::ripemd160<fingera_sse4::instrinsic_sse4> >(out, data, sizes, count);
+}
+
+} // namespace fingera
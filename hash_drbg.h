@@ -0,0 +1,328 @@
+/**
+ * @file hash_drbg.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-03
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "compact.h"
+#include "sha256.h"
+#include "sha256_shani.h"
+#include "instrinsic_one.h"
+
+namespace fingera {
+
+// NIST SP 800-90A Hash_DRBG on sha256, no prediction resistance
+//
+// the output of a request is sha256(V), sha256(V + 1), ... every V + i
+// is one 55 byte message in one padded block, only its last 4 bytes
+// move. bytes 0 .. 47 are the same for every lane, so rounds 0 .. 11 run
+// once on scalars into a midstate, as do the first schedule words that
+// only depend on them. lane l of a call hashes V + i + l with the counter
+// kept in a vector, digests go straight to the caller's buffer
+template<typename Instrinsic>
+class hash_drbg {
+public:
+    using type = typename Instrinsic::type;
+    using hash = sha256<Instrinsic>;
+
+    enum {
+        seed_size = 55,             // seedlen, 440 bits
+        max_request = 1 << 16,      // 2^19 bits per request
+    };
+
+    static inline size_t way() {
+        return hash::way();
+    }
+
+    // seed: entropy input and nonce, personalization may be empty
+    hash_drbg(const void *seed, size_t size, const void *personalization = nullptr, size_t personalization_size = 0) {
+        std::vector<uint8_t> material((const uint8_t *)seed, (const uint8_t *)seed + size);
+        append(material, personalization, personalization_size);
+        hash_df(v_, material);
+        update_c();
+    }
+
+    void reseed(const void *entropy, size_t size, const void *additional = nullptr, size_t additional_size = 0) {
+        std::vector<uint8_t> material(1, 0x01);
+        append(material, v_, seed_size);
+        append(material, entropy, size);
+        append(material, additional, additional_size);
+        hash_df(v_, material);
+        update_c();
+    }
+
+    uint64_t reseed_counter() const {
+        return reseed_counter_;
+    }
+
+    // size bytes, one generate request per max_request bytes
+    void generate(void *out, size_t size) {
+        uint8_t *cur = (uint8_t *)out;
+        while (size) {
+            size_t n = size < (size_t)max_request ? size : (size_t)max_request;
+            hashgen(cur, n);
+
+            // V = V + sha256(0x03 || V) + C + reseed_counter
+            std::vector<uint8_t> message(1, 0x03);
+            append(message, v_, seed_size);
+            uint8_t h[32], counter[8];
+            scalar_digest(h, message);
+            write_be64(counter, 0, reseed_counter_);
+            add(v_, h, 32);
+            add(v_, c_, seed_size);
+            add(v_, counter, 8);
+            reseed_counter_++;
+
+            cur += n;
+            size -= n;
+        }
+    }
+
+private:
+    using scalar = sha256<instrinsic_one>;
+
+    static void append(std::vector<uint8_t> &to, const void *data, size_t size) {
+        to.insert(to.end(), (const uint8_t *)data, (const uint8_t *)data + size);
+    }
+
+    static void scalar_digest(uint8_t *out, const std::vector<uint8_t> &message) {
+        std::vector<uint8_t> trunk(64 * (size_t)scalar::block_count(message.size()));
+        int count = scalar::fill_lane(trunk.data(), 0, message.data(), message.size(), 1);
+        scalar::process_trunk(out, trunk.data(), count);
+    }
+
+    // Hash_df to seed_size bytes
+    static void hash_df(uint8_t *out, const std::vector<uint8_t> &input) {
+        uint8_t temp[64];
+        for (uint8_t counter = 1; counter <= 2; counter++) {
+            std::vector<uint8_t> message(5);
+            message[0] = counter;
+            write_be32(message.data(), 1, seed_size * 8);
+            append(message, input.data(), input.size());
+            scalar_digest(temp + 32 * (counter - 1), message);
+        }
+        memcpy(out, temp, seed_size);
+    }
+
+    void update_c() {
+        std::vector<uint8_t> material(1, 0x00);
+        append(material, v_, seed_size);
+        hash_df(c_, material);
+        reseed_counter_ = 1;
+    }
+
+    // v += x mod 2^440, both big endian
+    static void add(uint8_t *v, const uint8_t *x, size_t size) {
+        unsigned carry = 0;
+        for (size_t i = 0; i < seed_size; i++) {
+            unsigned sum = v[seed_size - 1 - i] + carry + (i < size ? x[size - 1 - i] : 0);
+            v[seed_size - 1 - i] = (uint8_t)sum;
+            carry = sum >> 8;
+        }
+    }
+    static void add(uint8_t *v, uint32_t x) {
+        uint8_t be[4];
+        write_be32(be, 0, x);
+        add(v, be, 4);
+    }
+
+    // the words of data that do not depend on its last 4 bytes, already compressed
+    struct midstate {
+        uint32_t s[8];
+        uint32_t w[12];
+        uint32_t w16, w17, w18;
+        uint32_t w19, w20;          // without w12, w13
+        uint32_t high;              // word 12 without the top byte of the counter
+    };
+
+    static inline uint32_t ror(uint32_t x, int n) {
+        return (x >> n) | (x << (32 - n));
+    }
+    static inline uint32_t sigma0(uint32_t x) {
+        return ror(x, 7) ^ ror(x, 18) ^ (x >> 3);
+    }
+    static inline uint32_t sigma1(uint32_t x) {
+        return ror(x, 17) ^ ror(x, 19) ^ (x >> 10);
+    }
+
+    static void prepare(midstate &m, const uint8_t *data) {
+        const uint32_t *k = sha256_shani::constants();
+        uint32_t v[8];
+        scalar::init(v);
+        for (int i = 0; i < 12; i++) {
+            m.w[i] = read_be32(data, 4 * i);
+        }
+        for (int t = 0; t < 12; t++) {
+            uint32_t a = v[0], b = v[1], c = v[2], d = v[3], e = v[4], f = v[5], g = v[6], h = v[7];
+            uint32_t t1 = h + (ror(e, 6) ^ ror(e, 11) ^ ror(e, 25)) + ((e & f) ^ (~e & g)) + k[t] + m.w[t];
+            uint32_t t2 = (ror(a, 2) ^ ror(a, 13) ^ ror(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            v[7] = g; v[6] = f; v[5] = e; v[4] = d + t1;
+            v[3] = c; v[2] = b; v[1] = a; v[0] = t1 + t2;
+        }
+        memcpy(m.s, v, sizeof(v));
+        // w14 = 0, w15 = 440
+        m.w16 = sigma1(0) + m.w[9] + sigma0(m.w[1]) + m.w[0];
+        m.w17 = sigma1(seed_size * 8) + m.w[10] + sigma0(m.w[2]) + m.w[1];
+        m.w18 = sigma1(m.w16) + m.w[11] + sigma0(m.w[3]) + m.w[2];
+        m.w19 = sigma1(m.w17) + sigma0(m.w[4]) + m.w[3];
+        m.w20 = sigma1(m.w18) + sigma0(m.w[5]) + m.w[4];
+        m.high = read_be32(data, 48) & 0xFFFFFF00ul;
+    }
+
+    template<int N>
+    static inline type vror(type x) {
+        return Instrinsic::template vector_rol<32 - N>(x);
+    }
+    static inline type vsigma0(type x) {
+        return Instrinsic::vector_xor(Instrinsic::vector_xor(vror<7>(x), vror<18>(x)), Instrinsic::template vector_shr<3>(x));
+    }
+    static inline type vsigma1(type x) {
+        return Instrinsic::vector_xor(Instrinsic::vector_xor(vror<17>(x), vror<19>(x)), Instrinsic::template vector_shr<10>(x));
+    }
+
+    static inline void round(type a, type b, type c, type &d, type e, type f, type g, type &h, type kw) {
+        type s1 = Instrinsic::vector_xor(Instrinsic::vector_xor(vror<6>(e), vror<11>(e)), vror<25>(e));
+        type ch = Instrinsic::vector_xor(Instrinsic::vector_and(e, f), Instrinsic::vector_andnot(e, g));
+        type s0 = Instrinsic::vector_xor(Instrinsic::vector_xor(vror<2>(a), vror<13>(a)), vror<22>(a));
+        type maj = Instrinsic::vector_or(Instrinsic::vector_and(a, b), Instrinsic::vector_and(c, Instrinsic::vector_or(a, b)));
+        type t1 = Instrinsic::vector_add(Instrinsic::vector_add(h, s1), Instrinsic::vector_add(ch, kw));
+        d = Instrinsic::vector_add(d, t1);
+        h = Instrinsic::vector_add(t1, Instrinsic::vector_add(s0, maj));
+    }
+
+    // sha256 of way() messages, lane l ending in the 4 bytes counter + l
+    static inline void lanes(type *s, const midstate &m, type counter) {
+        const uint32_t *k = sha256_shani::constants();
+        type w[16];
+        for (int i = 0; i < 12; i++) {
+            w[i] = Instrinsic::vector_mirror(m.w[i]);
+        }
+        w[12] = Instrinsic::vector_or(Instrinsic::vector_mirror(m.high), Instrinsic::template vector_shr<24>(counter));
+        w[13] = Instrinsic::vector_or(Instrinsic::template vector_shl<8>(counter), Instrinsic::vector_mirror(0x80));
+        w[14] = Instrinsic::vector_mirror(0);
+        w[15] = Instrinsic::vector_mirror(seed_size * 8);
+
+        type a = Instrinsic::vector_mirror(m.s[0]), b = Instrinsic::vector_mirror(m.s[1]);
+        type c = Instrinsic::vector_mirror(m.s[2]), d = Instrinsic::vector_mirror(m.s[3]);
+        type e = Instrinsic::vector_mirror(m.s[4]), f = Instrinsic::vector_mirror(m.s[5]);
+        type g = Instrinsic::vector_mirror(m.s[6]), h = Instrinsic::vector_mirror(m.s[7]);
+
+        // rounds 12 .. 15 on the state as the midstate left it
+        round(a, b, c, d, e, f, g, h, Instrinsic::vector_add(Instrinsic::vector_mirror(k[12]), w[12]));
+        round(h, a, b, c, d, e, f, g, Instrinsic::vector_add(Instrinsic::vector_mirror(k[13]), w[13]));
+        round(g, h, a, b, c, d, e, f, Instrinsic::vector_mirror(k[14]));
+        round(f, g, h, a, b, c, d, e, Instrinsic::vector_mirror(k[15] + seed_size * 8));
+
+        // 16 .. 18 are shared, 19 and 20 only miss w12 and w13
+        w[0] = Instrinsic::vector_mirror(m.w16);
+        w[1] = Instrinsic::vector_mirror(m.w17);
+        w[2] = Instrinsic::vector_mirror(m.w18);
+        w[3] = Instrinsic::vector_add(Instrinsic::vector_mirror(m.w19), w[12]);
+        w[4] = Instrinsic::vector_add(Instrinsic::vector_mirror(m.w20), w[13]);
+        round(e, f, g, h, a, b, c, d, Instrinsic::vector_add(Instrinsic::vector_mirror(k[16]), w[0]));
+        round(d, e, f, g, h, a, b, c, Instrinsic::vector_add(Instrinsic::vector_mirror(k[17]), w[1]));
+        round(c, d, e, f, g, h, a, b, Instrinsic::vector_add(Instrinsic::vector_mirror(k[18]), w[2]));
+        round(b, c, d, e, f, g, h, a, Instrinsic::vector_add(Instrinsic::vector_mirror(k[19]), w[3]));
+        round(a, b, c, d, e, f, g, h, Instrinsic::vector_add(Instrinsic::vector_mirror(k[20]), w[4]));
+        for (int t = 21; t < 64; t += 8) {
+            round(h, a, b, c, d, e, f, g, next(w, k, t));
+            round(g, h, a, b, c, d, e, f, next(w, k, t + 1));
+            round(f, g, h, a, b, c, d, e, next(w, k, t + 2));
+            if (t + 3 == 64) {
+                break;
+            }
+            round(e, f, g, h, a, b, c, d, next(w, k, t + 3));
+            round(d, e, f, g, h, a, b, c, next(w, k, t + 4));
+            round(c, d, e, f, g, h, a, b, next(w, k, t + 5));
+            round(b, c, d, e, f, g, h, a, next(w, k, t + 6));
+            round(a, b, c, d, e, f, g, h, next(w, k, t + 7));
+        }
+
+        // 52 rounds leave the roles moved by 4 again, add the initial state
+        uint32_t iv[8];
+        scalar::init(iv);
+        s[0] = Instrinsic::vector_add(e, Instrinsic::vector_mirror(iv[0]));
+        s[1] = Instrinsic::vector_add(f, Instrinsic::vector_mirror(iv[1]));
+        s[2] = Instrinsic::vector_add(g, Instrinsic::vector_mirror(iv[2]));
+        s[3] = Instrinsic::vector_add(h, Instrinsic::vector_mirror(iv[3]));
+        s[4] = Instrinsic::vector_add(a, Instrinsic::vector_mirror(iv[4]));
+        s[5] = Instrinsic::vector_add(b, Instrinsic::vector_mirror(iv[5]));
+        s[6] = Instrinsic::vector_add(c, Instrinsic::vector_mirror(iv[6]));
+        s[7] = Instrinsic::vector_add(d, Instrinsic::vector_mirror(iv[7]));
+    }
+
+    // k[t] + W[t], W[t] replacing W[t - 16] in w
+    static inline type next(type *w, const uint32_t *k, int t) {
+        type &x = w[t & 15];
+        x = Instrinsic::vector_add(
+            Instrinsic::vector_add(x, vsigma1(w[(t - 2) & 15])),
+            Instrinsic::vector_add(w[(t - 7) & 15], vsigma0(w[(t - 15) & 15])));
+        return Instrinsic::vector_add(x, Instrinsic::vector_mirror(k[t]));
+    }
+
+    // Hashgen: sha256(V + i) for i = 0 .. ceil(size / 32) - 1, the first size bytes
+    void hashgen(uint8_t *out, size_t size) {
+        enum { lanes_count = sizeof(type) / sizeof(uint32_t) };
+        uint8_t data[seed_size];
+        memcpy(data, v_, seed_size);
+        midstate m;
+        prepare(m, data);
+
+        uint32_t first[lanes_count];
+        for (size_t l = 0; l < lanes_count; l++) {
+            first[l] = (uint32_t)l;
+        }
+        const type step = Instrinsic::vector_mirror((uint32_t)way());
+        type counter = Instrinsic::vector_add(Instrinsic::load_le(first, 0, 4), Instrinsic::vector_mirror(read_be32(data, 51)));
+
+        uint8_t digests[lanes_count * 32];
+        size_t block = 32 * way();
+        while (size) {
+            uint32_t low = read_be32(data, 51);
+            type s[8];
+            if (low > 0xFFFFFFFFul - (way() - 1)) {
+                // a lane carries into the bytes of the midstate, build the blocks
+                uint8_t trunk[lanes_count * 64];
+                memset(trunk, 0, sizeof(trunk));
+                for (size_t l = 0; l < way(); l++) {
+                    uint8_t *message = trunk + 64 * l;
+                    memcpy(message, data, seed_size);
+                    add(message, (uint32_t)l);
+                    message[seed_size] = 0x80;
+                    write_be64(message, 56, seed_size * 8);
+                }
+                hash::init(s);
+                hash::process_blocks(s, trunk, 1);
+            } else {
+                lanes(s, m, counter);
+            }
+
+            if (size >= block) {
+                hash::save_state(out, s);
+                out += block;
+                size -= block;
+            } else {
+                hash::save_state(digests, s);
+                memcpy(out, digests, size);
+                size = 0;
+            }
+
+            add(data, (uint32_t)way());
+            counter = Instrinsic::vector_add(counter, step);
+            if (read_be32(data, 51) < way()) {
+                // the carry reached the shared bytes
+                prepare(m, data);
+            }
+        }
+    }
+
+    uint8_t v_[seed_size];
+    uint8_t c_[seed_size];
+    uint64_t reseed_counter_;
+};
+
+} // namespace fingera
@@ -0,0 +1,209 @@
+/**
+ * @file hash_service.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-24
+ */
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "compact.h"
+#include "hash_backends.h"
+
+namespace fingera {
+
+// intrusive multi producer single consumer queue (Vyukov)
+class mpsc_queue {
+public:
+    struct node {
+        std::atomic<node *> next;
+    };
+
+    mpsc_queue() : head_(&stub_), tail_(&stub_) {
+        stub_.next.store(nullptr, std::memory_order_relaxed);
+    }
+    mpsc_queue(const mpsc_queue &) = delete;
+    mpsc_queue &operator=(const mpsc_queue &) = delete;
+
+    // any thread
+    void push(node *n) {
+        n->next.store(nullptr, std::memory_order_relaxed);
+        node *prev = head_.exchange(n, std::memory_order_acq_rel);
+        prev->next.store(n, std::memory_order_release);
+    }
+
+    // consumer thread only, nullptr when empty (or a push is half done)
+    node *pop() {
+        node *tail = tail_;
+        node *next = tail->next.load(std::memory_order_acquire);
+        if (tail == &stub_) {
+            if (!next) {
+                return nullptr;
+            }
+            tail_ = next;
+            tail = next;
+            next = next->next.load(std::memory_order_acquire);
+        }
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+        if (tail != head_.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        push(&stub_);
+        next = tail->next.load(std::memory_order_acquire);
+        if (next) {
+            tail_ = next;
+            return tail;
+        }
+        return nullptr;
+    }
+
+    bool empty() const {
+        return head_.load(std::memory_order_acquire) == &stub_ &&
+            stub_.next.load(std::memory_order_acquire) == nullptr;
+    }
+
+private:
+    std::atomic<node *> head_;
+    node *tail_;
+    node stub_;
+};
+
+// batches single messages from many threads into the lanes of Hash
+// a batch is hashed once way() jobs are queued, or when the oldest job
+// has waited for deadline
+template<typename Hash>
+class hash_service {
+public:
+    using digest = std::vector<uint8_t>;
+    // digest points to Hash::hash_size bytes, valid during the call
+    using callback = std::function<void(const uint8_t *digest)>;
+
+    explicit hash_service(std::chrono::nanoseconds deadline = std::chrono::microseconds(20))
+            : deadline_(deadline), stop_(false), sleeping_(false) {
+        worker_ = std::thread(&hash_service::run, this);
+    }
+    ~hash_service() {
+        stop_.store(true);
+        wake();
+        worker_.join();
+    }
+    hash_service(const hash_service &) = delete;
+    hash_service &operator=(const hash_service &) = delete;
+
+    static inline size_t way() {
+        return Hash::way();
+    }
+
+    // the message is copied, the callback runs on the worker thread
+    void submit(const void *data, size_t size, callback done) {
+        job *j = new job;
+        j->data.assign((const uint8_t *)data, (const uint8_t *)data + size);
+        j->done = std::move(done);
+        j->queued = clock::now();
+        queue_.push(j);
+        if (sleeping_.load()) {
+            wake();
+        }
+    }
+    std::future<digest> submit(const void *data, size_t size) {
+        std::shared_ptr<std::promise<digest> > result = std::make_shared<std::promise<digest> >();
+        std::future<digest> f = result->get_future();
+        submit(data, size, [result](const uint8_t *d) {
+            result->set_value(digest(d, d + Hash::hash_size));
+        });
+        return f;
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct job : mpsc_queue::node {
+        std::vector<uint8_t> data;
+        callback done;
+        clock::time_point queued;
+    };
+
+    void wake() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cond_.notify_one();
+    }
+
+    void dispatch(std::vector<job *> &batch) {
+        enum { lanes = sizeof(typename Hash::type) / sizeof(uint32_t) };
+        const void *data[lanes];
+        size_t sizes[lanes];
+        uint8_t digests[lanes * Hash::hash_size];
+        for (size_t i = 0; i < batch.size(); i++) {
+            data[i] = batch[i]->data.data();
+            sizes[i] = batch[i]->data.size();
+        }
+        hash_batch<Hash>(digests, data, sizes, batch.size());
+
+        for (size_t i = 0; i < batch.size(); i++) {
+            batch[i]->done(digests + i * Hash::hash_size);
+            delete batch[i];
+        }
+        batch.clear();
+    }
+
+    void run() {
+        std::vector<job *> batch;
+        batch.reserve(way());
+
+        for (;;) {
+            mpsc_queue::node *n = queue_.pop();
+            if (n) {
+                batch.push_back(static_cast<job *>(n));
+                if (batch.size() == way()) {
+                    dispatch(batch);
+                }
+                continue;
+            }
+
+            if (!batch.empty()) {
+                // partial batch: wait for more jobs until the oldest one is due
+                if (stop_.load() || clock::now() - batch.front()->queued >= deadline_) {
+                    dispatch(batch);
+                } else {
+                    std::this_thread::yield();
+                }
+                continue;
+            }
+
+            if (stop_.load()) {
+                if (queue_.empty()) {
+                    return;
+                }
+                continue;
+            }
+
+            std::unique_lock<std::mutex> lock(mutex_);
+            sleeping_.store(true);
+            if (queue_.empty() && !stop_.load()) {
+                cond_.wait_for(lock, std::chrono::milliseconds(1));
+            }
+            sleeping_.store(false);
+        }
+    }
+
+    std::chrono::nanoseconds deadline_;
+    mpsc_queue queue_;
+    std::atomic<bool> stop_;
+    std::atomic<bool> sleeping_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    std::thread worker_;
+};
+
+} // namespace fingera
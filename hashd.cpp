@@ -0,0 +1,54 @@
+/**
+ * @file hashd.cpp
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-03
+ *
+ * hashes the messages of every local client in the lanes of one backend,
+ * clients talk to it through shm_hash_client, see shm_service.h
+ *
+ * usage: hashd [socket path]
+ *   the socket defaults to /tmp/fingera-hashd.sock, SIGINT or SIGTERM
+ *   stop it after the messages already taken
+ */
+#include <atomic>
+#include <csignal>
+#include <cstdio>
+#include <string>
+#include "autotune.h"
+#include "hashd_serve.h"
+#include "instrinsic_two.h"
+
+using namespace fingera;
+
+static std::atomic<bool> stop(false);
+
+static void on_signal(int) {
+    stop.store(true);
+}
+
+int main(int argc, char const *argv[]) {
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [socket path]\n", argv[0]);
+        return 2;
+    }
+    std::string path = argc > 1 ? argv[1] : "/tmp/fingera-hashd.sock";
+
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = on_signal;
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    // the widest lanes, they only pay off when many clients share them
+    const cpu_features &cpu = cpu_features::get();
+    if (cpu.avx512f) {
+        return hashd_serve_avx512(path, stop);
+    }
+    if (cpu.avx2) {
+        return hashd_serve_avx2(path, stop);
+    }
+    if (cpu.sse41) {
+        return hashd_serve_sse4(path, stop);
+    }
+    return hashd_serve<instrinsic_two>("two", path, stop);
+}
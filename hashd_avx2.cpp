@@ -0,0 +1,19 @@
+/**
+ * @file hashd_avx2.cpp
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-03
+ *
+ * built with -mavx2, see hashd_serve.h and hash_backends.h
+ */
+#define fingera fingera_avx2
+#include "hashd_serve.h"
+#include "instrinsic_avx2.h"
+#undef fingera
+
+namespace fingera {
+
+int hashd_serve_avx2(const std::string &path, std::atomic<bool> &stop) {
+    return fingera_avx2::hashd_serve<fingera_avx2::instrinsic_avx2>("avx2", path, stop);
+}
+
+} // namespace fingera
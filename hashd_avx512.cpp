@@ -0,0 +1,19 @@
+/**
+ * @file hashd_avx512.cpp
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-03
+ *
+ * built with -mavx512f, see hashd_serve.h and hash_backends.h
+ */
+#define fingera fingera_avx512
+#include "hashd_serve.h"
+#include "instrinsic_avx512.h"
+#undef fingera
+
+namespace fingera {
+
+int hashd_serve_avx512(const std::string &path, std::atomic<bool> &stop) {
+    return fingera_avx512::hashd_serve<fingera_avx512::instrinsic_avx512>("avx512", path, stop);
+}
+
+} // namespace fingera
@@ -0,0 +1,34 @@
+/**
+ * @file hashd_serve.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-03
+ */
+#pragma once
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include "shm_service.h"
+
+namespace fingera {
+
+// runs a daemon on the lanes of Instrinsic until stop, 1 when it can not listen
+template<typename Instrinsic>
+int hashd_serve(const char *name, const std::string &path, std::atomic<bool> &stop) {
+    shm_hash_daemon<Instrinsic> daemon;
+    if (!daemon.listen(path)) {
+        fprintf(stderr, "hashd: %s: can not listen\n", path.c_str());
+        return 1;
+    }
+    fprintf(stderr, "hashd: %s, %zu lanes, on %s\n", name, daemon.way(), path.c_str());
+    daemon.run(stop);
+    return 0;
+}
+
+// hashd_serve of the vector backends, each built with the flags of its
+// instruction set (hashd_*.cpp), see hash_backends.h
+int hashd_serve_sse4(const std::string &path, std::atomic<bool> &stop);
+int hashd_serve_avx2(const std::string &path, std::atomic<bool> &stop);
+int hashd_serve_avx512(const std::string &path, std::atomic<bool> &stop);
+
+} // namespace fingera
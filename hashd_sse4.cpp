@@ -0,0 +1,19 @@
+/**
+ * @file hashd_sse4.cpp
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-03
+ *
+ * built with -msse4.1, see hashd_serve.h and hash_backends.h
+ */
+#define fingera fingera_sse4
+#include "hashd_serve.h"
+#include "instrinsic_sse4.h"
+#undef fingera
+
+namespace fingera {
+
+int hashd_serve_sse4(const std::string &path, std::atomic<bool> &stop) {
+    return fingera_sse4::hashd_serve<fingera_sse4::instrinsic_sse4>("sse4", path, stop);
+}
+
+} // namespace fingera
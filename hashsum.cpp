@@ -0,0 +1,393 @@
+/**
+ * @file hashsum.cpp
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-27
+ *
+ * hashes every record of stdin, one hex digest per line on stdout
+ *
+ * usage: hashsum [sha256|ripemd160] [-n] [-f] [-c cache] [-v]
+ *   records are lines (without the newline) by default
+ *   -n: records are prefixed by a 4 byte little endian length
+ *   -f: records are file paths, every file is hashed whole and the lines
+ *       are "<digest>  <path>"
+ *   -c: with -f, digests of unchanged files come from the cache file and
+ *       new ones go to it, see digest_cache.h
+ *   -v: with -f, the number of files and cache hits on stderr
+ *
+ * the backend comes from the autotuner profile, see autotune.h
+ */
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "compact.h"
+#include "hex.h"
+#include "autotune.h"
+#include "digest_cache.h"
+
+using namespace fingera;
+
+class hasher {
+public:
+    hasher(const hash_dispatch &dispatch, FILE *out) : dispatch_(dispatch), out_(out) {
+        data_.reserve(batch);
+        sizes_.reserve(batch);
+        digests_.resize(batch * dispatch_.hash_size());
+        output_.reserve(output_limit + batch * (dispatch_.hash_size() * 2 + 1));
+    }
+    ~hasher() {
+        flush();
+        write();
+    }
+
+    void add(const char *data, size_t size) {
+        data_.push_back(data);
+        sizes_.push_back(size);
+        if (data_.size() == batch) {
+            flush();
+        }
+    }
+
+    // hashes the pending records, they must stay valid until then
+    void flush() {
+        if (data_.empty()) {
+            return;
+        }
+        size_t hash_size = dispatch_.hash_size();
+        dispatch_.hash(digests_.data(), data_.data(), sizes_.data(), data_.size());
+
+        size_t line = hash_size * 2 + 1;
+        size_t offset = output_.size();
+        output_.resize(offset + line * data_.size());
+        for (size_t i = 0; i < data_.size(); i++) {
+            char *text = &output_[offset + i * line];
+            hex_encode(text, &digests_[i * hash_size], hash_size);
+            text[line - 1] = '\n';
+        }
+        data_.clear();
+        sizes_.clear();
+
+        if (output_.size() >= output_limit) {
+            write();
+        }
+    }
+
+    // one line of a digest computed elsewhere, "<digest>  <name>"
+    void emit(const uint8_t *digest, const std::string &name) {
+        size_t hash_size = dispatch_.hash_size();
+        size_t offset = output_.size();
+        output_.resize(offset + hash_size * 2);
+        hex_encode(&output_[offset], digest, hash_size);
+        output_.push_back(' ');
+        output_.push_back(' ');
+        output_.insert(output_.end(), name.begin(), name.end());
+        output_.push_back('\n');
+
+        if (output_.size() >= output_limit) {
+            write();
+        }
+    }
+
+private:
+    enum { batch = 64, output_limit = 1 << 20 };
+
+    void write() {
+        if (!output_.empty()) {
+            fwrite(output_.data(), 1, output_.size(), out_);
+            output_.clear();
+        }
+    }
+
+    const hash_dispatch &dispatch_;
+    FILE *out_;
+    std::vector<const void *> data_;
+    std::vector<size_t> sizes_;
+    std::vector<uint8_t> digests_;
+    std::vector<char> output_;
+};
+
+// records are paths, the small files of a batch are mapped and hashed
+// together, large ones alone
+// files found in the cache are not read at all
+class file_hasher {
+public:
+    file_hasher(const hash_dispatch &dispatch, hasher &out, digest_cache *cache)
+            : dispatch_(dispatch), out_(out), cache_(cache),
+              algorithm_(digest_cache::algorithm_id(dispatch.algorithm())),
+              files_(0), hits_(0), failed_(false) {}
+    ~file_hasher() {
+        flush();
+    }
+
+    void add(const char *path, size_t size) {
+        paths_.push_back(std::string(path, size));
+        if (paths_.size() == batch) {
+            flush();
+        }
+    }
+
+    void flush() {
+        if (paths_.empty()) {
+            return;
+        }
+        size_t hash_size = dispatch_.hash_size();
+        digests_.resize(paths_.size() * hash_size);
+        found_.assign(paths_.size(), 0);
+        mapped_.clear();
+        data_.clear();
+        sizes_.clear();
+
+        // a file changed after this may share its mtime with the cached one
+        int64_t started = digest_cache::now_ns();
+        for (size_t i = 0; i < paths_.size(); i++) {
+            mapping m;
+            if (!open(paths_[i], m)) {
+                fprintf(stderr, "hashsum: %s: %s\n", paths_[i].c_str(), strerror(errno));
+                failed_ = true;
+                continue;
+            }
+            found_[i] = 1;
+            files_++;
+            if (cache_ && cache_->lookup(m.id, &digests_[i * hash_size], hash_size)) {
+                ::close(m.fd);
+                hits_++;
+                continue;
+            }
+            if (!map(m)) {
+                fprintf(stderr, "hashsum: %s: %s\n", paths_[i].c_str(), strerror(errno));
+                ::close(m.fd);
+                found_[i] = 0;
+                failed_ = true;
+                continue;
+            }
+            m.index = i;
+            if (m.size >= stream_size) {
+                // alone on the single message backend, streamed from the mapping
+                const void *data = m.data;
+                dispatch_.hash(&digests_[i * hash_size], &data, &m.size, 1);
+                done(m, started);
+                continue;
+            }
+            mapped_.push_back(m);
+            data_.push_back(m.data);
+            sizes_.push_back(m.size);
+        }
+
+        if (!mapped_.empty()) {
+            hashed_.resize(mapped_.size() * hash_size);
+            dispatch_.hash(hashed_.data(), data_.data(), sizes_.data(), mapped_.size());
+        }
+        for (size_t i = 0; i < mapped_.size(); i++) {
+            const mapping &m = mapped_[i];
+            memcpy(&digests_[m.index * hash_size], &hashed_[i * hash_size], hash_size);
+            done(m, started);
+        }
+
+        for (size_t i = 0; i < paths_.size(); i++) {
+            if (found_[i]) {
+                out_.emit(&digests_[i * hash_size], paths_[i]);
+            }
+        }
+        paths_.clear();
+    }
+
+    size_t files() const {
+        return files_;
+    }
+    size_t hits() const {
+        return hits_;
+    }
+    bool failed() const {
+        return failed_;
+    }
+
+private:
+    // files from stream_size bytes are hashed one at a time, the smaller
+    // ones of a batch together, lanes sorted by size
+    enum { batch = 64, stream_size = 1 << 20 };
+
+    struct mapping {
+        size_t index;
+        int fd;
+        file_identity id;
+        const uint8_t *data;
+        size_t size;
+    };
+
+    // false with errno set
+    bool open(const std::string &path, mapping &m) const {
+        m.fd = ::open(path.c_str(), O_RDONLY);
+        if (m.fd < 0) {
+            return false;
+        }
+        struct stat st;
+        int error = 0;
+        if (fstat(m.fd, &st) != 0) {
+            error = errno;
+        } else if (!S_ISREG(st.st_mode)) {
+            error = S_ISDIR(st.st_mode) ? EISDIR : EINVAL;
+        }
+        if (error) {
+            ::close(m.fd);
+            errno = error;
+            return false;
+        }
+        m.id.assign(st, algorithm_);
+        return true;
+    }
+    static bool map(mapping &m) {
+        static const uint8_t empty[1] = { 0 };
+        m.size = m.id.size;
+        m.data = empty;
+        if (m.size == 0) {
+            return true;
+        }
+        void *p = mmap(nullptr, m.size, PROT_READ, MAP_PRIVATE, m.fd, 0);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        madvise(p, m.size, MADV_SEQUENTIAL);
+        m.data = (const uint8_t *)p;
+        return true;
+    }
+
+    // the digest of m is in digests_, caches it and lets the file go
+    void done(const mapping &m, int64_t started) {
+        size_t hash_size = dispatch_.hash_size();
+        // only when nothing about the file moved while it was read
+        file_identity after;
+        if (cache_ && after.stat(m.fd, algorithm_) && after == m.id) {
+            cache_->store(m.id, &digests_[m.index * hash_size], hash_size, started);
+        }
+        if (m.size) {
+            munmap((void *)m.data, m.size);
+        }
+        ::close(m.fd);
+    }
+
+    const hash_dispatch &dispatch_;
+    hasher &out_;
+    digest_cache *cache_;
+    uint32_t algorithm_;
+    size_t files_, hits_;
+    bool failed_;
+    std::vector<std::string> paths_;
+    std::vector<uint8_t> digests_;
+    std::vector<uint8_t> hashed_;
+    std::vector<uint8_t> found_;
+    std::vector<mapping> mapped_;
+    std::vector<const void *> data_;
+    std::vector<size_t> sizes_;
+};
+
+// Sink: add(record, size) for every record, flush() before the records move
+// or the buffer goes away
+template<typename Sink>
+int run(Sink &h, FILE *in, bool length_prefixed) {
+    std::vector<char> input(1 << 20);
+    size_t begin = 0, end = 0;
+    bool eof = false;
+
+    while (!eof || begin < end) {
+        if (!eof) {
+            // records point into the buffer, hash them before it moves
+            h.flush();
+            memmove(input.data(), input.data() + begin, end - begin);
+            end -= begin;
+            begin = 0;
+            if (end == input.size()) {
+                input.resize(input.size() * 2);
+            }
+            size_t n = fread(input.data() + end, 1, input.size() - end, in);
+            end += n;
+            eof = n == 0;
+        }
+
+        for (;;) {
+            const char *cur = input.data() + begin;
+            size_t left = end - begin;
+            if (length_prefixed) {
+                if (left < 4) {
+                    break;
+                }
+                size_t size = read_le32(cur, 0);
+                if (left - 4 < size) {
+                    break;
+                }
+                h.add(cur + 4, size);
+                begin += 4 + size;
+            } else {
+                const char *newline = (const char *)memchr(cur, '\n', left);
+                if (!newline) {
+                    if (eof && left) {
+                        h.add(cur, left);
+                        begin = end;
+                    }
+                    break;
+                }
+                h.add(cur, newline - cur);
+                begin += newline - cur + 1;
+            }
+        }
+
+        if (eof && begin < end) {
+            fprintf(stderr, "hashsum: truncated record at end of input\n");
+            h.flush();
+            return 1;
+        }
+    }
+    // the last records still point into input
+    h.flush();
+    return 0;
+}
+
+int main(int argc, char const *argv[]) {
+    std::string algorithm = "sha256";
+    std::string cache_path;
+    bool length_prefixed = false, files = false, verbose = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "-n") {
+            length_prefixed = true;
+        } else if (arg == "-f") {
+            files = true;
+        } else if (arg == "-v") {
+            verbose = true;
+        } else if (arg == "-c" && i + 1 < argc) {
+            cache_path = argv[++i];
+        } else if (arg == "sha256" || arg == "ripemd160") {
+            algorithm = arg;
+        } else {
+            fprintf(stderr, "usage: %s [sha256|ripemd160] [-n] [-f] [-c cache] [-v]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (!cache_path.empty() && !files) {
+        fprintf(stderr, "hashsum: -c needs -f\n");
+        return 2;
+    }
+
+    autotuner &tuner = autotuner::get();
+    const hash_dispatch &dispatch = algorithm == "ripemd160" ? tuner.ripemd160() : tuner.sha256();
+    hasher out(dispatch, stdout);
+    if (!files) {
+        return run(out, stdin, length_prefixed);
+    }
+
+    digest_cache cache;
+    if (!cache_path.empty() && !cache.open(cache_path)) {
+        fprintf(stderr, "hashsum: %s: cache unavailable, hashing everything\n", cache_path.c_str());
+    }
+    file_hasher h(dispatch, out, cache.is_open() ? &cache : nullptr);
+    int status = run(h, stdin, length_prefixed);
+    h.flush();
+    if (verbose) {
+        fprintf(stderr, "hashsum: %zu files, %zu from the cache\n", h.files(), h.hits());
+    }
+    return status ? status : h.failed() ? 1 : 0;
+}
@@ -0,0 +1,171 @@
+/**
+ * @file header_pow.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-31
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include "compact.h"
+#include "sha256.h"
+
+namespace fingera {
+
+// proof of work of 80 byte block headers, way() headers per kernel call
+//
+// the second block of a header and the second hash are fixed length, their
+// padding words are constants. the 256 bit hash and the target decoded from
+// nBits stay in vectors as 8 little endian limbs and are compared lane wise
+template<typename Instrinsic>
+class header_pow {
+public:
+    using type = typename Instrinsic::type;
+    using hash = sha256<Instrinsic>;
+
+    enum { header_size = 80 };
+
+    static inline size_t way() {
+        return hash::way();
+    }
+
+    // way() headers at headers + 80 * i, their sha256d words into s[8]
+    static inline void hash_headers(type *s, const void *headers) {
+        type w[16];
+        hash::init(s);
+        for (int i = 0; i < 16; i++) {
+            w[i] = Instrinsic::load(headers, i * 4, header_size);
+        }
+        hash::process_words(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], w);
+        for (int i = 0; i < 4; i++) {
+            w[i] = Instrinsic::load(headers, 64 + i * 4, header_size);
+        }
+        w[4] = Instrinsic::vector_mirror(0x80000000ul);
+        for (int i = 5; i < 15; i++) {
+            w[i] = Instrinsic::vector_mirror(0);
+        }
+        w[15] = Instrinsic::vector_mirror(header_size * 8);
+        hash::process_words(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], w);
+
+        // second pass: the 32 byte digest padded into one block
+        for (int i = 0; i < 8; i++) {
+            w[i] = s[i];
+        }
+        w[8] = Instrinsic::vector_mirror(0x80000000ul);
+        for (int i = 9; i < 15; i++) {
+            w[i] = Instrinsic::vector_mirror(0);
+        }
+        w[15] = Instrinsic::vector_mirror(256);
+        hash::init(s);
+        hash::process_words(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], w);
+    }
+
+    // limb k of the target in nBits, bit 32 * k up. limb 8 catches overflow
+    static inline void decode_target(type *limbs, type bits) {
+        const type mantissa = Instrinsic::vector_and(bits, Instrinsic::vector_mirror(0x007FFFFFul));
+        // 8 * exponent - 24, the mantissa is 3 bytes
+        const type shift = Instrinsic::vector_add(
+            Instrinsic::template vector_shl<3>(Instrinsic::template vector_shr<24>(bits)),
+            Instrinsic::vector_mirror((uint32_t)-24));
+        for (int k = 0; k < 9; k++) {
+            // counts that wrap around below zero are large, those shifts give 0
+            type left = Instrinsic::vector_add(shift, Instrinsic::vector_mirror((uint32_t)(-32 * k)));
+            type right = Instrinsic::vector_add(
+                Instrinsic::vector_xor(left, Instrinsic::vector_mirror(0xFFFFFFFFul)), Instrinsic::vector_mirror(1));
+            limbs[k] = Instrinsic::vector_or(
+                Instrinsic::vector_shlv(mantissa, left), Instrinsic::vector_shrv(mantissa, right));
+        }
+    }
+
+    // bit i set when the 8 limb number x of lane i is not above y
+    static inline uint32_t mask_le(const type *x, const type *y) {
+        uint32_t le = lane_mask();
+        for (int k = 0; k < 8; k++) {
+            le = Instrinsic::vector_mask_lt(x[k], y[k]) | (Instrinsic::vector_mask_eq(x[k], y[k]) & le);
+        }
+        return le;
+    }
+
+    // way() headers at headers + 80 * i, their hashes to hashes + 32 * i
+    // pow_limit: 32 bytes, little endian like a hash, null for no limit
+    // returns bit i set when header i meets its own nBits target
+    static uint32_t verify_lanes(const void *headers, void *hashes, const void *pow_limit = nullptr) {
+        type s[8], h[8], target[9];
+        hash_headers(s, headers);
+        for (int i = 0; i < 8; i++) {
+            Instrinsic::save(hashes, i * 4, s[i], 32);
+            h[i] = bswap(s[i]);
+        }
+
+        const type bits = Instrinsic::load_le(headers, 72, header_size);
+        decode_target(target, bits);
+
+        const type zero = Instrinsic::vector_mirror(0);
+        const type mantissa = Instrinsic::vector_and(bits, Instrinsic::vector_mirror(0x007FFFFFul));
+        uint32_t valid = ~Instrinsic::vector_mask_eq(mantissa, zero);
+        // negative
+        valid &= Instrinsic::vector_mask_eq(Instrinsic::vector_and(bits, Instrinsic::vector_mirror(0x00800000ul)), zero);
+        // above 2^256, from exponent 35 on every mantissa bit is out of range
+        valid &= Instrinsic::vector_mask_eq(target[8], zero);
+        valid &= ~Instrinsic::vector_mask_lt(Instrinsic::vector_mirror(34), Instrinsic::template vector_shr<24>(bits));
+        // zero after the shift
+        type any = target[0];
+        for (int k = 1; k < 8; k++) {
+            any = Instrinsic::vector_or(any, target[k]);
+        }
+        valid &= ~Instrinsic::vector_mask_eq(any, zero);
+
+        if (pow_limit) {
+            type limit[8];
+            for (int k = 0; k < 8; k++) {
+                limit[k] = Instrinsic::vector_mirror(read_le32(pow_limit, k * 4));
+            }
+            valid &= mask_le(target, limit);
+        }
+        return valid & mask_le(h, target) & lane_mask();
+    }
+
+    // count contiguous headers, hashes: 32 * count bytes
+    // bitmap: (count + 31) / 32 words, bit i % 32 of word i / 32 for header i
+    // returns the number of valid headers
+    static size_t verify(const void *headers, size_t count, void *hashes, uint32_t *bitmap,
+            const void *pow_limit = nullptr) {
+        enum { lanes = sizeof(type) / sizeof(uint32_t) };
+        const uint8_t *in = (const uint8_t *)headers;
+        uint8_t *out = (uint8_t *)hashes;
+        memset(bitmap, 0, (count + 31) / 32 * sizeof(uint32_t));
+
+        size_t valid = 0;
+        for (size_t begin = 0; begin < count; begin += way()) {
+            size_t n = count - begin < way() ? count - begin : way();
+            uint32_t mask;
+            if (n == way()) {
+                mask = verify_lanes(in + header_size * begin, out + 32 * begin, pow_limit);
+            } else {
+                // the tail through a zeroed staging batch
+                uint8_t staging[lanes * header_size];
+                uint8_t digests[lanes * 32];
+                memset(staging, 0, sizeof(staging));
+                memcpy(staging, in + header_size * begin, header_size * n);
+                mask = verify_lanes(staging, digests, pow_limit) & ((1u << n) - 1);
+                memcpy(out + 32 * begin, digests, 32 * n);
+            }
+            // way() divides 32, a batch never straddles two words
+            bitmap[begin / 32] |= mask << (begin % 32);
+            valid += __builtin_popcount(mask);
+        }
+        return valid;
+    }
+
+private:
+    static inline uint32_t lane_mask() {
+        return way() >= 32 ? 0xFFFFFFFFul : (1u << way()) - 1;
+    }
+    static inline type bswap(type x) {
+        return Instrinsic::vector_or(
+            Instrinsic::vector_and(Instrinsic::template vector_rol<8>(x), Instrinsic::vector_mirror(0x00FF00FFul)),
+            Instrinsic::vector_and(Instrinsic::template vector_rol<24>(x), Instrinsic::vector_mirror(0xFF00FF00ul)));
+    }
+};
+
+} // namespace fingera
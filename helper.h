@@ -7,16 +7,16 @@
 
 #include <iostream>
 #include <iomanip>
+#include <string>
 #include <cpuid.h>
+#include "hex.h"
 
 namespace fingera {
 
 inline void dump_buffer(const void *buf, size_t size) {
-    for (size_t i = 0; i < size; i++) {
-        uint32_t data = ((uint8_t *)buf)[i];
-        std::cout << std::hex << std::setw(2) << std::setfill('0') << data;
-    }
-    std::cout << std::endl;
+    std::string text(size * 2, '0');
+    hex_encode(&text[0], buf, size);
+    std::cout << text << std::endl;
 }
 
 
@@ -0,0 +1,164 @@
+/**
+ * @file hex.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-27
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <immintrin.h>
+
+// _mm_shuffle_epi8 CPUID Flags: SSSE3
+// _mm256_shuffle_epi8 _mm256_maddubs_epi16 CPUID Flags: AVX2
+
+namespace fingera {
+
+namespace detail {
+
+static const char hex_digits[] = "0123456789abcdef";
+
+inline int hex_value(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    }
+    return -1;
+}
+
+#ifdef __SSSE3__
+// 16 bytes to 32 chars
+inline void hex_encode_16(char *out, __m128i x) {
+    const __m128i digits = _mm_loadu_si128((const __m128i *)hex_digits);
+    const __m128i low = _mm_set1_epi8(0x0F);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(x, 4), low);
+    __m128i lo = _mm_and_si128(x, low);
+    _mm_storeu_si128((__m128i *)out, _mm_shuffle_epi8(digits, _mm_unpacklo_epi8(hi, lo)));
+    _mm_storeu_si128((__m128i *)(out + 16), _mm_shuffle_epi8(digits, _mm_unpackhi_epi8(hi, lo)));
+}
+
+// 32 chars to 16 nibble values, false when a char is not a hex digit
+inline bool hex_decode_16(void *out, const char *in) {
+    const __m128i zero = _mm_set1_epi8('0' - 1);
+    const __m128i nine = _mm_set1_epi8('9' + 1);
+    const __m128i a = _mm_set1_epi8('a' - 1);
+    const __m128i f = _mm_set1_epi8('f' + 1);
+    const __m128i lower = _mm_set1_epi8(0x20);
+    const __m128i weight = _mm_set1_epi16(0x0110);
+    __m128i r[2];
+    for (int i = 0; i < 2; i++) {
+        __m128i c = _mm_loadu_si128((const __m128i *)(in + i * 16));
+        __m128i l = _mm_or_si128(c, lower);
+        __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(c, zero), _mm_cmpgt_epi8(nine, c));
+        __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(l, a), _mm_cmpgt_epi8(f, l));
+        if (_mm_movemask_epi8(_mm_or_si128(digit, alpha)) != 0xFFFF) {
+            return false;
+        }
+        __m128i v = _mm_or_si128(
+            _mm_and_si128(digit, _mm_sub_epi8(c, _mm_set1_epi8('0'))),
+            _mm_andnot_si128(digit, _mm_sub_epi8(l, _mm_set1_epi8('a' - 10))));
+        // high nibble * 16 + low nibble for every pair
+        r[i] = _mm_maddubs_epi16(v, weight);
+    }
+    _mm_storeu_si128((__m128i *)out, _mm_packus_epi16(r[0], r[1]));
+    return true;
+}
+#endif
+
+#ifdef __AVX2__
+// 32 bytes to 64 chars
+inline void hex_encode_32(char *out, __m256i x) {
+    const __m256i digits = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)hex_digits));
+    const __m256i low = _mm256_set1_epi8(0x0F);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(x, 4), low);
+    __m256i lo = _mm256_and_si256(x, low);
+    __m256i first = _mm256_shuffle_epi8(digits, _mm256_unpacklo_epi8(hi, lo));
+    __m256i second = _mm256_shuffle_epi8(digits, _mm256_unpackhi_epi8(hi, lo));
+    _mm256_storeu_si256((__m256i *)out, _mm256_permute2x128_si256(first, second, 0x20));
+    _mm256_storeu_si256((__m256i *)(out + 32), _mm256_permute2x128_si256(first, second, 0x31));
+}
+
+// 64 chars to 32 bytes, false when a char is not a hex digit
+inline bool hex_decode_32(void *out, const char *in) {
+    const __m256i zero = _mm256_set1_epi8('0' - 1);
+    const __m256i nine = _mm256_set1_epi8('9' + 1);
+    const __m256i a = _mm256_set1_epi8('a' - 1);
+    const __m256i f = _mm256_set1_epi8('f' + 1);
+    const __m256i lower = _mm256_set1_epi8(0x20);
+    const __m256i weight = _mm256_set1_epi16(0x0110);
+    __m256i r[2];
+    for (int i = 0; i < 2; i++) {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(in + i * 32));
+        __m256i l = _mm256_or_si256(c, lower);
+        __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(c, zero), _mm256_cmpgt_epi8(nine, c));
+        __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(l, a), _mm256_cmpgt_epi8(f, l));
+        if (_mm256_movemask_epi8(_mm256_or_si256(digit, alpha)) != -1) {
+            return false;
+        }
+        __m256i v = _mm256_blendv_epi8(
+            _mm256_sub_epi8(l, _mm256_set1_epi8('a' - 10)),
+            _mm256_sub_epi8(c, _mm256_set1_epi8('0')), digit);
+        r[i] = _mm256_maddubs_epi16(v, weight);
+    }
+    // packus works per 128 bit lane
+    __m256i packed = _mm256_packus_epi16(r[0], r[1]);
+    _mm256_storeu_si256((__m256i *)out, _mm256_permute4x64_epi64(packed, 0xD8));
+    return true;
+}
+#endif
+
+} // namespace detail
+
+// out: 2 * size lower case hex chars, not terminated
+inline void hex_encode(char *out, const void *data, size_t size) {
+    const uint8_t *in = (const uint8_t *)data;
+    size_t i = 0;
+#ifdef __AVX2__
+    for (; i + 32 <= size; i += 32) {
+        detail::hex_encode_32(out + i * 2, _mm256_loadu_si256((const __m256i *)(in + i)));
+    }
+#endif
+#ifdef __SSSE3__
+    for (; i + 16 <= size; i += 16) {
+        detail::hex_encode_16(out + i * 2, _mm_loadu_si128((const __m128i *)(in + i)));
+    }
+#endif
+    for (; i < size; i++) {
+        out[i * 2] = detail::hex_digits[in[i] >> 4];
+        out[i * 2 + 1] = detail::hex_digits[in[i] & 15];
+    }
+}
+
+// in: 2 * size hex chars of either case, false on any other char
+inline bool hex_decode(void *data, const char *in, size_t size) {
+    uint8_t *out = (uint8_t *)data;
+    size_t i = 0;
+#ifdef __AVX2__
+    for (; i + 32 <= size; i += 32) {
+        if (!detail::hex_decode_32(out + i, in + i * 2)) {
+            return false;
+        }
+    }
+#endif
+#ifdef __SSSE3__
+    for (; i + 16 <= size; i += 16) {
+        if (!detail::hex_decode_16(out + i, in + i * 2)) {
+            return false;
+        }
+    }
+#endif
+    for (; i < size; i++) {
+        int hi = detail::hex_value(in[i * 2]);
+        int lo = detail::hex_value(in[i * 2 + 1]);
+        if (hi < 0 || lo < 0) {
+            return false;
+        }
+        out[i] = (uint8_t)(hi << 4 | lo);
+    }
+    return true;
+}
+
+} // namespace fingera
@@ -0,0 +1,224 @@
+/**
+ * @file hmac_sha256.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-21
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include "compact.h"
+#include "sha256.h"
+#include "instrinsic_one.h"
+
+namespace fingera {
+
+template<typename Instrinsic>
+class hmac_sha256 {
+public:
+    using type = typename Instrinsic::type;
+    using hash = sha256<Instrinsic>;
+
+    // sha256 state after the key ^ ipad / key ^ opad block, big endian words
+    struct key {
+        uint8_t inner[32];
+        uint8_t outer[32];
+    };
+
+protected:
+    using scalar = sha256<instrinsic_one>;
+
+    static inline type vector_mirror(uint32_t x) {
+        return Instrinsic::vector_mirror(x);
+    }
+
+    // continue a single message from state, prefix bytes were already compressed
+    static void scalar_finish(
+            uint32_t &a, uint32_t &b, uint32_t &c, uint32_t &d,
+            uint32_t &e, uint32_t &f, uint32_t &g, uint32_t &h,
+            const void *data, size_t size, uint64_t prefix) {
+        const uint8_t *cur = (const uint8_t *)data;
+        size_t left = size;
+        while (left >= 64) {
+            scalar::process_block(a, b, c, d, e, f, g, h, cur);
+            cur += 64;
+            left -= 64;
+        }
+
+        uint8_t block[128];
+        size_t tail = left + 9 > 64 ? 128 : 64;
+        memset(block, 0, sizeof(block));
+        memcpy(block, cur, left);
+        block[left] = 0x80;
+        write_be64(block, tail - 8, (prefix + size) * 8);
+
+        scalar::process_block(a, b, c, d, e, f, g, h, block);
+        if (tail == 128) {
+            scalar::process_block(a, b, c, d, e, f, g, h, block + 64);
+        }
+    }
+
+    static void scalar_pad(uint8_t *midstate, const uint8_t *block, uint8_t pad) {
+        uint8_t padded[64];
+        for (int i = 0; i < 64; i++) {
+            padded[i] = block[i] ^ pad;
+        }
+        uint32_t a, b, c, d, e, f, g, h;
+        scalar::init(a, b, c, d, e, f, g, h);
+        scalar::process_block(a, b, c, d, e, f, g, h, padded);
+        scalar::save_state(midstate, a, b, c, d, e, f, g, h);
+    }
+
+    // inner digest in a..h, replaced by the tag
+    static inline void outer(
+            type &a, type &b, type &c, type &d,
+            type &e, type &f, type &g, type &h,
+            type oa, type ob, type oc, type od,
+            type oe, type of, type og, type oh) {
+        type zero = vector_mirror(0);
+        type w[16] = {
+            a, b, c, d, e, f, g, h,
+            vector_mirror(0x80000000ul), zero, zero, zero,
+            zero, zero, zero, vector_mirror((64 + 32) * 8)
+        };
+        a = oa; b = ob; c = oc; d = od;
+        e = oe; f = of; g = og; h = oh;
+        hash::process_words(a, b, c, d, e, f, g, h, w);
+    }
+
+    static inline void mirror_state(
+            const uint8_t *midstate,
+            type &a, type &b, type &c, type &d,
+            type &e, type &f, type &g, type &h) {
+        a = vector_mirror(read_be32(midstate,  0));
+        b = vector_mirror(read_be32(midstate,  4));
+        c = vector_mirror(read_be32(midstate,  8));
+        d = vector_mirror(read_be32(midstate, 12));
+        e = vector_mirror(read_be32(midstate, 16));
+        f = vector_mirror(read_be32(midstate, 20));
+        g = vector_mirror(read_be32(midstate, 24));
+        h = vector_mirror(read_be32(midstate, 28));
+    }
+
+    static inline void lane_state(
+            const key *const *keys, size_t member,
+            type &a, type &b, type &c, type &d,
+            type &e, type &f, type &g, type &h) {
+        uint8_t midstates[sizeof(type) * 8];
+        for (size_t i = 0; i < way(); i++) {
+            memcpy(midstates + i * 32, (const uint8_t *)keys[i] + member, 32);
+        }
+        hash::load_state(midstates, a, b, c, d, e, f, g, h);
+    }
+
+    static inline uint32_t compare(
+            const void *expected,
+            type a, type b, type c, type d,
+            type e, type f, type g, type h) {
+        type ea, eb, ec, ed, ee, ef, eg, eh;
+        hash::load_state(expected, ea, eb, ec, ed, ee, ef, eg, eh);
+
+        type diff = Instrinsic::vector_or(
+            Instrinsic::vector_or(
+                Instrinsic::vector_or(Instrinsic::vector_xor(a, ea), Instrinsic::vector_xor(b, eb)),
+                Instrinsic::vector_or(Instrinsic::vector_xor(c, ec), Instrinsic::vector_xor(d, ed))),
+            Instrinsic::vector_or(
+                Instrinsic::vector_or(Instrinsic::vector_xor(e, ee), Instrinsic::vector_xor(f, ef)),
+                Instrinsic::vector_or(Instrinsic::vector_xor(g, eg), Instrinsic::vector_xor(h, eh))));
+
+        uint32_t lanes[sizeof(type) / sizeof(uint32_t)];
+        Instrinsic::save(lanes, 0, diff, sizeof(uint32_t));
+
+        // no data dependent branch: bit i is set when lane i has no differing bit
+        uint32_t mask = 0;
+        for (size_t i = 0; i < way(); i++) {
+            mask |= (uint32_t)(((uint64_t)lanes[i] - 1) >> 63) << i;
+        }
+        return mask;
+    }
+
+public:
+    static inline size_t way() {
+        return hash::way();
+    }
+
+    static void init_key(key &k, const void *secret, size_t size) {
+        uint8_t block[64];
+        memset(block, 0, sizeof(block));
+        if (size > 64) {
+            uint32_t a, b, c, d, e, f, g, h;
+            scalar::init(a, b, c, d, e, f, g, h);
+            scalar_finish(a, b, c, d, e, f, g, h, secret, size, 0);
+            scalar::save_state(block, a, b, c, d, e, f, g, h);
+        } else {
+            memcpy(block, secret, size);
+        }
+        scalar_pad(k.inner, block, 0x36);
+        scalar_pad(k.outer, block, 0x5c);
+    }
+
+    // single message on the scalar path
+    static void sign(void *out, const key &k, const void *data, size_t size) {
+        uint32_t a, b, c, d, e, f, g, h;
+        scalar::load_state(k.inner, a, b, c, d, e, f, g, h);
+        scalar_finish(a, b, c, d, e, f, g, h, data, size, 64);
+
+        uint8_t inner[32];
+        scalar::save_state(inner, a, b, c, d, e, f, g, h);
+        scalar::load_state(k.outer, a, b, c, d, e, f, g, h);
+        scalar_finish(a, b, c, d, e, f, g, h, inner, 32, 64);
+        scalar::save_state(out, a, b, c, d, e, f, g, h);
+    }
+
+    // blocks are padded as for sha256::process_trunk, except that the length
+    // field also counts the 64 byte key block: (64 + message size) * 8
+    static inline void process(
+            type &a, type &b, type &c, type &d,
+            type &e, type &f, type &g, type &h,
+            const key &k, const void *blocks, int count = 1) {
+        mirror_state(k.inner, a, b, c, d, e, f, g, h);
+        hash::process_blocks(a, b, c, d, e, f, g, h, blocks, count);
+
+        type oa, ob, oc, od, oe, of, og, oh;
+        mirror_state(k.outer, oa, ob, oc, od, oe, of, og, oh);
+        outer(a, b, c, d, e, f, g, h, oa, ob, oc, od, oe, of, og, oh);
+    }
+    // keys: one key per lane
+    static inline void process(
+            type &a, type &b, type &c, type &d,
+            type &e, type &f, type &g, type &h,
+            const key *const *keys, const void *blocks, int count = 1) {
+        lane_state(keys, offsetof(key, inner), a, b, c, d, e, f, g, h);
+        hash::process_blocks(a, b, c, d, e, f, g, h, blocks, count);
+
+        type oa, ob, oc, od, oe, of, og, oh;
+        lane_state(keys, offsetof(key, outer), oa, ob, oc, od, oe, of, og, oh);
+        outer(a, b, c, d, e, f, g, h, oa, ob, oc, od, oe, of, og, oh);
+    }
+
+    static void process_trunk(void *out, const key &k, const void *blocks, int count = 1) {
+        type a, b, c, d, e, f, g, h;
+        process(a, b, c, d, e, f, g, h, k, blocks, count);
+        hash::save_state(out, a, b, c, d, e, f, g, h);
+    }
+    static void process_trunk(void *out, const key *const *keys, const void *blocks, int count = 1) {
+        type a, b, c, d, e, f, g, h;
+        process(a, b, c, d, e, f, g, h, keys, blocks, count);
+        hash::save_state(out, a, b, c, d, e, f, g, h);
+    }
+
+    // expected: way() tags of 32 bytes, returns bit i set when lane i matches
+    static uint32_t verify_trunk(const void *expected, const key &k, const void *blocks, int count = 1) {
+        type a, b, c, d, e, f, g, h;
+        process(a, b, c, d, e, f, g, h, k, blocks, count);
+        return compare(expected, a, b, c, d, e, f, g, h);
+    }
+    static uint32_t verify_trunk(const void *expected, const key *const *keys, const void *blocks, int count = 1) {
+        type a, b, c, d, e, f, g, h;
+        process(a, b, c, d, e, f, g, h, keys, blocks, count);
+        return compare(expected, a, b, c, d, e, f, g, h);
+    }
+};
+
+} // namespace fingera
@@ -51,16 +51,80 @@ public:
         return vector_or(vector_shl<N>(x), vector_shr<32 - N>(x));
     }
 
-    static inline type load(const void *trunk, int offset) {
+    // low 32 bits of the products
+    static inline type vector_mullo(type x, type y) {
+        return _mm256_mullo_epi32(x, y);
+    }
+
+    // bit i set when lane i of x and y are equal, lane 0 is the highest element
+    static inline uint32_t vector_mask_eq(type x, type y) {
+        type eq = _mm256_permutevar8x32_epi32(_mm256_cmpeq_epi32(x, y),
+            _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        return _mm256_movemask_ps(_mm256_castsi256_ps(eq));
+    }
+    static inline uint32_t extract(type v, size_t lane) {
+        type r = _mm256_permutevar8x32_epi32(v, _mm256_set1_epi32(7 - lane));
+        return _mm_cvtsi128_si32(_mm256_castsi256_si128(r));
+    }
+    // table[index] of every lane, index < 2^31
+    static inline type vector_gather(const uint32_t *table, type index) {
+        return _mm256_i32gather_epi32((const int *)table, index, 4);
+    }
+
+    // bytes of x where mask is set, of y elsewhere, mask lanes all ones or zero
+    static inline type vector_select(type mask, type x, type y) {
+        return _mm256_blendv_epi8(y, x, mask);
+    }
+    // all ones in the lanes where bit N is set
+    template<int N>
+    static inline type vector_bit_mask(type x) {
+        return _mm256_srai_epi32(_mm256_slli_epi32(x, 31 - N), 31);
+    }
+
+    // per lane shift counts, counts above 31 give 0
+    static inline type vector_shlv(type x, type count) {
+        return _mm256_sllv_epi32(x, count);
+    }
+    static inline type vector_shrv(type x, type count) {
+        return _mm256_srlv_epi32(x, count);
+    }
+    // bit i set when lane i of x is below lane i of y, unsigned
+    static inline uint32_t vector_mask_lt(type x, type y) {
+        const type sign = _mm256_set1_epi32(0x80000000);
+        type lt = _mm256_permutevar8x32_epi32(
+            _mm256_cmpgt_epi32(_mm256_xor_si256(y, sign), _mm256_xor_si256(x, sign)),
+            _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+        return _mm256_movemask_ps(_mm256_castsi256_ps(lt));
+    }
+
+    static inline type vector_xor3(type x, type y, type z) {
+        return vector_xor(vector_xor(x, y), z);
+    }
+    static inline type vector_chi(type x, type y, type z) {
+        // x ^ (~y & z)
+        return vector_xor(x, vector_andnot(y, z));
+    }
+
+    static inline type vector_mirror64(uint64_t x) {
+        return _mm256_set1_epi64x(x);
+    }
+    template<int N>
+    static inline type vector_rol64(type x) {
+        // CPUID Flags: AVX512VL + AVX512F
+        // return _mm256_rol_epi64(x, N);
+        return vector_or(_mm256_slli_epi64(x, N), _mm256_srli_epi64(x, 64 - N));
+    }
+
+    static inline type load(const void *trunk, int offset, size_t block_size = 64) {
         return _mm256_set_epi32(
-            read_be32(trunk, offset + 64 * 0),
-            read_be32(trunk, offset + 64 * 1),
-            read_be32(trunk, offset + 64 * 2),
-            read_be32(trunk, offset + 64 * 3),
-            read_be32(trunk, offset + 64 * 4),
-            read_be32(trunk, offset + 64 * 5),
-            read_be32(trunk, offset + 64 * 6),
-            read_be32(trunk, offset + 64 * 7)
+            read_be32(trunk, offset + block_size * 0),
+            read_be32(trunk, offset + block_size * 1),
+            read_be32(trunk, offset + block_size * 2),
+            read_be32(trunk, offset + block_size * 3),
+            read_be32(trunk, offset + block_size * 4),
+            read_be32(trunk, offset + block_size * 5),
+            read_be32(trunk, offset + block_size * 6),
+            read_be32(trunk, offset + block_size * 7)
         );
     }
     static inline void save(void *out, int offset, type v, size_t hash_size = 32) {
@@ -74,16 +138,29 @@ public:
         write_be32(out, offset + hash_size * 7, _mm256_extract_epi32(v, 0));
     }
 
-    static inline type load_le(const void *trunk, int offset) {
+    // big endian word at offset of every lane's own block
+    static inline type load_lanes(const void *const *lanes, int offset) {
         return _mm256_set_epi32(
-            read_le32(trunk, offset + 64 * 0),
-            read_le32(trunk, offset + 64 * 1),
-            read_le32(trunk, offset + 64 * 2),
-            read_le32(trunk, offset + 64 * 3),
-            read_le32(trunk, offset + 64 * 4),
-            read_le32(trunk, offset + 64 * 5),
-            read_le32(trunk, offset + 64 * 6),
-            read_le32(trunk, offset + 64 * 7)
+            read_be32(lanes[0], offset),
+            read_be32(lanes[1], offset),
+            read_be32(lanes[2], offset),
+            read_be32(lanes[3], offset),
+            read_be32(lanes[4], offset),
+            read_be32(lanes[5], offset),
+            read_be32(lanes[6], offset),
+            read_be32(lanes[7], offset)
+        );
+    }
+    static inline type load_le(const void *trunk, int offset, size_t block_size = 64) {
+        return _mm256_set_epi32(
+            read_le32(trunk, offset + block_size * 0),
+            read_le32(trunk, offset + block_size * 1),
+            read_le32(trunk, offset + block_size * 2),
+            read_le32(trunk, offset + block_size * 3),
+            read_le32(trunk, offset + block_size * 4),
+            read_le32(trunk, offset + block_size * 5),
+            read_le32(trunk, offset + block_size * 6),
+            read_le32(trunk, offset + block_size * 7)
         );
     }
     static inline void save_le(void *out, int offset, type v, size_t hash_size = 32) {
@@ -96,6 +173,21 @@ public:
         write_le32(out, offset + hash_size * 6, _mm256_extract_epi32(v, 1));
         write_le32(out, offset + hash_size * 7, _mm256_extract_epi32(v, 0));
     }
+
+    static inline type load64_le(const void *trunk, int offset, size_t block_size) {
+        return _mm256_set_epi64x(
+            read_le64(trunk, offset + block_size * 0),
+            read_le64(trunk, offset + block_size * 1),
+            read_le64(trunk, offset + block_size * 2),
+            read_le64(trunk, offset + block_size * 3)
+        );
+    }
+    static inline void save64_le(void *out, int offset, type v, size_t hash_size = 32) {
+        write_le64(out, offset + hash_size * 0, _mm256_extract_epi64(v, 3));
+        write_le64(out, offset + hash_size * 1, _mm256_extract_epi64(v, 2));
+        write_le64(out, offset + hash_size * 2, _mm256_extract_epi64(v, 1));
+        write_le64(out, offset + hash_size * 3, _mm256_extract_epi64(v, 0));
+    }
 };
 
 } // namespace fingera
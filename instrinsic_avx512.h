@@ -10,6 +10,7 @@
 #include "compact.h"
 
 // _mm512_rol_epi32 CPUID Flags: AVX512VL + AVX512F
+// _mm512_rol_epi64 _mm512_ternarylogic_epi64 CPUID Flags: AVX512F
 // _mm512_xxx CPUID Flags: AVX512F
 
 namespace fingera {
@@ -51,25 +52,88 @@ public:
         // return vector_or(vector_shl<N>(x), vector_shr<32 - N>(x));
     }
 
-    static inline type load(const void *trunk, int offset) {
+    // low 32 bits of the products
+    static inline type vector_mullo(type x, type y) {
+        return _mm512_mullo_epi32(x, y);
+    }
+
+    // bit i set when lane i of x and y are equal, lane 0 is the highest element
+    static inline uint32_t vector_mask_eq(type x, type y) {
+        type diff = _mm512_permutexvar_epi32(
+            _mm512_set_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+            _mm512_xor_si512(x, y));
+        return _mm512_testn_epi32_mask(diff, diff);
+    }
+    static inline uint32_t extract(type v, size_t lane) {
+        type r = _mm512_permutexvar_epi32(_mm512_set1_epi32(15 - lane), v);
+        return _mm_cvtsi128_si32(_mm512_castsi512_si128(r));
+    }
+    // table[index] of every lane, index < 2^31
+    static inline type vector_gather(const uint32_t *table, type index) {
+        return _mm512_i32gather_epi32(index, (const void *)table, 4);
+    }
+
+    // bits of x where mask is set, of y elsewhere
+    static inline type vector_select(type mask, type x, type y) {
+        // vpternlogd: mask ? x : y
+        return _mm512_ternarylogic_epi32(mask, x, y, 0xCA);
+    }
+    // all ones in the lanes where bit N is set
+    template<int N>
+    static inline type vector_bit_mask(type x) {
+        return _mm512_srai_epi32(_mm512_slli_epi32(x, 31 - N), 31);
+    }
+
+    // per lane shift counts, counts above 31 give 0
+    static inline type vector_shlv(type x, type count) {
+        return _mm512_sllv_epi32(x, count);
+    }
+    static inline type vector_shrv(type x, type count) {
+        return _mm512_srlv_epi32(x, count);
+    }
+    // bit i set when lane i of x is below lane i of y, unsigned
+    static inline uint32_t vector_mask_lt(type x, type y) {
+        const type reverse = _mm512_set_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+        return _mm512_cmplt_epu32_mask(_mm512_permutexvar_epi32(reverse, x), _mm512_permutexvar_epi32(reverse, y));
+    }
+
+    static inline type vector_xor3(type x, type y, type z) {
+        // vpternlogq: x ^ y ^ z
+        return _mm512_ternarylogic_epi64(x, y, z, 0x96);
+    }
+    static inline type vector_chi(type x, type y, type z) {
+        // vpternlogq: x ^ (~y & z)
+        return _mm512_ternarylogic_epi64(x, y, z, 0xD2);
+    }
+
+    static inline type vector_mirror64(uint64_t x) {
+        return _mm512_set1_epi64(x);
+    }
+    template<int N>
+    static inline type vector_rol64(type x) {
+        // CPUID Flags: AVX512F
+        return _mm512_rol_epi64(x, N);
+    }
+
+    static inline type load(const void *trunk, int offset, size_t block_size = 64) {
         return _mm512_set_epi32(
-            read_be32(trunk, offset + 64 * 0),
-            read_be32(trunk, offset + 64 * 1),
-            read_be32(trunk, offset + 64 * 2),
-            read_be32(trunk, offset + 64 * 3),
-            read_be32(trunk, offset + 64 * 4),
-            read_be32(trunk, offset + 64 * 5),
-            read_be32(trunk, offset + 64 * 6),
-            read_be32(trunk, offset + 64 * 7),
-
-            read_be32(trunk, offset + 64 * 8),
-            read_be32(trunk, offset + 64 * 9),
-            read_be32(trunk, offset + 64 * 10),
-            read_be32(trunk, offset + 64 * 11),
-            read_be32(trunk, offset + 64 * 12),
-            read_be32(trunk, offset + 64 * 13),
-            read_be32(trunk, offset + 64 * 14),
-            read_be32(trunk, offset + 64 * 15)
+            read_be32(trunk, offset + block_size * 0),
+            read_be32(trunk, offset + block_size * 1),
+            read_be32(trunk, offset + block_size * 2),
+            read_be32(trunk, offset + block_size * 3),
+            read_be32(trunk, offset + block_size * 4),
+            read_be32(trunk, offset + block_size * 5),
+            read_be32(trunk, offset + block_size * 6),
+            read_be32(trunk, offset + block_size * 7),
+
+            read_be32(trunk, offset + block_size * 8),
+            read_be32(trunk, offset + block_size * 9),
+            read_be32(trunk, offset + block_size * 10),
+            read_be32(trunk, offset + block_size * 11),
+            read_be32(trunk, offset + block_size * 12),
+            read_be32(trunk, offset + block_size * 13),
+            read_be32(trunk, offset + block_size * 14),
+            read_be32(trunk, offset + block_size * 15)
         );
     }
     static inline void save(void *data, int offset, type d, size_t hash_size = 32) {
@@ -104,25 +168,46 @@ public:
     }
 
 
-    static inline type load_le(const void *trunk, int offset) {
+    // big endian word at offset of every lane's own block
+    static inline type load_lanes(const void *const *lanes, int offset) {
         return _mm512_set_epi32(
-            read_le32(trunk, offset + 64 * 0),
-            read_le32(trunk, offset + 64 * 1),
-            read_le32(trunk, offset + 64 * 2),
-            read_le32(trunk, offset + 64 * 3),
-            read_le32(trunk, offset + 64 * 4),
-            read_le32(trunk, offset + 64 * 5),
-            read_le32(trunk, offset + 64 * 6),
-            read_le32(trunk, offset + 64 * 7),
-
-            read_le32(trunk, offset + 64 * 8),
-            read_le32(trunk, offset + 64 * 9),
-            read_le32(trunk, offset + 64 * 10),
-            read_le32(trunk, offset + 64 * 11),
-            read_le32(trunk, offset + 64 * 12),
-            read_le32(trunk, offset + 64 * 13),
-            read_le32(trunk, offset + 64 * 14),
-            read_le32(trunk, offset + 64 * 15)
+            read_be32(lanes[0], offset),
+            read_be32(lanes[1], offset),
+            read_be32(lanes[2], offset),
+            read_be32(lanes[3], offset),
+            read_be32(lanes[4], offset),
+            read_be32(lanes[5], offset),
+            read_be32(lanes[6], offset),
+            read_be32(lanes[7], offset),
+            read_be32(lanes[8], offset),
+            read_be32(lanes[9], offset),
+            read_be32(lanes[10], offset),
+            read_be32(lanes[11], offset),
+            read_be32(lanes[12], offset),
+            read_be32(lanes[13], offset),
+            read_be32(lanes[14], offset),
+            read_be32(lanes[15], offset)
+        );
+    }
+    static inline type load_le(const void *trunk, int offset, size_t block_size = 64) {
+        return _mm512_set_epi32(
+            read_le32(trunk, offset + block_size * 0),
+            read_le32(trunk, offset + block_size * 1),
+            read_le32(trunk, offset + block_size * 2),
+            read_le32(trunk, offset + block_size * 3),
+            read_le32(trunk, offset + block_size * 4),
+            read_le32(trunk, offset + block_size * 5),
+            read_le32(trunk, offset + block_size * 6),
+            read_le32(trunk, offset + block_size * 7),
+
+            read_le32(trunk, offset + block_size * 8),
+            read_le32(trunk, offset + block_size * 9),
+            read_le32(trunk, offset + block_size * 10),
+            read_le32(trunk, offset + block_size * 11),
+            read_le32(trunk, offset + block_size * 12),
+            read_le32(trunk, offset + block_size * 13),
+            read_le32(trunk, offset + block_size * 14),
+            read_le32(trunk, offset + block_size * 15)
         );
     }
     static inline void save_le(void *data, int offset, type d, size_t hash_size = 32) {
@@ -155,6 +240,35 @@ public:
         write_le32(out, offset + hash_size * 2, _mm_extract_epi32(v, 1));
         write_le32(out, offset + hash_size * 3, _mm_extract_epi32(v, 0));
     }
+
+    static inline type load64_le(const void *trunk, int offset, size_t block_size) {
+        return _mm512_set_epi64(
+            read_le64(trunk, offset + block_size * 0),
+            read_le64(trunk, offset + block_size * 1),
+            read_le64(trunk, offset + block_size * 2),
+            read_le64(trunk, offset + block_size * 3),
+            read_le64(trunk, offset + block_size * 4),
+            read_le64(trunk, offset + block_size * 5),
+            read_le64(trunk, offset + block_size * 6),
+            read_le64(trunk, offset + block_size * 7)
+        );
+    }
+    static inline void save64_le(void *data, int offset, type d, size_t hash_size = 32) {
+        char *out = (char *)data;
+
+        __m256i v = _mm512_extracti64x4_epi64(d, 1);
+        write_le64(out, offset + hash_size * 0, _mm256_extract_epi64(v, 3));
+        write_le64(out, offset + hash_size * 1, _mm256_extract_epi64(v, 2));
+        write_le64(out, offset + hash_size * 2, _mm256_extract_epi64(v, 1));
+        write_le64(out, offset + hash_size * 3, _mm256_extract_epi64(v, 0));
+        out += hash_size * 4;
+
+        v = _mm512_extracti64x4_epi64(d, 0);
+        write_le64(out, offset + hash_size * 0, _mm256_extract_epi64(v, 3));
+        write_le64(out, offset + hash_size * 1, _mm256_extract_epi64(v, 2));
+        write_le64(out, offset + hash_size * 2, _mm256_extract_epi64(v, 1));
+        write_le64(out, offset + hash_size * 3, _mm256_extract_epi64(v, 0));
+    }
 };
 
 } // namespace fingera
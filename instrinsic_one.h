@@ -45,14 +45,57 @@ public:
         return (x << N) | (x >> (32 - N));
     }
 
-    static inline type load(const void *trunk, int offset) {
-        return read_be32(trunk, offset + 64 * 0);
+    // low 32 bits of the product
+    static inline type vector_mullo(type x, type y) {
+        return x * y;
+    }
+
+    // bit i set when lane i of x and y are equal
+    static inline uint32_t vector_mask_eq(type x, type y) {
+        return x == y;
+    }
+    static inline uint32_t extract(type v, size_t lane) {
+        return v;
+    }
+    // table[index] of every lane
+    static inline type vector_gather(const uint32_t *table, type index) {
+        return table[index];
+    }
+
+    // bits of x where mask is set, of y elsewhere
+    static inline type vector_select(type mask, type x, type y) {
+        return (mask & x) | (~mask & y);
+    }
+    // all ones in the lanes where bit N is set
+    template<int N>
+    static inline type vector_bit_mask(type x) {
+        return (type)((int32_t)(x << (31 - N)) >> 31);
+    }
+
+    // per lane shift counts, counts above 31 give 0
+    static inline type vector_shlv(type x, type count) {
+        return count < 32 ? x << count : 0;
+    }
+    static inline type vector_shrv(type x, type count) {
+        return count < 32 ? x >> count : 0;
+    }
+    // bit i set when lane i of x is below lane i of y, unsigned
+    static inline uint32_t vector_mask_lt(type x, type y) {
+        return x < y;
+    }
+
+    static inline type load(const void *trunk, int offset, size_t block_size = 64) {
+        return read_be32(trunk, offset + block_size * 0);
     }
     static inline void save(void *out, int offset, type v, size_t hash_size = 32) {
         write_be32(out, offset + hash_size * 0, v);
     }
-    static inline type load_le(const void *trunk, int offset) {
-        return read_le32(trunk, offset + 64 * 0);
+    // big endian word at offset of every lane's own block
+    static inline type load_lanes(const void *const *lanes, int offset) {
+        return read_be32(lanes[0], offset);
+    }
+    static inline type load_le(const void *trunk, int offset, size_t block_size = 64) {
+        return read_le32(trunk, offset + block_size * 0);
     }
     static inline void save_le(void *out, int offset, type v, size_t hash_size = 32) {
         write_le32(out, offset + hash_size * 0, v);
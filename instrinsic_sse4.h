@@ -9,7 +9,7 @@
 #include <immintrin.h>
 #include "compact.h"
 
-// _mm_extract_epi32 CPUID Flags: SSE4.1
+// _mm_extract_epi32 _mm_extract_epi64 _mm_blendv_epi8 _mm_mullo_epi32 CPUID Flags: SSE4.1
 // _mm_rol_epi32 CPUID Flags: AVX512VL + AVX512F(disabled)
 // _mm_xxx CPUID Flags: SSE2
 
@@ -52,12 +52,94 @@ public:
         return vector_or(vector_shl<N>(x), vector_shr<32 - N>(x));
     }
 
-    static inline type load(const void *trunk, int offset) {
+    // low 32 bits of the products
+    static inline type vector_mullo(type x, type y) {
+        return _mm_mullo_epi32(x, y);
+    }
+
+    // bit i set when lane i of x and y are equal, lane 0 is the highest element
+    static inline uint32_t vector_mask_eq(type x, type y) {
+        type eq = _mm_shuffle_epi32(_mm_cmpeq_epi32(x, y), 0x1B);
+        return _mm_movemask_ps(_mm_castsi128_ps(eq));
+    }
+    static inline uint32_t extract(type v, size_t lane) {
+        switch (lane) {
+        case 0: return _mm_extract_epi32(v, 3);
+        case 1: return _mm_extract_epi32(v, 2);
+        case 2: return _mm_extract_epi32(v, 1);
+        default: return _mm_extract_epi32(v, 0);
+        }
+    }
+    // table[index] of every lane, no gather before AVX2
+    static inline type vector_gather(const uint32_t *table, type index) {
         return _mm_set_epi32(
-            read_be32(trunk, offset + 64 * 0),
-            read_be32(trunk, offset + 64 * 1),
-            read_be32(trunk, offset + 64 * 2),
-            read_be32(trunk, offset + 64 * 3)
+            table[(uint32_t)_mm_extract_epi32(index, 3)],
+            table[(uint32_t)_mm_extract_epi32(index, 2)],
+            table[(uint32_t)_mm_extract_epi32(index, 1)],
+            table[(uint32_t)_mm_extract_epi32(index, 0)]
+        );
+    }
+
+    // bytes of x where mask is set, of y elsewhere, mask lanes all ones or zero
+    static inline type vector_select(type mask, type x, type y) {
+        return _mm_blendv_epi8(y, x, mask);
+    }
+    // all ones in the lanes where bit N is set
+    template<int N>
+    static inline type vector_bit_mask(type x) {
+        return _mm_srai_epi32(_mm_slli_epi32(x, 31 - N), 31);
+    }
+
+    // per lane shift counts, counts above 31 give 0, no variable shift before AVX2
+    static inline type vector_shlv(type x, type count) {
+        uint32_t v[4], c[4];
+        _mm_storeu_si128((type *)v, x);
+        _mm_storeu_si128((type *)c, count);
+        for (int i = 0; i < 4; i++) {
+            v[i] = c[i] < 32 ? v[i] << c[i] : 0;
+        }
+        return _mm_loadu_si128((const type *)v);
+    }
+    static inline type vector_shrv(type x, type count) {
+        uint32_t v[4], c[4];
+        _mm_storeu_si128((type *)v, x);
+        _mm_storeu_si128((type *)c, count);
+        for (int i = 0; i < 4; i++) {
+            v[i] = c[i] < 32 ? v[i] >> c[i] : 0;
+        }
+        return _mm_loadu_si128((const type *)v);
+    }
+    // bit i set when lane i of x is below lane i of y, unsigned
+    static inline uint32_t vector_mask_lt(type x, type y) {
+        const type sign = _mm_set1_epi32(0x80000000);
+        type lt = _mm_cmpgt_epi32(_mm_xor_si128(y, sign), _mm_xor_si128(x, sign));
+        return _mm_movemask_ps(_mm_castsi128_ps(_mm_shuffle_epi32(lt, 0x1B)));
+    }
+
+    static inline type vector_xor3(type x, type y, type z) {
+        return vector_xor(vector_xor(x, y), z);
+    }
+    static inline type vector_chi(type x, type y, type z) {
+        // x ^ (~y & z)
+        return vector_xor(x, vector_andnot(y, z));
+    }
+
+    static inline type vector_mirror64(uint64_t x) {
+        return _mm_set1_epi64x(x);
+    }
+    template<int N>
+    static inline type vector_rol64(type x) {
+        // CPUID Flags: AVX512VL + AVX512F
+        // return _mm_rol_epi64(x, N);
+        return vector_or(_mm_slli_epi64(x, N), _mm_srli_epi64(x, 64 - N));
+    }
+
+    static inline type load(const void *trunk, int offset, size_t block_size = 64) {
+        return _mm_set_epi32(
+            read_be32(trunk, offset + block_size * 0),
+            read_be32(trunk, offset + block_size * 1),
+            read_be32(trunk, offset + block_size * 2),
+            read_be32(trunk, offset + block_size * 3)
         );
     }
     static inline void save(void *out, int offset, type v, size_t hash_size = 32) {
@@ -67,12 +149,21 @@ public:
         write_be32(out, offset + hash_size * 3, _mm_extract_epi32(v, 0));
     }
 
-    static inline type load_le(const void *trunk, int offset) {
+    // big endian word at offset of every lane's own block
+    static inline type load_lanes(const void *const *lanes, int offset) {
         return _mm_set_epi32(
-            read_le32(trunk, offset + 64 * 0),
-            read_le32(trunk, offset + 64 * 1),
-            read_le32(trunk, offset + 64 * 2),
-            read_le32(trunk, offset + 64 * 3)
+            read_be32(lanes[0], offset),
+            read_be32(lanes[1], offset),
+            read_be32(lanes[2], offset),
+            read_be32(lanes[3], offset)
+        );
+    }
+    static inline type load_le(const void *trunk, int offset, size_t block_size = 64) {
+        return _mm_set_epi32(
+            read_le32(trunk, offset + block_size * 0),
+            read_le32(trunk, offset + block_size * 1),
+            read_le32(trunk, offset + block_size * 2),
+            read_le32(trunk, offset + block_size * 3)
         );
     }
     static inline void save_le(void *out, int offset, type v, size_t hash_size = 32) {
@@ -81,6 +172,17 @@ public:
         write_le32(out, offset + hash_size * 2, _mm_extract_epi32(v, 1));
         write_le32(out, offset + hash_size * 3, _mm_extract_epi32(v, 0));
     }
+
+    static inline type load64_le(const void *trunk, int offset, size_t block_size) {
+        return _mm_set_epi64x(
+            read_le64(trunk, offset + block_size * 0),
+            read_le64(trunk, offset + block_size * 1)
+        );
+    }
+    static inline void save64_le(void *out, int offset, type v, size_t hash_size = 32) {
+        write_le64(out, offset + hash_size * 0, _mm_extract_epi64(v, 1));
+        write_le64(out, offset + hash_size * 1, _mm_extract_epi64(v, 0));
+    }
 };
 
 } // namespace fingera
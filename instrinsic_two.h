@@ -64,18 +64,75 @@ public:
         return r;
     }
 
-    static inline type load(const void *trunk, int offset) {
-        type first = read_be32(trunk, offset + 64 * 0);
-        type second = read_be32(trunk, offset + 64 * 1);
+    // low 32 bits of the products
+    static inline type vector_mullo(type x, type y) {
+        uint64_t r;
+        *b1(&r) = *b1(&x) * *b1(&y);
+        *b2(&r) = *b2(&x) * *b2(&y);
+        return r;
+    }
+
+    // bit i set when lane i of x and y are equal
+    static inline uint32_t vector_mask_eq(type x, type y) {
+        return (uint32_t)((uint32_t)x == (uint32_t)y) | ((uint32_t)((x >> 32) == (y >> 32)) << 1);
+    }
+    static inline uint32_t extract(type v, size_t lane) {
+        return (uint32_t)(v >> (32 * lane));
+    }
+    // table[index] of every lane
+    static inline type vector_gather(const uint32_t *table, type index) {
+        return (type)table[(uint32_t)index] | ((type)table[index >> 32] << 32);
+    }
+
+    // bits of x where mask is set, of y elsewhere
+    static inline type vector_select(type mask, type x, type y) {
+        return (mask & x) | (~mask & y);
+    }
+    // all ones in the lanes where bit N is set
+    template<int N>
+    static inline type vector_bit_mask(type x) {
+        uint64_t r;
+        *b1(&r) = (uint32_t)((int32_t)(*b1(&x) << (31 - N)) >> 31);
+        *b2(&r) = (uint32_t)((int32_t)(*b2(&x) << (31 - N)) >> 31);
+        return r;
+    }
+
+    // per lane shift counts, counts above 31 give 0
+    static inline type vector_shlv(type x, type count) {
+        uint64_t r;
+        *b1(&r) = *b1(&count) < 32 ? *b1(&x) << *b1(&count) : 0;
+        *b2(&r) = *b2(&count) < 32 ? *b2(&x) << *b2(&count) : 0;
+        return r;
+    }
+    static inline type vector_shrv(type x, type count) {
+        uint64_t r;
+        *b1(&r) = *b1(&count) < 32 ? *b1(&x) >> *b1(&count) : 0;
+        *b2(&r) = *b2(&count) < 32 ? *b2(&x) >> *b2(&count) : 0;
+        return r;
+    }
+    // bit i set when lane i of x is below lane i of y, unsigned
+    static inline uint32_t vector_mask_lt(type x, type y) {
+        return (uint32_t)((uint32_t)x < (uint32_t)y) | ((uint32_t)((x >> 32) < (y >> 32)) << 1);
+    }
+
+    static inline type load(const void *trunk, int offset, size_t block_size = 64) {
+        type first = read_be32(trunk, offset + block_size * 0);
+        type second = read_be32(trunk, offset + block_size * 1);
         return first | (second << 32);
     }
     static inline void save(void *out, int offset, type v, size_t hash_size = 32) {
         write_be32(out, offset + hash_size * 0, v);
         write_be32(out, offset + hash_size * 1, v >> 32);
     }
-    static inline type load_le(const void *trunk, int offset) {
-        type first = read_le32(trunk, offset + 64 * 0);
-        type second = read_le32(trunk, offset + 64 * 1);
+    // big endian word at offset of every lane's own block
+    static inline type load_lanes(const void *const *lanes, int offset) {
+        type first = read_be32(lanes[0], offset);
+        type second = read_be32(lanes[1], offset);
+        return first | (second << 32);
+    }
+    static inline type load_le(const void *trunk, int offset, size_t block_size = 64) {
+        type first = read_le32(trunk, offset + block_size * 0);
+        type second = read_le32(trunk, offset + block_size * 1);
         return first | (second << 32);
     }
     static inline void save_le(void *out, int offset, type v, size_t hash_size = 32) {
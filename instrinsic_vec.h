@@ -0,0 +1,187 @@
+/**
+ * @file instrinsic_vec.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-01
+ */
+#pragma once
+
+#include <cstdint>
+#include "compact.h"
+
+// GCC / Clang vector extensions, the compiler picks the instructions for
+// the target flags. widths above the hardware are split into registers
+
+namespace fingera {
+
+// a vector of Bytes / sizeof(T) elements, a member so that it stays a
+// dependent type inside templates
+template<typename T, int Bytes>
+struct vector_of {
+    typedef T type __attribute__((vector_size(Bytes)));
+};
+
+// N lanes of 32 bits, N a power of two, lane i is element i. the lane
+// masks are 32 bits wide, the 64 bit operations need N >= 2
+template<int N>
+class instrinsic_vec {
+    static_assert(N >= 1 && N <= 32 && (N & (N - 1)) == 0, "N must be a power of two from 1 to 32");
+
+public:
+    using type = typename vector_of<uint32_t, 4 * N>::type;
+    using signed_type = typename vector_of<int32_t, 4 * N>::type;
+
+private:
+    // N / 2 lanes of 64 bits, only for the 64 bit operations
+    template<int M = N>
+    using type64 = typename vector_of<uint64_t, 4 * M>::type;
+
+public:
+    static inline type vector_mirror(uint32_t x) {
+        return type{} + x;
+    }
+    static inline type vector_add(type x, type y) {
+        return x + y;
+    }
+    static inline type vector_xor(type x, type y) {
+        return x ^ y;
+    }
+    static inline type vector_or(type x, type y) {
+        return x | y;
+    }
+    static inline type vector_and(type x, type y) {
+        return x & y;
+    }
+    static inline type vector_andnot(type x, type y) {
+        return ~x & y;
+    }
+    template<int S>
+    static inline type vector_shr(type x) {
+        return x >> S;
+    }
+    template<int S>
+    static inline type vector_shl(type x) {
+        return x << S;
+    }
+    template<int S>
+    static inline type vector_rol(type x) {
+        return (x << S) | (x >> (32 - S));
+    }
+
+    // low 32 bits of the products
+    static inline type vector_mullo(type x, type y) {
+        return x * y;
+    }
+
+    // bit i set when lane i of x and y are equal
+    static inline uint32_t vector_mask_eq(type x, type y) {
+        return lane_bits(x == y);
+    }
+    static inline uint32_t extract(type v, size_t lane) {
+        return v[lane];
+    }
+    // table[index] of every lane
+    static inline type vector_gather(const uint32_t *table, type index) {
+        type r;
+        for (int i = 0; i < N; i++) {
+            r[i] = table[index[i]];
+        }
+        return r;
+    }
+
+    // bits of x where mask is set, of y elsewhere
+    static inline type vector_select(type mask, type x, type y) {
+        return (mask & x) | (~mask & y);
+    }
+    // all ones in the lanes where bit S is set
+    template<int S>
+    static inline type vector_bit_mask(type x) {
+        return (type)((signed_type)(x << (31 - S)) >> 31);
+    }
+
+    // per lane shift counts, counts above 31 give 0
+    static inline type vector_shlv(type x, type count) {
+        return (x << (count & 31)) & (type)(count < 32);
+    }
+    static inline type vector_shrv(type x, type count) {
+        return (x >> (count & 31)) & (type)(count < 32);
+    }
+    // bit i set when lane i of x is below lane i of y, unsigned
+    static inline uint32_t vector_mask_lt(type x, type y) {
+        return lane_bits(x < y);
+    }
+
+    static inline type vector_xor3(type x, type y, type z) {
+        return x ^ y ^ z;
+    }
+    static inline type vector_chi(type x, type y, type z) {
+        // x ^ (~y & z)
+        return x ^ (~y & z);
+    }
+
+    static inline type vector_mirror64(uint64_t x) {
+        return (type)(type64<>{} + x);
+    }
+    template<int S>
+    static inline type vector_rol64(type x) {
+        type64<> v = (type64<>)x;
+        return (type)((v << S) | (v >> (64 - S)));
+    }
+
+    static inline type load(const void *trunk, int offset, size_t block_size = 64) {
+        type r;
+        for (int i = 0; i < N; i++) {
+            r[i] = read_be32(trunk, offset + block_size * i);
+        }
+        return r;
+    }
+    static inline void save(void *out, int offset, type v, size_t hash_size = 32) {
+        for (int i = 0; i < N; i++) {
+            write_be32(out, offset + hash_size * i, v[i]);
+        }
+    }
+    // big endian word at offset of every lane's own block
+    static inline type load_lanes(const void *const *lanes, int offset) {
+        type r;
+        for (int i = 0; i < N; i++) {
+            r[i] = read_be32(lanes[i], offset);
+        }
+        return r;
+    }
+    static inline type load_le(const void *trunk, int offset, size_t block_size = 64) {
+        type r;
+        for (int i = 0; i < N; i++) {
+            r[i] = read_le32(trunk, offset + block_size * i);
+        }
+        return r;
+    }
+    static inline void save_le(void *out, int offset, type v, size_t hash_size = 32) {
+        for (int i = 0; i < N; i++) {
+            write_le32(out, offset + hash_size * i, v[i]);
+        }
+    }
+
+    static inline type load64_le(const void *trunk, int offset, size_t block_size) {
+        type64<> r;
+        for (int i = 0; i < N / 2; i++) {
+            r[i] = read_le64(trunk, offset + block_size * i);
+        }
+        return (type)r;
+    }
+    static inline void save64_le(void *out, int offset, type v, size_t hash_size = 32) {
+        type64<> w = (type64<>)v;
+        for (int i = 0; i < N / 2; i++) {
+            write_le64(out, offset + hash_size * i, w[i]);
+        }
+    }
+
+private:
+    static inline uint32_t lane_bits(signed_type mask) {
+        uint32_t r = 0;
+        for (int i = 0; i < N; i++) {
+            r |= (uint32_t)(mask[i] & 1) << i;
+        }
+        return r;
+    }
+};
+
+} // namespace fingera
@@ -0,0 +1,227 @@
+/**
+ * @file keccak.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-20
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include "compact.h"
+
+namespace fingera {
+
+// Keccak-256 / SHA3-256 over 64-bit lanes.
+// Instrinsic must provide the 64-bit operations (sse4, avx2, avx512).
+template<typename Instrinsic>
+class keccak {
+public:
+    using type = typename Instrinsic::type;
+
+    enum {
+        rate = 136,
+        hash_size = 32,
+    };
+    // domain separation byte, the last bit of the rate is set by the kernel
+    enum padding {
+        keccak_pad = 0x01,
+        sha3_pad = 0x06,
+    };
+protected:
+    static inline type vector_mirror(uint64_t x) {
+        return Instrinsic::vector_mirror64(x);
+    }
+    static inline type vector_xor(type x, type y) {
+        return Instrinsic::vector_xor(x, y);
+    }
+    static inline type vector_xor(type x, type y, type z) {
+        return Instrinsic::vector_xor3(x, y, z);
+    }
+    static inline type vector_chi(type x, type y, type z) {
+        return Instrinsic::vector_chi(x, y, z);
+    }
+    template<int N>
+    static inline type vector_rol64(type x) {
+        return Instrinsic::template vector_rol64<N>(x);
+    }
+
+    static inline void round(type *s, uint64_t rc) {
+        // theta
+        type c0 = vector_xor(vector_xor(s[0], s[5], s[10]), s[15], s[20]);
+        type c1 = vector_xor(vector_xor(s[1], s[6], s[11]), s[16], s[21]);
+        type c2 = vector_xor(vector_xor(s[2], s[7], s[12]), s[17], s[22]);
+        type c3 = vector_xor(vector_xor(s[3], s[8], s[13]), s[18], s[23]);
+        type c4 = vector_xor(vector_xor(s[4], s[9], s[14]), s[19], s[24]);
+
+        type d0 = vector_xor(c4, vector_rol64<1>(c1));
+        type d1 = vector_xor(c0, vector_rol64<1>(c2));
+        type d2 = vector_xor(c1, vector_rol64<1>(c3));
+        type d3 = vector_xor(c2, vector_rol64<1>(c4));
+        type d4 = vector_xor(c3, vector_rol64<1>(c0));
+
+        // rho + pi
+        type b0 = vector_xor(s[0], d0);
+        type b10 = vector_rol64<1>(vector_xor(s[1], d1));
+        type b20 = vector_rol64<62>(vector_xor(s[2], d2));
+        type b5 = vector_rol64<28>(vector_xor(s[3], d3));
+        type b15 = vector_rol64<27>(vector_xor(s[4], d4));
+        type b16 = vector_rol64<36>(vector_xor(s[5], d0));
+        type b1 = vector_rol64<44>(vector_xor(s[6], d1));
+        type b11 = vector_rol64<6>(vector_xor(s[7], d2));
+        type b21 = vector_rol64<55>(vector_xor(s[8], d3));
+        type b6 = vector_rol64<20>(vector_xor(s[9], d4));
+        type b7 = vector_rol64<3>(vector_xor(s[10], d0));
+        type b17 = vector_rol64<10>(vector_xor(s[11], d1));
+        type b2 = vector_rol64<43>(vector_xor(s[12], d2));
+        type b12 = vector_rol64<25>(vector_xor(s[13], d3));
+        type b22 = vector_rol64<39>(vector_xor(s[14], d4));
+        type b23 = vector_rol64<41>(vector_xor(s[15], d0));
+        type b8 = vector_rol64<45>(vector_xor(s[16], d1));
+        type b18 = vector_rol64<15>(vector_xor(s[17], d2));
+        type b3 = vector_rol64<21>(vector_xor(s[18], d3));
+        type b13 = vector_rol64<8>(vector_xor(s[19], d4));
+        type b14 = vector_rol64<18>(vector_xor(s[20], d0));
+        type b24 = vector_rol64<2>(vector_xor(s[21], d1));
+        type b9 = vector_rol64<61>(vector_xor(s[22], d2));
+        type b19 = vector_rol64<56>(vector_xor(s[23], d3));
+        type b4 = vector_rol64<14>(vector_xor(s[24], d4));
+
+        // chi
+        s[0] = vector_chi(b0, b1, b2);
+        s[1] = vector_chi(b1, b2, b3);
+        s[2] = vector_chi(b2, b3, b4);
+        s[3] = vector_chi(b3, b4, b0);
+        s[4] = vector_chi(b4, b0, b1);
+
+        s[5] = vector_chi(b5, b6, b7);
+        s[6] = vector_chi(b6, b7, b8);
+        s[7] = vector_chi(b7, b8, b9);
+        s[8] = vector_chi(b8, b9, b5);
+        s[9] = vector_chi(b9, b5, b6);
+
+        s[10] = vector_chi(b10, b11, b12);
+        s[11] = vector_chi(b11, b12, b13);
+        s[12] = vector_chi(b12, b13, b14);
+        s[13] = vector_chi(b13, b14, b10);
+        s[14] = vector_chi(b14, b10, b11);
+
+        s[15] = vector_chi(b15, b16, b17);
+        s[16] = vector_chi(b16, b17, b18);
+        s[17] = vector_chi(b17, b18, b19);
+        s[18] = vector_chi(b18, b19, b15);
+        s[19] = vector_chi(b19, b15, b16);
+
+        s[20] = vector_chi(b20, b21, b22);
+        s[21] = vector_chi(b21, b22, b23);
+        s[22] = vector_chi(b22, b23, b24);
+        s[23] = vector_chi(b23, b24, b20);
+        s[24] = vector_chi(b24, b20, b21);
+
+        // iota
+        s[0] = vector_xor(s[0], vector_mirror(rc));
+    }
+
+public:
+    static inline size_t way() {
+        return sizeof(type) / sizeof(uint64_t);
+    }
+
+    static inline void permute(type *s) {
+        round(s, 0x0000000000000001ull);
+        round(s, 0x0000000000008082ull);
+        round(s, 0x800000000000808Aull);
+        round(s, 0x8000000080008000ull);
+        round(s, 0x000000000000808Bull);
+        round(s, 0x0000000080000001ull);
+        round(s, 0x8000000080008081ull);
+        round(s, 0x8000000000008009ull);
+        round(s, 0x000000000000008Aull);
+        round(s, 0x0000000000000088ull);
+        round(s, 0x0000000080008009ull);
+        round(s, 0x000000008000000Aull);
+        round(s, 0x000000008000808Bull);
+        round(s, 0x800000000000008Bull);
+        round(s, 0x8000000000008089ull);
+        round(s, 0x8000000000008003ull);
+        round(s, 0x8000000000008002ull);
+        round(s, 0x8000000000000080ull);
+        round(s, 0x000000000000800Aull);
+        round(s, 0x800000008000000Aull);
+        round(s, 0x8000000080008081ull);
+        round(s, 0x8000000000008080ull);
+        round(s, 0x0000000080000001ull);
+        round(s, 0x8000000080008008ull);
+    }
+
+    static inline void process_block(type *s, const void *block) {
+        for (int i = 0; i < rate / 8; i++) {
+            s[i] = vector_xor(s[i], Instrinsic::load64_le(block, i * 8, rate));
+        }
+        permute(s);
+    }
+
+    // blocks: padded 136 byte blocks, block i of every message at blocks + 136 * way() * i
+    static void process_trunk(void *out, const void *blocks, int count = 1) {
+        type s[25];
+        for (int i = 0; i < 25; i++) {
+            s[i] = vector_mirror(0);
+        }
+
+        char *cur_block = (char *)blocks;
+        while (count--) {
+            process_block(s, cur_block);
+            cur_block += rate * way();
+        }
+
+        Instrinsic::save64_le(out,  0, s[0]);
+        Instrinsic::save64_le(out,  8, s[1]);
+        Instrinsic::save64_le(out, 16, s[2]);
+        Instrinsic::save64_le(out, 24, s[3]);
+    }
+
+    // in: way() messages of 32 bytes, out: way() digests
+    static void process_32(void *out, const void *in, uint8_t pad = keccak_pad) {
+        type s[25];
+        s[0] = Instrinsic::load64_le(in,  0, 32);
+        s[1] = Instrinsic::load64_le(in,  8, 32);
+        s[2] = Instrinsic::load64_le(in, 16, 32);
+        s[3] = Instrinsic::load64_le(in, 24, 32);
+        s[4] = vector_mirror(pad);
+        for (int i = 5; i < 25; i++) {
+            s[i] = vector_mirror(0);
+        }
+        s[16] = vector_mirror(0x8000000000000000ull);
+        permute(s);
+
+        Instrinsic::save64_le(out,  0, s[0]);
+        Instrinsic::save64_le(out,  8, s[1]);
+        Instrinsic::save64_le(out, 16, s[2]);
+        Instrinsic::save64_le(out, 24, s[3]);
+    }
+
+    // in: way() messages of 64 bytes, out: way() digests
+    static void process_64(void *out, const void *in, uint8_t pad = keccak_pad) {
+        type s[25];
+        s[0] = Instrinsic::load64_le(in,  0, 64);
+        s[1] = Instrinsic::load64_le(in,  8, 64);
+        s[2] = Instrinsic::load64_le(in, 16, 64);
+        s[3] = Instrinsic::load64_le(in, 24, 64);
+        s[4] = Instrinsic::load64_le(in, 32, 64);
+        s[5] = Instrinsic::load64_le(in, 40, 64);
+        s[6] = Instrinsic::load64_le(in, 48, 64);
+        s[7] = Instrinsic::load64_le(in, 56, 64);
+        s[8] = vector_mirror(pad);
+        for (int i = 9; i < 25; i++) {
+            s[i] = vector_mirror(0);
+        }
+        s[16] = vector_mirror(0x8000000000000000ull);
+        permute(s);
+
+        Instrinsic::save64_le(out,  0, s[0]);
+        Instrinsic::save64_le(out,  8, s[1]);
+        Instrinsic::save64_le(out, 16, s[2]);
+        Instrinsic::save64_le(out, 24, s[3]);
+    }
+};
+
+} // namespace fingera
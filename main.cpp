@@ -2,14 +2,39 @@
 #include <string>
 #include <cstring>
 #include <cmath>
+#include <csignal>
+#include <sys/resource.h>
 #include "helper.h"
 #include "sha256.h"
 #include "ripemd160.h"
+#include "keccak.h"
+#include "hmac_sha256.h"
+#include "pbkdf2_sha256.h"
+#include "trunk_arena.h"
+#include "hash_service.h"
+#include "digest_filter.h"
+#include "digest_index.h"
+#include "sha256_shani.h"
+#include "sha256_rorx.h"
+#include "merkle.h"
+#include "merkle_tree.h"
+#include "block.h"
+#include "header_pow.h"
+#include "base58.h"
+#include "hash_drbg.h"
+#include "sphincs_sha256.h"
+#include "fastcdc.h"
+#include "sha256_pipeline.h"
+#include "merkle_mountain.h"
+#include "hash_backends.h"
+#include "digest_cache.h"
+#include "shm_service.h"
 #include "instrinsic_sse4.h"
 #include "instrinsic_one.h"
 #include "instrinsic_two.h"
 #include "instrinsic_avx2.h"
 #include "instrinsic_avx512.h"
+#include "instrinsic_vec.h"
 
 uint8_t sha256_single_block[] = {
     // data
@@ -58,6 +83,502 @@ void fill_ripemd160_trunk(void *buffer, size_t way) {
     }
 }
 
+// checks print their name and ok, main returns 1 if any of them failed
+int failures = 0;
+
+void check(const std::string &what, bool ok) {
+    std::cout << what << (ok ? " ok" : " FAILED") << std::endl;
+    failures += !ok;
+}
+
+void check_hex(const std::string &what, const void *buf, size_t size, const char *expected) {
+    std::string text(size * 2, '0');
+    fingera::hex_encode(&text[0], buf, size);
+    check(what, text == expected);
+    if (text != expected)
+        std::cout << "    got " << text << std::endl;
+}
+
+// lanes of sha3-256, only for 64 bit lanes, vec<1> has none
+template<int N>
+void check_vec_keccak(const std::string &name) {
+    using namespace fingera;
+    using hash = keccak<instrinsic_vec<N> >;
+    uint8_t in[16 * 32], digests[16 * 32], expected[16 * 32];
+    for (size_t i = 0; i < sizeof(in); i++)
+        in[i] = i;
+    hash::process_32(digests, in, hash::sha3_pad);
+    for (size_t i = 0; i < hash::way(); i += 2)
+        keccak<instrinsic_sse4>::process_32(expected + i * 32, in + i * 32, hash::sha3_pad);
+    check_hex(name + " sha3-256", digests, 32, "050a48733bd5c2756ba95c5828cc83ee16fabcd3c086885b7744f84a0f9e0d94");
+    check(name + " sha3-256 lanes", memcmp(digests, expected, hash::way() * 32) == 0);
+}
+
+template<>
+void check_vec_keccak<1>(const std::string &) {
+}
+
+// every lane of instrinsic_vec<N> against the 1 way kernels
+template<int N>
+void check_vec() {
+    using namespace fingera;
+    uint8_t trunk[32 * 64], digests[32 * 32], expected[32 * 32];
+    std::string name = "vec<" + std::to_string(N) + ">";
+
+    fill_sha256_trunk(trunk, N);
+    sha256<instrinsic_vec<N> >::process_trunk(digests, trunk);
+    for (int i = 0; i < N; i++)
+        sha256<instrinsic_one>::process_trunk(expected + i * 32, trunk + i * 64);
+    check_hex(name + " sha256", digests, 32, "5feceb66ffc86f38d952786c6d696c79c2dbc239dd4e91b46729d73a27fb57e9");
+    check(name + " sha256 lanes", memcmp(digests, expected, N * 32) == 0);
+
+    fill_ripemd160_trunk(trunk, N);
+    ripemd160<instrinsic_vec<N> >::process_trunk(digests, trunk);
+    for (int i = 0; i < N; i++)
+        ripemd160<instrinsic_one>::process_trunk(expected + i * 20, trunk + i * 64);
+    check_hex(name + " ripemd160", digests, 20, "ba5ed015715da74cf1e87230ba73d4855edaf6f6");
+    check(name + " ripemd160 lanes", memcmp(digests, expected, N * 20) == 0);
+
+    check_vec_keccak<N>(name);
+}
+
+// Hash_DRBG sha256 as a CAVP test runs it: instantiate, reseed, generate
+// twice, the second 1024 bits are the answer. no prediction resistance,
+// 256 bit entropy, 128 bit nonce, 256 bit personalization, no additional input
+template<typename Instrinsic>
+void check_drbg(const std::string &name) {
+    using namespace fingera;
+    uint8_t seed[48], personalization[32], entropy[32], out[128];
+    hex_decode(seed, "4a1b2262fb29cffdba152406632f7812f3d1bacdedbc4afda3e6bc251a00f6a1"
+        "063b976c7ff52c07868f11db798770c4", 48);
+    hex_decode(personalization, "61f6c1dc3fb2e6cacba3ccebe5081d06eeeafe3461be86627e87c01d76abd6a1", 32);
+    hex_decode(entropy, "dc85088ebd2695d895018d6d6c5f34d1d868a047838a8ceaa773b0473bb6ca14", 32);
+    hash_drbg<Instrinsic> drbg(seed, sizeof(seed), personalization, sizeof(personalization));
+    drbg.reseed(entropy, sizeof(entropy));
+    drbg.generate(out, sizeof(out));
+    drbg.generate(out, sizeof(out));
+    check_hex(name + " hash_drbg", out, sizeof(out),
+        "a7800c01ad5e98c3a2979c473772344754607e4cb849b66313b381f80d84afe3fc4fe64f1e02c4bc722d3ae0028f4b3c"
+        "d969718b9919b95bab33b8b8f0c2efa79673984ca8aac3b7536834128df220fc71672e17268be90c14297db4ea9f30d8"
+        "947899ffd961817299fb6b894b702e9e86132020c9d85e0abcac06975db8996c");
+}
+
+// SPHINCS+-SHA2-128f simple: the 8 WOTS+ keys of the top layer and their
+// root, the public key root of these seeds, and a WOTS+ signature whose
+// digits include 0 and w - 1. values from a reference of the spec
+template<typename Instrinsic>
+void check_sphincs(const std::string &name) {
+    using namespace fingera;
+    using spx = sphincs_sha256<Instrinsic>;
+    uint8_t sk_seed[16], pk_seed[16], message[16];
+    for (int i = 0; i < 16; i++) {
+        sk_seed[i] = i;
+        pk_seed[i] = 16 + i;
+    }
+    hex_decode(message, "0f00ff123456789abcdef0c3a55a7e81", 16);
+    spx hashes(pk_seed);
+
+    sphincs_address address;
+    address.set_layer(21);
+    uint8_t leaves[8 * 16], root[16];
+    hashes.wots_pkgen(leaves, sk_seed, address, 0, 8);
+    check_hex(name + " wots_pkgen", leaves, 16, "3ff8471da95a6022f3926edff1e5f202");
+    check_hex(name + " wots_pkgen keypair 7", leaves + 7 * 16, 16, "53fda12faa4fcefcc28ac9c9832ebfc7");
+    hashes.tree_root(root, leaves, 3, address);
+    check_hex(name + " tree_root", root, 16, "3f84108932df679a727b6ed8468c812b");
+
+    uint8_t sig[spx::len * 16], pk[16];
+    hashes.wots_sign(sig, message, sk_seed, address, 5);
+    trunk_arena<sha256<instrinsic_one> > arena(sha256<instrinsic_one>::block_count(sizeof(sig)));
+    arena.add(sig, sizeof(sig));
+    arena.process();
+    check_hex(name + " wots_sign", arena.digest(0), 32, "5d39de4d7d3fe50c76bda3776a1ebe9a7c8d42d68e80f8b6f22aacd39af7f23f");
+    hashes.wots_pk_from_sig(pk, sig, message, address, 5);
+    check_hex(name + " wots_pk_from_sig", pk, 16, "f05c6aef21b78d60902429413e949694");
+    check(name + " wots sign round trip", memcmp(pk, leaves + 5 * 16, 16) == 0);
+
+    address.set_layer(3);
+    address.set_tree(0x0123456789abcdefull);
+    hashes.wots_pkgen(leaves, sk_seed, address, 0, 8);
+    hashes.tree_root(root, leaves, 3, address);
+    check_hex(name + " tree_root, layer 3", root, 16, "991e2ce7c3bdccf542fae96afeb1c6da");
+}
+
+// chunks of an lcg stream through cdc_pipeline, in place and from a file,
+// against a reference of normalized FastCDC on the whole stream. the
+// summary is the sha256 of every chunk's le32 length || digest. 20000
+// bytes span 5 segments of 4096 and carry a chunk across each, the zeros
+// from 5000 to 8000 have no candidates and cut at max_size
+template<typename Instrinsic>
+void check_cdc(const std::string &name) {
+    using namespace fingera;
+    struct { size_t size, count; const char *summary; } cases[] = {
+        { 0, 0, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855" },
+        { 1, 1, "47523ac572a3a798aa386e6f5c3c367f8e0dce0945f010f4675c4fb29fb7c384" },
+        { 31, 1, "07d5f9ad3909af198bc9b9fe9bec0aa7fe0b1619e2c060f48a3304c6e26acd77" },
+        { 64, 1, "c4928ab345b387c8467e076dd57541e30ee4fa25c29aa96428e34f83ad9ff55f" },
+        { 20000, 62, "b72914b1042932413d3a7cd25dd1920659899d84eeb2cdb4ecb068762fd04bbf" },
+    };
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); c++) {
+        std::vector<uint8_t> data(cases[c].size);
+        uint64_t x = 0x0123456789abcdefull;
+        for (size_t i = 0; i < data.size(); i++) {
+            x = x * 6364136223846793005ull + 1442695040888963407ull;
+            data[i] = (uint8_t)(x >> 56);
+        }
+        if (data.size() > 8000)
+            memset(&data[5000], 0, 3000);
+
+        for (int from_file = 0; from_file < 2; from_file++) {
+            std::vector<uint8_t> records;
+            uint64_t end = 0;
+            size_t count = 0;
+            cdc_pipeline<Instrinsic> pipeline(cdc_params(64, 256, 1024), 4096);
+            auto done = [&](const chunk_record &record) {
+                uint8_t length[4];
+                write_le32(length, 0, record.length);
+                records.insert(records.end(), length, length + 4);
+                records.insert(records.end(), record.digest, record.digest + 32);
+                count += record.offset == end;
+                end += record.length;
+            };
+            if (from_file) {
+                FILE *file = tmpfile();
+                fwrite(data.data(), 1, data.size(), file);
+                fflush(file);
+                lseek(fileno(file), 0, SEEK_SET);
+                pipeline.run(fileno(file), done);
+                fclose(file);
+            } else {
+                pipeline.run(data.data(), data.size(), done);
+            }
+
+            trunk_arena<sha256<instrinsic_one> > arena(sha256<instrinsic_one>::block_count(records.size()));
+            arena.add(records.data(), records.size());
+            arena.process();
+            std::string what = name + (from_file ? " fd" : " in place") + " cdc of " + std::to_string(data.size());
+            check_hex(what, arena.digest(0), 32, cases[c].summary);
+            check(what + " records", count == cases[c].count && end == data.size());
+        }
+    }
+}
+
+// sha256_pipeline against trunk_arena on sizes around the block boundaries,
+// a partial last batch, contiguous and strided messages, aligned and
+// unaligned digests
+template<typename Instrinsic>
+void check_pipeline(const std::string &name) {
+    using namespace fingera;
+    using one = sha256<instrinsic_one>;
+    const size_t sizes[] = { 0, 1, 55, 56, 63, 64, 65, 119, 120, 128, 200 };
+    const size_t count = 2 * sha256<Instrinsic>::way() + 3;
+    std::vector<uint8_t> data(211 * count), expected(32 * count), out(32 * count + 4);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (uint8_t)(i * 7 + 1);
+
+    bool ok = true;
+    for (size_t size : sizes) {
+        for (size_t stride : { size, (size_t)211 }) {
+            for (size_t i = 0; i < count; i++) {
+                trunk_arena<one> arena(one::block_count(size));
+                arena.add(&data[stride * i], size);
+                arena.process();
+                memcpy(&expected[32 * i], arena.digest(0), 32);
+            }
+            for (size_t shift : { 0, 4 }) {
+                memset(out.data(), 0, out.size());
+                sha256_pipeline<Instrinsic>::process(&out[shift], data.data(), size, count, stride == size ? 0 : stride);
+                ok &= memcmp(&out[shift], expected.data(), 32 * count) == 0;
+            }
+        }
+    }
+    check(name + " sha256_pipeline", ok);
+}
+
+// levels of the perfect tree over 2^height leaves, level 0 the leaves
+std::vector<std::vector<uint8_t> > mmr_levels(const uint8_t *leaves, int height) {
+    std::vector<std::vector<uint8_t> > levels(1, std::vector<uint8_t>(leaves, leaves + (32 << height)));
+    for (int h = 1; h <= height; h++) {
+        std::vector<uint8_t> level(levels.back().size() / 2);
+        for (size_t i = 0; i < level.size() / 32; i++)
+            fingera::merkle_branch<fingera::instrinsic_one>::hash_nodes(&level[32 * i],
+                &levels.back()[64 * i], &levels.back()[64 * i + 32]);
+        levels.push_back(level);
+    }
+    return levels;
+}
+
+// root and every proof of range against the peaks recomputed from its count leaves
+template<typename Range>
+bool mmr_matches(Range &range, const uint8_t *leaves, uint64_t count) {
+    std::vector<std::vector<std::vector<uint8_t> > > peaks;
+    std::vector<uint64_t> firsts;
+    for (int h = 63, first = 0; h >= 0; h--) {
+        if ((count >> h) & 1) {
+            peaks.push_back(mmr_levels(leaves + 32 * first, h));
+            firsts.push_back(first);
+            first += 1 << h;
+        }
+    }
+    uint8_t root[32], expected[32];
+    memset(expected, 0, 32);
+    if (!peaks.empty()) {
+        memcpy(expected, peaks.back().back().data(), 32);
+        for (size_t i = peaks.size() - 1; i-- > 0;)
+            fingera::merkle_branch<fingera::instrinsic_one>::hash_nodes(expected, peaks[i].back().data(), expected);
+    }
+    if (range.leaves() != count || !range.root(root) || memcmp(root, expected, 32) != 0)
+        return false;
+
+    std::vector<uint8_t> proof, want;
+    for (size_t p = 0; p < peaks.size(); p++) {
+        for (uint64_t i = 0; i < peaks[p][0].size() / 32; i++) {
+            want.clear();
+            for (size_t l = 0; l + 1 < peaks[p].size(); l++)
+                want.insert(want.end(), &peaks[p][l][32 * ((i >> l) ^ 1)], &peaks[p][l][32 * ((i >> l) ^ 1)] + 32);
+            for (size_t q = 0; q < peaks.size(); q++) {
+                if (q != p)
+                    want.insert(want.end(), peaks[q].back().begin(), peaks[q].back().end());
+            }
+            uint64_t leaf = firsts[p] + i;
+            if (!range.proof(leaf, proof) || proof != want ||
+                    !Range::verify(root, count, leaf, leaves + 32 * leaf, proof.data(), proof.size() / 32))
+                return false;
+        }
+    }
+    return !range.proof(count, proof);
+}
+
+// a merkle mountain range against the recomputed one while it grows past
+// its first mapping, after it is opened again, and while the file can not grow
+template<typename Instrinsic>
+void check_mmr(const std::string &name) {
+    using namespace fingera;
+    char path[] = "/tmp/testcpp_mmr_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        check(name + " mmr file", false);
+        return;
+    }
+    ::close(fd);
+
+    std::vector<uint8_t> leaves(32 * 2300);
+    for (size_t i = 0; i < leaves.size(); i++)
+        leaves[i] = (uint8_t)(i * 7 + (i >> 5) * 13);
+
+    merkle_mountain_range<Instrinsic> range;
+    bool ok = range.open(path) && mmr_matches(range, leaves.data(), 0);
+    uint64_t count = 0;
+    for (uint64_t to : { 1, 2, 3, 7, 8, 600, 1500 }) {
+        for (; count < to; count++)
+            range.append(&leaves[32 * count]);
+        ok &= mmr_matches(range, leaves.data(), count);
+    }
+    check(name + " mmr root and proofs", ok);
+
+    ok = range.close() && range.open(path) && mmr_matches(range, leaves.data(), count);
+    for (; count < 2000; count++)
+        range.append(&leaves[32 * count]);
+    ok &= mmr_matches(range, leaves.data(), count);
+    check(name + " mmr reopened", ok);
+
+    // no room to grow: the appends stay pending, the mapping stays readable
+    struct stat st;
+    struct rlimit limit, saved;
+    signal(SIGXFSZ, SIG_IGN);
+    getrlimit(RLIMIT_FSIZE, &saved);
+    limit = saved;
+    stat(path, &st);
+    limit.rlim_cur = st.st_size;
+    setrlimit(RLIMIT_FSIZE, &limit);
+    for (; count < 2300; count++)
+        range.append(&leaves[32 * count]);
+    uint8_t root[32];
+    ok = !range.flush() && !range.root(root) && range.leaves() == count &&
+        range.size() == range.node_count(2000) && memcmp(range.node(0), &leaves[0], 32) == 0;
+    setrlimit(RLIMIT_FSIZE, &saved);
+    signal(SIGXFSZ, SIG_DFL);
+    ok &= mmr_matches(range, leaves.data(), count);
+    check(name + " mmr growth failure", ok);
+
+    range.close();
+    unlink(path);
+}
+
+// hash_batch of shuffled sizes, some past max_batch_blocks, against one
+// lane of One with a trunk as long as the message
+template<typename Hash, typename One>
+void check_batch(const std::string &name) {
+    using namespace fingera;
+    const size_t sizes[] = { 70000, 0, 65536, 3, 300000, 65527, 64, 1 << 20, 119, 65600, 55, 200000 };
+    const size_t count = sizeof(sizes) / sizeof(sizes[0]);
+    std::vector<uint8_t> data((1 << 20) + 101 * count), expected(count * Hash::hash_size), out(count * Hash::hash_size);
+    for (size_t i = 0; i < data.size(); i++)
+        data[i] = (uint8_t)(i * 7 + (i >> 9));
+    const void *ptrs[count];
+    for (size_t i = 0; i < count; i++) {
+        ptrs[i] = &data[i * 101];
+        trunk_arena<One> arena((int)One::block_count(sizes[i]));
+        arena.add(ptrs[i], sizes[i]);
+        arena.process();
+        memcpy(&expected[i * Hash::hash_size], arena.digest(0), Hash::hash_size);
+    }
+    bool ok = true;
+    for (size_t n : { (size_t)1, (size_t)5, count }) {
+        memset(out.data(), 0, out.size());
+        hash_batch<Hash>(out.data(), ptrs, sizes, n);
+        ok &= memcmp(out.data(), expected.data(), n * Hash::hash_size) == 0;
+    }
+    check(name + " hash_batch", ok);
+}
+
+// what the buffer pool keeps after an arena too large for it
+void check_buffer_pool() {
+    using namespace fingera;
+    buffer_pool &pool = buffer_pool::local();
+    pool.trim();
+    {
+        trunk_arena<sha256<instrinsic_avx512> > arena(max_pooled_chunk / 64 / 16 + 1);
+    }
+    {
+        trunk_arena<sha256<instrinsic_avx512> > arena(max_batch_blocks);
+    }
+    check("buffer_pool cap", pool.pooled() < max_pooled_chunk && pool.pooled() >= 64 * 16 * max_batch_blocks);
+}
+
+// a digest is trusted while the file stays as it was hashed, long enough ago
+void check_digest_cache() {
+    using namespace fingera;
+    char path[] = "/tmp/testcpp_cache_XXXXXX";
+    char file[] = "/tmp/testcpp_file_XXXXXX";
+    int cfd = mkstemp(path), fd = mkstemp(file);
+    if (cfd < 0 || fd < 0) {
+        check("digest_cache files", false);
+        return;
+    }
+    ::close(cfd);
+    const uint32_t sha = digest_cache::algorithm_id("sha256"), rmd = digest_cache::algorithm_id("ripemd160");
+    uint8_t digest[32], got[32];
+    for (int i = 0; i < 32; i++)
+        digest[i] = (uint8_t)(i * 5 + 3);
+
+    digest_cache cache;
+    file_identity id, other;
+    bool ok = write(fd, "abc", 3) == 3 && id.stat(fd, sha) && cache.open(path) && !cache.lookup(id, got, 32);
+    // hashed now: racy, not stored
+    ok &= !cache.store(id, digest, 32, digest_cache::now_ns());
+    ok &= !cache.lookup(id, got, 32);
+    int64_t later = (id.ctime_ns > id.mtime_ns ? id.ctime_ns : id.mtime_ns) + digest_cache::racy_ns + 1;
+    ok &= cache.store(id, digest, 32, later);
+    ok &= cache.lookup(id, got, 32) && memcmp(got, digest, 32) == 0;
+    check("digest_cache hit", ok);
+
+    other = id;
+    other.algorithm = rmd;
+    ok = !cache.lookup(other, got, 20) && !cache.lookup(id, got, 20);
+    cache.close();
+    ok &= cache.open(path) && cache.lookup(id, got, 32) && memcmp(got, digest, 32) == 0;
+    check("digest_cache miss", ok);
+
+    // the file changes: size, then only the times
+    ok = write(fd, "d", 1) == 1 && other.stat(fd, sha) && !cache.lookup(other, got, 32);
+    other = id;
+    other.mtime_ns += 1;
+    ok &= !cache.lookup(other, got, 32);
+    other = id;
+    other.ctime_ns += 1;
+    ok &= !cache.lookup(other, got, 32);
+    check("digest_cache invalidation", ok);
+
+    cache.close();
+    ::close(fd);
+    unlink(file);
+    unlink(path);
+}
+
+// digests of one lane of One, the reference for hashd
+template<typename One>
+void one_digest(uint8_t *out, const uint8_t *data, size_t size) {
+    fingera::trunk_arena<One> arena((int)One::block_count(size));
+    arena.add(data, size);
+    arena.process();
+    memcpy(out, arena.digest(0), One::hash_size);
+}
+
+// clients of a hashd in threads of their own: every slot in flight with
+// messages of mixed sizes and algorithms up to the slot capacity, checked
+// against one lane, then the refused messages
+template<typename Instrinsic>
+void check_shm(const std::string &name) {
+    using namespace fingera;
+    std::string path = "/tmp/testcpp_hashd_" + std::to_string(getpid()) + ".sock";
+    shm_hash_daemon<Instrinsic> daemon(16, 1024);
+    if (!daemon.listen(path)) {
+        check(name + " hashd listen", false);
+        return;
+    }
+    std::atomic<bool> stop(false);
+    std::thread server([&daemon, &stop]() {
+        daemon.run(stop);
+    });
+
+    std::atomic<int> bad(0);
+    std::vector<std::thread> clients;
+    for (unsigned t = 0; t < 3; t++) {
+        clients.push_back(std::thread([&path, &bad, t]() {
+            shm_hash_client c;
+            if (!c.connect(path)) {
+                bad++;
+                return;
+            }
+            uint32_t x = t * 2654435761u + 1;
+            for (int round = 0; round < 20; round++) {
+                std::vector<std::vector<uint8_t> > messages(c.slots());
+                std::vector<uint32_t> algorithms(c.slots());
+                for (size_t i = 0; i < c.slots(); i++) {
+                    x = x * 1664525 + 1013904223;
+                    size_t size = round == 0 && i == 0 ? c.capacity() : (x >> 8) % (round % 2 ? c.capacity() + 1 : 120);
+                    algorithms[i] = (x >> 4) % 3 ? shm_ring::sha256_id : shm_ring::ripemd160_id;
+                    messages[i].resize(size);
+                    for (size_t k = 0; k < size; k++)
+                        messages[i][k] = (uint8_t)(x + k * 131);
+                    int id = c.reserve();
+                    memcpy(c.data(id), messages[i].data(), size);
+                    c.submit(id, algorithms[i], size);
+                }
+                for (size_t i = 0; i < c.slots(); i++) {
+                    uint8_t expected[32];
+                    size_t size = algorithms[i] == shm_ring::sha256_id ? 32 : 20;
+                    if (size == 32)
+                        one_digest<sha256<instrinsic_one> >(expected, messages[i].data(), messages[i].size());
+                    else
+                        one_digest<ripemd160<instrinsic_one> >(expected, messages[i].data(), messages[i].size());
+                    const uint8_t *digest = c.wait((int)i);
+                    bad += !digest || memcmp(digest, expected, size) != 0;
+                    c.release((int)i);
+                }
+            }
+            // an unknown algorithm and a size past the slot are refused
+            int id = c.reserve();
+            c.submit(id, 99, 3);
+            bad += c.wait(id) != nullptr;
+            c.release(id);
+            id = c.reserve();
+            c.submit(id, shm_ring::sha256_id, c.capacity() + 1);
+            bad += c.wait(id) != nullptr;
+            c.release(id);
+            uint8_t digest[32], expected[32];
+            one_digest<sha256<instrinsic_one> >(expected, (const uint8_t *)"abc", 3);
+            bad += !c.hash(shm_ring::sha256_id, "abc", 3, digest, 32) || memcmp(digest, expected, 32) != 0;
+        }));
+    }
+    for (size_t i = 0; i < clients.size(); i++)
+        clients[i].join();
+    stop.store(true);
+    server.join();
+    check(name + " hashd round trip", bad.load() == 0);
+}
+
 void add(int &out) {
 }
 
@@ -88,6 +609,228 @@ int main(int argc, char const *argv[]) {
 
     using namespace fingera;
 
+    uint8_t keccak_input[8 * 32];
+    for (size_t i = 0; i < sizeof(keccak_input); i++) {
+        keccak_input[i] = i;
+    }
+    keccak<instrinsic_avx512>::process_32(&result_hash[0][0], keccak_input);
+    std::cout << "8 way keccak256" << std::endl;
+    for (size_t i = 0; i < 8; i++)
+        dump_buffer(&result_hash[0][i * 32], 32);
+
+    keccak<instrinsic_avx512>::process_32(&result_hash[0][0], keccak_input, keccak<instrinsic_avx512>::sha3_pad);
+    std::cout << "8 way sha3-256" << std::endl;
+    for (size_t i = 0; i < 8; i++)
+        dump_buffer(&result_hash[0][i * 32], 32);
+
+    // 089c386a9149b5cce5972bfe0f05c8d6e92de22e902457b3a23a69a79f85fa97
+    hmac_sha256<instrinsic_avx2>::key hmac_key;
+    hmac_sha256<instrinsic_avx2>::init_key(hmac_key, "key", 3);
+    uint8_t hmac_trunk[8 * 64];
+    memset(hmac_trunk, 0, sizeof(hmac_trunk));
+    for (size_t i = 0; i < 8; i++) {
+        hmac_trunk[i * 64] = '0' + i;
+        hmac_trunk[i * 64 + 1] = 0x80;
+        write_be64(hmac_trunk, i * 64 + 56, (64 + 1) * 8);
+    }
+    hmac_sha256<instrinsic_avx2>::process_trunk(&result_hash[3][0], hmac_key, hmac_trunk);
+    std::cout << "8 way hmac-sha256" << std::endl;
+    for (size_t i = 0; i < 8; i++)
+        dump_buffer(&result_hash[3][i * 32], 32);
+
+    const char *passwords[] = { "password", "passphrase" };
+    const char *salts[] = { "salt", "NaCl" };
+    size_t password_sizes[] = { 8, 10 };
+    size_t salt_sizes[] = { 4, 4 };
+    pbkdf2_sha256<instrinsic_avx2>::derive(&result_hash[3][0], 32,
+        (const void *const *)passwords, password_sizes,
+        (const void *const *)salts, salt_sizes, 4096, 2);
+    std::cout << "2 of 8 way pbkdf2-hmac-sha256" << std::endl;
+    // c5e478d59288c841aa530db6845c4c8d962893a001ce4e11a4963873aa98134a
+    dump_buffer(&result_hash[3][0], 32);
+    dump_buffer(&result_hash[3][32], 32);
+
+    // messages of different lengths share one batch
+    trunk_arena<sha256<instrinsic_sse4> > arena(2);
+    arena.add("", 0);
+    arena.add("abc", 3);
+    arena.add("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq", 56);
+    arena.process();
+    std::cout << "4 way sha256 arena" << std::endl;
+    // e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855
+    // ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad
+    // 248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1
+    for (size_t i = 0; i < arena.size(); i++)
+        dump_buffer(arena.digest(i), 32);
+
+    {
+        data_trunk blocks(64 * sha256_shani::way());
+        uint8_t digests[32 * 2];
+        for (size_t i = 0; i < sha256_shani::way(); i++)
+            sha256_shani::fill_lane(blocks.data(), i, "abc", 3);
+        sha256_shani::process_trunk(digests, blocks.data());
+        std::cout << "2 way sha-ni sha256" << std::endl;
+        // ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad
+        dump_buffer(digests, 32);
+        dump_buffer(digests + 32, 32);
+    }
+
+    {
+        // block 100000, txids in internal byte order
+        const char *txids[4] = {
+            "876dd0a3ef4a2816ffd1c12ab649825a958b0ff3bb3d6f3e1250f13ddbf0148c",
+            "c40297f730dd7b5a99567eb8d27b78758f607507c52292d02d4031895b52f2ff",
+            "c46e239ab7d28e2c019b6d66ad8fae98a56ef1f21aeecb94d1b1718186f05963",
+            "1d0cb83721529a062d9675b98d6e5c587e4a770fc84ed00abc5a5de04568a6e9",
+        };
+        uint8_t leaves[4][32], level1[2][32], root[32], branches[4][2][32];
+        for (int i = 0; i < 4; i++)
+            hex_decode(leaves[i], txids[i], 32);
+        merkle_branch<instrinsic_two>::hash_nodes(level1, leaves[0], leaves[1], 64);
+        merkle_branch<instrinsic_one>::hash_nodes(root, level1[0], level1[1]);
+
+        merkle_proof proofs[4];
+        for (uint32_t i = 0; i < 4; i++) {
+            memcpy(branches[i][0], leaves[i ^ 1], 32);
+            memcpy(branches[i][1], level1[(i >> 1) ^ 1], 32);
+            proofs[i].leaf = leaves[i];
+            proofs[i].index = i;
+            proofs[i].depth = 2;
+            proofs[i].branch = branches[i][0];
+            proofs[i].root = root;
+        }
+        uint8_t valid[4];
+        std::cout << "8 way merkle proofs, block 100000" << std::endl;
+        // 6657a9252aacd5c0b2940996ecff952228c3067cc38d4885efb5a4ac4247e9f3
+        dump_buffer(root, 32);
+        // 4 valid
+        std::cout << verify_proofs<instrinsic_avx2>(proofs, 4, valid) << " valid" << std::endl;
+
+        merkle_tree<instrinsic_avx2> tree;
+        for (int i = 0; i < 4; i++)
+            tree.push_back(leaves[i]);
+        tree.update(2, leaves[0]);
+        tree.update(2, leaves[2]);
+        std::cout << "incremental merkle tree" << std::endl;
+        // 6657a9252aacd5c0b2940996ecff952228c3067cc38d4885efb5a4ac4247e9f3
+        dump_buffer(tree.root(), 32);
+    }
+
+    {
+        const char *genesis =
+            "0100000000000000000000000000000000000000000000000000000000000000000000003ba3edfd7a7b12b27ac72c3e67768f61"
+            "7fc81bc3888a51323a9fb8aa4b1e5e4a29ab5f49ffff001d1dac2b7c01010000000100000000000000000000000000000000000000"
+            "00000000000000000000000000ffffffff4d04ffff001d0104455468652054696d65732030332f4a616e2f32303039204368616e63"
+            "656c6c6f72206f6e206272696e6b206f66207365636f6e64206261696c6f757420666f722062616e6b73ffffffff0100f2052a0100"
+            "0000434104678afdb0fe5548271967f1a67130b7105cd6a828e03909a67962e0ea1f61deb649f6bc3f4cef38c4f35504e51ec112de"
+            "5c384df7ba0b8d578a4c702b6bf11d5fac00000000";
+        std::vector<uint8_t> raw(strlen(genesis) / 2);
+        hex_decode(raw.data(), genesis, raw.size());
+        block_view block;
+        uint8_t txid[32], wtxid[32];
+        if (block.parse(raw.data(), raw.size()) && block.tx_count() == 1) {
+            block.hash_transactions<instrinsic_avx2>(txid, wtxid);
+            std::cout << "genesis block txid" << std::endl;
+            // 3ba3edfd7a7b12b27ac72c3e67768f617fc81bc3888a51323a9fb8aa4b1e5e4a
+            dump_buffer(txid, 32);
+
+            uint8_t hash[32];
+            uint32_t bitmap;
+            size_t valid = header_pow<instrinsic_avx512>::verify(block.header(), 1, hash, &bitmap);
+            std::cout << "genesis header proof of work" << std::endl;
+            // 6fe28c0ab6f1b372c1a6a246ae63f74f931e8365e15a089c68d6190000000000
+            dump_buffer(hash, 32);
+            // 1 valid
+            std::cout << valid << " valid" << std::endl;
+        }
+    }
+
+    {
+        // nBits edge cases on the genesis header, the nonces make the hash
+        // alone meet or miss the target where a case depends on it
+        struct { uint32_t bits, nonce; } cases[] = {
+            { 0x1d00ffff, 0x7c2bac1d },     // genesis, pass
+            { 0x1d80ffff, 0 },              // negative
+            { 0x04923456, 0 },              // negative
+            { 0x23000001, 0 },              // overflow, exponent 35
+            { 0x22000100, 0 },              // overflow, 2^256
+            { 0x21010000, 0 },              // overflow, 2^256
+            { 0x02008000, 0 },              // exponent < 3, target 0x80
+            { 0x01003456, 0 },              // exponent < 3, target 0
+            { 0x00000000, 0 },              // zero
+            { 0x2100ffff, 0 },              // pass
+            { 0x22000001, 0xd0 },           // 2^248, hash below, pass
+            { 0x22000001, 0 },              // 2^248, hash above
+            { 0x207fffff, 0 },              // pass
+        };
+        enum { count = sizeof(cases) / sizeof(cases[0]) };
+        const uint32_t expected = 0x1601;
+        uint8_t headers[count * 80], hashes[count * 32];
+        hex_decode(headers, "0100000000000000000000000000000000000000000000000000000000000000000000003ba3edfd7a7b12b2"
+            "7ac72c3e67768f617fc81bc3888a51323a9fb8aa4b1e5e4a29ab5f49ffff001d1dac2b7c", 80);
+        for (int i = 0; i < count; i++) {
+            memcpy(headers + i * 80, headers, 72);
+            write_le32(headers, i * 80 + 72, cases[i].bits);
+            write_le32(headers, i * 80 + 76, cases[i].nonce);
+        }
+        uint32_t bitmap;
+        header_pow<instrinsic_one>::verify(headers, count, hashes, &bitmap);
+        check("1 way nBits edge cases", bitmap == expected);
+        header_pow<instrinsic_sse4>::verify(headers, count, hashes, &bitmap);
+        check("4 way nBits edge cases", bitmap == expected);
+        header_pow<instrinsic_avx512>::verify(headers, count, hashes, &bitmap);
+        check("16 way nBits edge cases", bitmap == expected);
+
+        struct { uint32_t bits; const char *target; } targets[] = {
+            { 0x01123456, "1200000000000000000000000000000000000000000000000000000000000000" },
+            { 0x02123456, "3412000000000000000000000000000000000000000000000000000000000000" },
+            { 0x02008000, "8000000000000000000000000000000000000000000000000000000000000000" },
+            { 0x03123456, "5634120000000000000000000000000000000000000000000000000000000000" },
+            { 0x04123456, "0056341200000000000000000000000000000000000000000000000000000000" },
+            { 0x1d00ffff, "0000000000000000000000000000000000000000000000000000ffff00000000" },
+            { 0x2100ffff, "000000000000000000000000000000000000000000000000000000000000ffff" },
+            { 0x22000001, "0000000000000000000000000000000000000000000000000000000000000001" },
+        };
+        for (size_t i = 0; i < sizeof(targets) / sizeof(targets[0]); i++) {
+            uint32_t limbs[9];
+            uint8_t target[32];
+            char name[32];
+            header_pow<instrinsic_one>::decode_target(limbs, targets[i].bits);
+            for (int k = 0; k < 8; k++)
+                write_le32(target, k * 4, limbs[k]);
+            snprintf(name, sizeof(name), "nBits %08x target", targets[i].bits);
+            check_hex(name, target, 32, targets[i].target);
+        }
+    }
+
+    {
+        uint8_t payload[21];
+        hex_decode(payload, "0062e907b15cbf27d5425399ebf6f0fb50ebb88f18", 21);
+        const uint8_t *payloads[] = { payload };
+        size_t sizes[] = { 21 };
+        char address[base58_check<instrinsic_avx2>::max_encoded];
+        char *addresses[] = { address };
+        base58_check<instrinsic_avx2>::encode(addresses, payloads, sizes, 1);
+        std::cout << "base58check address" << std::endl;
+        // 1A1zP1eP5QGefi2DMPTfTL5SLmv7DivfNa
+        std::cout << address << std::endl;
+
+        uint8_t decoded[base58_check<instrinsic_avx2>::max_payload];
+        uint8_t *outs[] = { decoded };
+        const char *strings[] = { address };
+        uint8_t valid;
+        // 1 valid
+        std::cout << base58_check<instrinsic_avx2>::decode(outs, sizes, strings, 1, &valid) << " valid" << std::endl;
+    }
+
+    {
+        hash_service<ripemd160<instrinsic_avx512> > service;
+        std::future<std::vector<uint8_t> > digest = service.submit("abc", 3);
+        std::cout << "ripemd160 service" << std::endl;
+        // 8eb208f7e05d987a9b044a8e98c6b087f15a0bfc
+        dump_buffer(digest.get().data(), 20);
+    }
+
     // ba5ed015715da74cf1e87230ba73d4855edaf6f6
     // ba5ed015715da74cf1e87230ba73d4855edaf6f6
     ripemd160<instrinsic_one>::process_trunk(&result_hash[0][0], trunk[0]);
@@ -117,7 +860,85 @@ int main(int argc, char const *argv[]) {
     for (size_t i = 0; i < 16; i++)
         dump_buffer(&result_hash[4][i * 20], 20);
 
-    return 0;
+    const uint8_t prefix[] = { 0xba, 0x5e };
+    uint32_t lanes[16];
+    size_t matched = process_trunk_if<ripemd160<instrinsic_avx512> >(
+        &result_hash[4][0], lanes, trunk[4], 1,
+        prefix_filter<ripemd160<instrinsic_avx512> >(prefix, 16));
+    std::cout << "16 way ripemd160 with prefix ba5e" << std::endl;
+    for (size_t i = 0; i < matched; i++) {
+        std::cout << lanes[i] << " ";
+        dump_buffer(&result_hash[4][i * 20], 20);
+    }
+
+    uint8_t watched[20] = {
+        0x79, 0x2c, 0x23, 0xea, 0x28, 0x43, 0x63, 0x92, 0x71, 0x33,
+        0xcd, 0x00, 0x9c, 0xf2, 0xc0, 0x89, 0x37, 0x26, 0x5d, 0x11,
+    };
+    digest_index<ripemd160<instrinsic_avx512> > index(1);
+    index.insert(watched);
+    index.sort();
+    matched = index.process_trunk(&result_hash[4][0], lanes, trunk[4]);
+    std::cout << "16 way ripemd160 against watched set" << std::endl;
+    for (size_t i = 0; i < matched; i++) {
+        std::cout << lanes[i] << " ";
+        dump_buffer(&result_hash[4][i * 20], 20);
+    }
+
+    fill_sha256_trunk(trunk[0], 1);
+    sha256<instrinsic_one>::process_trunk(&result_hash[0][0], trunk[0]);
+    std::cout << "1 way sha256" << std::endl;
+    dump_buffer(&result_hash[0][0], 32);
+    sha256_rorx::process_trunk(&result_hash[0][32], trunk[0]);
+    std::cout << "1 way sha256 rorx" << std::endl;
+    dump_buffer(&result_hash[0][32], 32);
+
+    check_drbg<instrinsic_one>("1 way");
+    check_drbg<instrinsic_two>("2 way");
+    check_drbg<instrinsic_sse4>("4 way");
+    check_drbg<instrinsic_avx2>("8 way");
+    check_drbg<instrinsic_avx512>("16 way");
+
+    check_sphincs<instrinsic_one>("1 way");
+    check_sphincs<instrinsic_two>("2 way");
+    check_sphincs<instrinsic_sse4>("4 way");
+    check_sphincs<instrinsic_avx2>("8 way");
+    check_sphincs<instrinsic_avx512>("16 way");
+
+    check_cdc<instrinsic_one>("1 way");
+    check_cdc<instrinsic_two>("2 way");
+    check_cdc<instrinsic_sse4>("4 way");
+    check_cdc<instrinsic_avx2>("8 way");
+    check_cdc<instrinsic_avx512>("16 way");
+
+    check_pipeline<instrinsic_one>("1 way");
+    check_pipeline<instrinsic_two>("2 way");
+    check_pipeline<instrinsic_sse4>("4 way");
+    check_pipeline<instrinsic_avx2>("8 way");
+    check_pipeline<instrinsic_avx512>("16 way");
+
+    check_mmr<instrinsic_one>("1 way");
+    check_mmr<instrinsic_sse4>("4 way");
+    check_mmr<instrinsic_avx512>("16 way");
+
+    check_batch<sha256<instrinsic_one>, sha256<instrinsic_one> >("1 way sha256");
+    check_batch<sha256<instrinsic_avx512>, sha256<instrinsic_one> >("16 way sha256");
+    check_batch<sha256_shani, sha256<instrinsic_one> >("sha-ni sha256");
+    check_batch<sha256_rorx, sha256<instrinsic_one> >("rorx sha256");
+    check_batch<ripemd160<instrinsic_one>, ripemd160<instrinsic_one> >("1 way ripemd160");
+    check_batch<ripemd160<instrinsic_sse4>, ripemd160<instrinsic_one> >("4 way ripemd160");
+    check_buffer_pool();
+    check_digest_cache();
+
+    check_shm<instrinsic_sse4>("4 way");
+    check_shm<instrinsic_avx512>("16 way");
+
+    check_vec<1>();
+    check_vec<2>();
+    check_vec<8>();
+    check_vec<32>();
+
+    return failures ? 1 : 0;
 
     for (size_t i = 0; i < 5; i++) {
         fill_sha256_trunk(trunk[i], std::pow(2, i));
@@ -0,0 +1,178 @@
+/**
+ * @file merkle.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-30
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "compact.h"
+#include "sha256.h"
+
+namespace fingera {
+
+// bitcoin style merkle proofs: node = sha256d(left || right), hashes in
+// internal byte order. the running node of every proof stays in the state
+// vectors of sha256<Instrinsic>, one proof per lane
+template<typename Instrinsic>
+class merkle_branch {
+public:
+    using instrinsic = Instrinsic;
+    using type = typename Instrinsic::type;
+    using hash = sha256<Instrinsic>;
+
+    static inline size_t way() {
+        return hash::way();
+    }
+
+    // sha256d of the 64 byte messages in w[16], digest words in out[8]
+    static inline void sha256d_64(type *out, const type *w) {
+        type pad[16];
+        pad[0] = Instrinsic::vector_mirror(0x80000000ul);
+        for (int i = 1; i < 15; i++) {
+            pad[i] = Instrinsic::vector_mirror(0);
+        }
+        pad[15] = Instrinsic::vector_mirror(512);
+
+        type s[8];
+        hash::init(s);
+        hash::process_words(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], w);
+        hash::process_words(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], pad);
+
+        // second pass: the 32 byte digest padded into one block
+        for (int i = 0; i < 8; i++) {
+            pad[i] = s[i];
+        }
+        pad[8] = Instrinsic::vector_mirror(0x80000000ul);
+        pad[15] = Instrinsic::vector_mirror(256);
+        hash::init(out);
+        hash::process_words(out[0], out[1], out[2], out[3], out[4], out[5], out[6], out[7], pad);
+    }
+
+    // way() parent nodes, lane i hashes left + stride * i || right + stride * i
+    static void hash_nodes(void *out, const void *left, const void *right, size_t stride = 32) {
+        type w[16], s[8];
+        for (int i = 0; i < 8; i++) {
+            w[i] = Instrinsic::load(left, i * 4, stride);
+            w[i + 8] = Instrinsic::load(right, i * 4, stride);
+        }
+        sha256d_64(s, w);
+        for (int i = 0; i < 8; i++) {
+            Instrinsic::save(out, i * 4, s[i], 32);
+        }
+    }
+
+    // way() proofs, lane i:
+    //   leaves + 32 * i: the leaf hash
+    //   indexes[i]: position of the leaf, bit l says the node is the right child at level l
+    //   depths[i] <= 32: number of levels, the node stops changing after it
+    //   branches + 32 * (l * way() + i): sibling at level l, for l < max depth
+    //   roots + 32 * i: expected root
+    // returns bit i set when proof i reaches its root
+    static uint32_t verify(const void *leaves, const uint32_t *indexes, const int *depths,
+            const void *branches, const void *roots) {
+        type node[8];
+        for (int i = 0; i < 8; i++) {
+            node[i] = Instrinsic::load(leaves, i * 4, 32);
+        }
+
+        // active: one bit per remaining level
+        int max_depth = 0;
+        uint32_t active_bits[sizeof(type) / sizeof(uint32_t)];
+        for (size_t i = 0; i < way(); i++) {
+            active_bits[i] = depths[i] >= 32 ? 0xFFFFFFFFul : (1ul << depths[i]) - 1;
+            max_depth = depths[i] > max_depth ? depths[i] : max_depth;
+        }
+        type active = Instrinsic::load_le(active_bits, 0, 4);
+        type index = Instrinsic::load_le(indexes, 0, 4);
+
+        const char *level = (const char *)branches;
+        for (int l = 0; l < max_depth; l++) {
+            type right = Instrinsic::template vector_bit_mask<0>(index);
+            type live = Instrinsic::template vector_bit_mask<0>(active);
+
+            // right child: sibling || node, left child: node || sibling
+            type w[16], next[8];
+            for (int i = 0; i < 8; i++) {
+                type sibling = Instrinsic::load(level, i * 4, 32);
+                w[i] = Instrinsic::vector_select(right, sibling, node[i]);
+                w[i + 8] = Instrinsic::vector_select(right, node[i], sibling);
+            }
+            sha256d_64(next, w);
+            for (int i = 0; i < 8; i++) {
+                node[i] = Instrinsic::vector_select(live, next[i], node[i]);
+            }
+
+            index = Instrinsic::template vector_shr<1>(index);
+            active = Instrinsic::template vector_shr<1>(active);
+            level += 32 * way();
+        }
+
+        uint32_t lanes = (uint32_t)((1ull << way()) - 1);
+        for (int i = 0; i < 8; i++) {
+            lanes &= Instrinsic::vector_mask_eq(node[i], Instrinsic::load(roots, i * 4, 32));
+        }
+        return lanes;
+    }
+};
+
+// one proof, branch: depth siblings from the leaf up
+struct merkle_proof {
+    const uint8_t *leaf;
+    uint32_t index;
+    int depth;
+    const uint8_t *branch;
+    const uint8_t *root;
+};
+
+// any number of proofs, valid[i] = 1 when proof i reaches its root
+// returns the number of valid proofs
+template<typename Instrinsic>
+size_t verify_proofs(const merkle_proof *proofs, size_t count, uint8_t *valid) {
+    using branch = merkle_branch<Instrinsic>;
+    const size_t way = branch::way();
+
+    // the lanes are loaded with a fixed stride, proofs are staged level major
+    data_trunk leaves(32 * way), roots(32 * way), siblings;
+    uint32_t indexes[sizeof(typename branch::type) / sizeof(uint32_t)];
+    int depths[sizeof(typename branch::type) / sizeof(uint32_t)];
+    size_t total = 0;
+
+    for (size_t begin = 0; begin < count; begin += way) {
+        size_t n = count - begin < way ? count - begin : way;
+        int max_depth = 0;
+        for (size_t i = 0; i < way; i++) {
+            depths[i] = i < n ? proofs[begin + i].depth : 0;
+            max_depth = depths[i] > max_depth ? depths[i] : max_depth;
+        }
+        if (siblings.size() < 32 * way * max_depth) {
+            siblings.resize(32 * way * max_depth);
+        }
+
+        memset(leaves.data(), 0, leaves.size());
+        memset(roots.data(), 0, roots.size());
+        for (size_t i = 0; i < n; i++) {
+            const merkle_proof &p = proofs[begin + i];
+            memcpy(&leaves[32 * i], p.leaf, 32);
+            memcpy(&roots[32 * i], p.root, 32);
+            indexes[i] = p.index;
+            for (int l = 0; l < p.depth; l++) {
+                memcpy(&siblings[32 * (l * way + i)], p.branch + 32 * l, 32);
+            }
+        }
+        for (size_t i = n; i < way; i++) {
+            indexes[i] = 0;
+        }
+
+        uint32_t lanes = branch::verify(leaves.data(), indexes, depths, siblings.data(), roots.data());
+        for (size_t i = 0; i < n; i++) {
+            valid[begin + i] = (lanes >> i) & 1;
+            total += valid[begin + i];
+        }
+    }
+    return total;
+}
+
+} // namespace fingera
@@ -0,0 +1,352 @@
+/**
+ * @file merkle_mountain.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-04
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "compact.h"
+#include "merkle.h"
+#include "instrinsic_one.h"
+
+namespace fingera {
+
+// append only merkle mountain range in one memory mapped file
+//
+// node = sha256d(left || right) as merkle_branch, nodes in post order: the
+// node at position p is at byte 64 + 32 * p, after a 64 byte header that
+// holds the leaf count. appends are buffered, flush() writes the new leaves
+// and then the new parents level by level, way() of them per kernel call,
+// so a peak merge is not a call of its own. the header is written last,
+// nodes past its count are ignored when the file is opened again. the
+// root bags the peaks from the right: H(p0 || H(p1 || ... p(m-1)))
+template<typename Instrinsic>
+class merkle_mountain_range {
+public:
+    using branch = merkle_branch<Instrinsic>;
+
+    enum {
+        version = 1,
+        batch = 1 << 16,        // buffered leaves that trigger a flush
+    };
+
+    merkle_mountain_range() : fd_(-1), map_(nullptr), map_size_(0),
+            left_(32 * branch::way()), right_(32 * branch::way()), out_(32 * branch::way()) {}
+    ~merkle_mountain_range() {
+        close();
+    }
+    merkle_mountain_range(const merkle_mountain_range &) = delete;
+    merkle_mountain_range &operator=(const merkle_mountain_range &) = delete;
+
+    // position of node index at height, the leaves are height 0
+    static uint64_t position(int height, uint64_t index) {
+        // the last leaf under the node, then up height levels
+        uint64_t last = ((index + 1) << height) - 1;
+        return 2 * last - __builtin_popcountll(last) + height;
+    }
+    // nodes of a range of leaves leaves
+    static uint64_t node_count(uint64_t leaves) {
+        return 2 * leaves - __builtin_popcountll(leaves);
+    }
+
+    // created when missing or empty, false when path is not a range of this version
+    bool open(const std::string &path) {
+        close();
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        struct stat st;
+        if (fd_ < 0 || fstat(fd_, &st) != 0) {
+            close();
+            return false;
+        }
+        if (st.st_size == 0) {
+            if (!map(capacity(0))) {
+                close();
+                return false;
+            }
+            header *h = head();
+            h->magic = magic;
+            h->version = version;
+            h->node_size = 32;
+            h->leaves = 0;
+            return true;
+        }
+        if ((size_t)st.st_size < sizeof(header) || !map((size_t)st.st_size)) {
+            close();
+            return false;
+        }
+        const header *h = head();
+        if (h->magic != magic || h->version != version || h->node_size != 32 ||
+                sizeof(header) + 32 * node_count(h->leaves) > map_size_) {
+            close();
+            return false;
+        }
+        return true;
+    }
+    // false when the buffered appends could not be written, they are dropped
+    bool close() {
+        bool ok = flush();
+        if (map_) {
+            munmap(map_, map_size_);
+            map_ = nullptr;
+            map_size_ = 0;
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+        pending_.clear();
+        return ok;
+    }
+
+    bool is_open() const {
+        return map_ != nullptr;
+    }
+    // appended leaves, flushed or not
+    uint64_t leaves() const {
+        return map_ ? head()->leaves + pending_.size() / 32 : 0;
+    }
+    // flushed nodes
+    uint64_t size() const {
+        return map_ ? node_count(head()->leaves) : 0;
+    }
+    const uint8_t *node(uint64_t position) const {
+        return map_ + sizeof(header) + 32 * position;
+    }
+
+    // a 32 byte leaf hash, returns its leaf index
+    uint64_t append(const void *leaf) {
+        uint64_t index = leaves();
+        pending_.insert(pending_.end(), (const uint8_t *)leaf, (const uint8_t *)leaf + 32);
+        // a flush that failed is tried again a batch later
+        if (pending_.size() % (32 * batch) == 0) {
+            flush();
+        }
+        return index;
+    }
+
+    // hashes the buffered appends into the file, false when it can not grow,
+    // the appends are then kept for the next flush
+    // durable: the nodes reach the disk before the header that counts them,
+    // false when a sync fails
+    bool flush(bool durable = false) {
+        if (!map_ || pending_.empty()) {
+            return true;
+        }
+        uint64_t n = head()->leaves, k = pending_.size() / 32;
+        size_t need = sizeof(header) + 32 * node_count(n + k);
+        if (need > map_size_ && !map(capacity(need))) {
+            return false;
+        }
+        for (uint64_t i = 0; i < k; i++) {
+            memcpy(at(position(0, n + i)), &pending_[32 * i], 32);
+        }
+        for (int h = 1; (n >> h) != ((n + k) >> h); h++) {
+            hash_level(h, n >> h, (n + k) >> h);
+        }
+        if (durable && msync(map_, need, MS_SYNC) != 0) {
+            return false;
+        }
+        head()->leaves = n + k;
+        pending_.clear();
+        return !durable || msync(map_, sizeof(header), MS_SYNC) == 0;
+    }
+
+    // 32 zero bytes for an empty range, false when not open or not flushed
+    bool root(void *out) {
+        if (!map_ || !flush()) {
+            return false;
+        }
+        std::vector<uint64_t> tops = peaks(head()->leaves);
+        if (tops.empty()) {
+            memset(out, 0, 32);
+            return true;
+        }
+        uint8_t acc[32];
+        memcpy(acc, node(tops.back()), 32);
+        for (size_t i = tops.size() - 1; i-- > 0;) {
+            merkle_branch<instrinsic_one>::hash_nodes(acc, node(tops[i]), acc);
+        }
+        memcpy(out, acc, 32);
+        return true;
+    }
+
+    // inclusion proof of leaf: its siblings up to its peak from the bottom,
+    // then the other peaks from left to right, 32 bytes each
+    // false when not open, not flushed or leaf is not in the range
+    bool proof(uint64_t leaf, std::vector<uint8_t> &out) {
+        out.clear();
+        if (!map_ || !flush()) {
+            return false;
+        }
+        uint64_t leaves = head()->leaves;
+        if (leaf >= leaves) {
+            return false;
+        }
+        int height;
+        size_t own;
+        locate(leaves, leaf, height, own);
+        for (int l = 0; l < height; l++) {
+            const uint8_t *sibling = node(position(l, (leaf >> l) ^ 1));
+            out.insert(out.end(), sibling, sibling + 32);
+        }
+        std::vector<uint64_t> tops = peaks(leaves);
+        for (size_t i = 0; i < tops.size(); i++) {
+            if (i != own) {
+                out.insert(out.end(), node(tops[i]), node(tops[i]) + 32);
+            }
+        }
+        return true;
+    }
+
+    // true when proof puts hash at leaf of a range of leaves leaves with root
+    static bool verify(const void *root, uint64_t leaves, uint64_t leaf, const void *hash,
+            const void *proof, size_t nodes) {
+        if (leaf >= leaves) {
+            return false;
+        }
+        int height;
+        size_t own;
+        locate(leaves, leaf, height, own);
+        size_t count = peaks(leaves).size();
+        if (nodes != height + count - 1) {
+            return false;
+        }
+        const uint8_t *p = (const uint8_t *)proof;
+        uint8_t acc[32];
+        memcpy(acc, hash, 32);
+        for (int l = 0; l < height; l++, p += 32) {
+            if ((leaf >> l) & 1) {
+                merkle_branch<instrinsic_one>::hash_nodes(acc, p, acc);
+            } else {
+                merkle_branch<instrinsic_one>::hash_nodes(acc, acc, p);
+            }
+        }
+
+        // the peaks in order with ours in its place, bagged from the right
+        std::vector<uint8_t> tops(32 * count);
+        for (size_t i = 0, j = 0; i < count; i++) {
+            if (i == own) {
+                memcpy(&tops[32 * i], acc, 32);
+            } else {
+                memcpy(&tops[32 * i], p + 32 * j++, 32);
+            }
+        }
+        memcpy(acc, &tops[32 * (count - 1)], 32);
+        for (size_t i = count - 1; i-- > 0;) {
+            merkle_branch<instrinsic_one>::hash_nodes(acc, &tops[32 * i], acc);
+        }
+        return memcmp(acc, root, 32) == 0;
+    }
+
+private:
+    static const uint64_t magic = 0x000000726d6d6766ull; // "fgmmr" as written on little endian
+
+    struct header {
+        uint64_t magic;
+        uint32_t version;
+        uint32_t node_size;
+        uint64_t leaves;
+        uint8_t reserved[40];
+    };
+
+    header *head() const {
+        return (header *)map_;
+    }
+    uint8_t *at(uint64_t position) {
+        return map_ + sizeof(header) + 32 * position;
+    }
+
+    // positions of the peaks, left to right
+    static std::vector<uint64_t> peaks(uint64_t leaves) {
+        std::vector<uint64_t> tops;
+        uint64_t before = 0;
+        for (int h = 63; h >= 0; h--) {
+            if ((leaves >> h) & 1) {
+                tops.push_back(position(h, before >> h));
+                before += (uint64_t)1 << h;
+            }
+        }
+        return tops;
+    }
+    // height and index of the peak over leaf < leaves
+    static void locate(uint64_t leaves, uint64_t leaf, int &height, size_t &index) {
+        uint64_t before = 0;
+        index = 0;
+        for (height = 63; height > 0; height--) {
+            if ((leaves >> height) & 1) {
+                before += (uint64_t)1 << height;
+                if (leaf < before) {
+                    return;
+                }
+                index++;
+            }
+        }
+    }
+
+    // the file size for need bytes, doubled so growth stays amortized
+    size_t capacity(size_t need) const {
+        size_t size = map_size_ ? map_size_ : sizeof(header) + 32 * 1024;
+        while (size < need) {
+            size *= 2;
+        }
+        return size;
+    }
+    // the first size bytes of the file, grown to them. the old mapping is
+    // only dropped once the new one is in place, it stays on failure
+    bool map(size_t size) {
+        struct stat st;
+        if (fstat(fd_, &st) != 0 || ((size_t)st.st_size < size && ftruncate(fd_, size) != 0)) {
+            return false;
+        }
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (p == MAP_FAILED) {
+            return false;
+        }
+        if (map_) {
+            munmap(map_, map_size_);
+        }
+        map_ = (uint8_t *)p;
+        map_size_ = size;
+        return true;
+    }
+
+    // parents [first, last) at height, their children already written
+    void hash_level(int height, uint64_t first, uint64_t last) {
+        const size_t way = branch::way();
+        const uint64_t step = (uint64_t)1 << height;
+        for (uint64_t begin = first; begin < last; begin += way) {
+            size_t n = last - begin < way ? (size_t)(last - begin) : way;
+            if (n == 1) {
+                uint64_t p = position(height, begin);
+                merkle_branch<instrinsic_one>::hash_nodes(at(p), at(p - step), at(p - 1));
+                continue;
+            }
+
+            for (size_t i = 0; i < n; i++) {
+                uint64_t p = position(height, begin + i);
+                memcpy(&left_[32 * i], at(p - step), 32);
+                memcpy(&right_[32 * i], at(p - 1), 32);
+            }
+            branch::hash_nodes(out_.data(), left_.data(), right_.data());
+            for (size_t i = 0; i < n; i++) {
+                memcpy(at(position(height, begin + i)), &out_[32 * i], 32);
+            }
+        }
+    }
+
+    int fd_;
+    uint8_t *map_;
+    size_t map_size_;
+    std::vector<uint8_t> pending_;
+    data_trunk left_, right_, out_;
+};
+
+} // namespace fingera
@@ -0,0 +1,162 @@
+/**
+ * @file merkle_tree.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-30
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include "compact.h"
+#include "merkle.h"
+#include "instrinsic_one.h"
+
+namespace fingera {
+
+// bitcoin merkle tree that keeps every interior node
+//
+// level 0 holds the leaves, level k + 1 the parents of level k, each level
+// one contiguous cache line aligned array of 32 byte nodes. an odd last
+// node is paired with itself. changes only record the dirty leaves, root()
+// rehashes their ancestors level by level, way() dirty nodes per kernel call
+template<typename Instrinsic>
+class merkle_tree {
+public:
+    using branch = merkle_branch<Instrinsic>;
+
+    merkle_tree() : left_(32 * branch::way()), right_(32 * branch::way()), out_(32 * branch::way()) {
+        levels_.resize(1);
+    }
+
+    size_t size() const {
+        return levels_[0].size() / 32;
+    }
+    const uint8_t *leaf(size_t index) const {
+        return &levels_[0][32 * index];
+    }
+
+    void push_back(const void *leaf) {
+        insert(size(), leaf);
+    }
+    // index <= size(), the leaves from index on move up by one
+    void insert(size_t index, const void *leaf) {
+        data_trunk &leaves = levels_[0];
+        leaves.insert(leaves.begin() + 32 * index, (const uint8_t *)leaf, (const uint8_t *)leaf + 32);
+        mark(index, size());
+    }
+    void update(size_t index, const void *leaf) {
+        memcpy(&levels_[0][32 * index], leaf, 32);
+        mark(index, index + 1);
+    }
+    // the leaves after index move down by one
+    void remove(size_t index) {
+        data_trunk &leaves = levels_[0];
+        leaves.erase(leaves.begin() + 32 * index, leaves.begin() + 32 * (index + 1));
+        // the old last leaf is gone, the new one may pair with itself now
+        mark(index ? index - 1 : 0, size());
+    }
+    void clear() {
+        levels_.resize(1);
+        levels_[0].clear();
+        dirty_.clear();
+    }
+
+    // 32 zero bytes for an empty tree
+    const uint8_t *root() {
+        rehash();
+        if (size() == 0) {
+            static const uint8_t empty[32] = { 0 };
+            return empty;
+        }
+        return levels_.back().data();
+    }
+
+    // siblings of a leaf from the bottom up, as merkle_proof::branch
+    // out: 32 bytes per level, returns the depth
+    int proof(size_t index, void *out) {
+        rehash();
+        int depth = 0;
+        for (size_t k = 0; k + 1 < levels_.size(); k++, depth++) {
+            size_t count = levels_[k].size() / 32;
+            size_t sibling = (index ^ 1) < count ? index ^ 1 : index;
+            memcpy((uint8_t *)out + 32 * depth, &levels_[k][32 * sibling], 32);
+            index >>= 1;
+        }
+        return depth;
+    }
+
+    // brings every interior node up to date
+    void rehash() {
+        if (dirty_.empty()) {
+            return;
+        }
+        std::sort(dirty_.begin(), dirty_.end());
+        dirty_.erase(std::unique(dirty_.begin(), dirty_.end()), dirty_.end());
+
+        size_t k = 0;
+        for (; levels_[k].size() > 32; k++) {
+            size_t count = levels_[k].size() / 32;
+            if (levels_.size() == k + 1) {
+                levels_.resize(k + 2);
+            }
+            levels_[k + 1].resize(32 * ((count + 1) / 2));
+
+            // dirty parents, still sorted
+            size_t n = 0;
+            for (size_t i = 0; i < dirty_.size(); i++) {
+                uint32_t parent = dirty_[i] >> 1;
+                if (parent < (count + 1) / 2 && (n == 0 || dirty_[n - 1] != parent)) {
+                    dirty_[n++] = parent;
+                }
+            }
+            dirty_.resize(n);
+            hash_level(levels_[k], count, levels_[k + 1]);
+        }
+        levels_.resize(k + 1);
+        dirty_.clear();
+    }
+
+private:
+    // leaves [begin, end) changed, the path of the last leaf may pair differently
+    void mark(size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            dirty_.push_back((uint32_t)i);
+        }
+        if (size()) {
+            dirty_.push_back((uint32_t)(size() - 1));
+        }
+    }
+
+    // parents in dirty_ from the count nodes of children
+    void hash_level(const data_trunk &children, size_t count, data_trunk &parents) {
+        const size_t way = branch::way();
+        for (size_t begin = 0; begin < dirty_.size(); begin += way) {
+            size_t n = dirty_.size() - begin < way ? dirty_.size() - begin : way;
+            if (n == 1) {
+                size_t j = dirty_[begin];
+                size_t right = 2 * j + 1 < count ? 2 * j + 1 : 2 * j;
+                merkle_branch<instrinsic_one>::hash_nodes(&parents[32 * j], &children[64 * j], &children[32 * right]);
+                continue;
+            }
+
+            for (size_t i = 0; i < n; i++) {
+                size_t j = dirty_[begin + i];
+                size_t right = 2 * j + 1 < count ? 2 * j + 1 : 2 * j;
+                memcpy(&left_[32 * i], &children[64 * j], 32);
+                memcpy(&right_[32 * i], &children[32 * right], 32);
+            }
+            branch::hash_nodes(out_.data(), left_.data(), right_.data());
+            for (size_t i = 0; i < n; i++) {
+                memcpy(&parents[32 * dirty_[begin + i]], &out_[32 * i], 32);
+            }
+        }
+    }
+
+    std::vector<data_trunk> levels_;
+    std::vector<uint32_t> dirty_;
+    data_trunk left_, right_, out_;
+};
+
+} // namespace fingera
@@ -0,0 +1,127 @@
+/**
+ * @file pbkdf2_sha256.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-22
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "compact.h"
+#include "sha256.h"
+#include "hmac_sha256.h"
+
+namespace fingera {
+
+// runs up to way() independent PBKDF2-HMAC-SHA256 derivations, one per lane
+template<typename Instrinsic>
+class pbkdf2_sha256 : public hmac_sha256<Instrinsic> {
+public:
+    using type = typename Instrinsic::type;
+    using hash = sha256<Instrinsic>;
+    using hmac = hmac_sha256<Instrinsic>;
+    using key = typename hmac::key;
+
+protected:
+    static inline type vector_xor(type x, type y) {
+        return Instrinsic::vector_xor(x, y);
+    }
+
+    // U(i) = HMAC(P, U(i - 1)), T ^= U(i), state never leaves the lanes
+    static inline void iterate(
+            type *t, type *u,
+            const type *inner, const type *outer,
+            uint32_t iterations) {
+        type zero = Instrinsic::vector_mirror(0);
+        type pad = Instrinsic::vector_mirror(0x80000000ul);
+        type length = Instrinsic::vector_mirror((64 + 32) * 8);
+
+        for (uint32_t i = 1; i < iterations; i++) {
+            type w[16] = {
+                u[0], u[1], u[2], u[3], u[4], u[5], u[6], u[7],
+                pad, zero, zero, zero, zero, zero, zero, length
+            };
+            u[0] = inner[0]; u[1] = inner[1]; u[2] = inner[2]; u[3] = inner[3];
+            u[4] = inner[4]; u[5] = inner[5]; u[6] = inner[6]; u[7] = inner[7];
+            hash::process_words(u[0], u[1], u[2], u[3], u[4], u[5], u[6], u[7], w);
+
+            hmac::outer(u[0], u[1], u[2], u[3], u[4], u[5], u[6], u[7],
+                outer[0], outer[1], outer[2], outer[3],
+                outer[4], outer[5], outer[6], outer[7]);
+
+            t[0] = vector_xor(t[0], u[0]);
+            t[1] = vector_xor(t[1], u[1]);
+            t[2] = vector_xor(t[2], u[2]);
+            t[3] = vector_xor(t[3], u[3]);
+            t[4] = vector_xor(t[4], u[4]);
+            t[5] = vector_xor(t[5], u[5]);
+            t[6] = vector_xor(t[6], u[6]);
+            t[7] = vector_xor(t[7], u[7]);
+        }
+    }
+
+    static inline void load_state(const uint8_t *in, type *s) {
+        hash::load_state(in, s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+    }
+
+public:
+    static inline size_t way() {
+        return hash::way();
+    }
+
+    // out: count derived keys of dk_size bytes
+    // false unless 0 < count <= way() and iterations > 0
+    static bool derive(
+            void *out, size_t dk_size,
+            const void *const *passwords, const size_t *password_sizes,
+            const void *const *salts, const size_t *salt_sizes,
+            uint32_t iterations, size_t count) {
+        if (count == 0 || count > way() || iterations == 0) {
+            return false;
+        }
+        const size_t lanes = sizeof(type) / sizeof(uint32_t);
+        std::vector<key> keys(lanes);
+        std::vector<uint8_t> message;
+        uint8_t inner[lanes * 32], outer[lanes * 32], block[lanes * 32];
+
+        for (size_t i = 0; i < lanes; i++) {
+            size_t src = i < count ? i : 0;
+            hmac::init_key(keys[i], passwords[src], password_sizes[src]);
+            memcpy(inner + i * 32, keys[i].inner, 32);
+            memcpy(outer + i * 32, keys[i].outer, 32);
+        }
+
+        type vinner[8], vouter[8];
+        load_state(inner, vinner);
+        load_state(outer, vouter);
+
+        for (uint32_t index = 1; (index - 1) * 32 < dk_size; index++) {
+            // U(1) = HMAC(P, S || INT(index)) depends on the salt size, done per lane
+            for (size_t i = 0; i < lanes; i++) {
+                size_t src = i < count ? i : 0;
+                message.resize(salt_sizes[src] + 4);
+                if (salt_sizes[src]) {
+                    memcpy(message.data(), salts[src], salt_sizes[src]);
+                }
+                write_be32(message.data(), salt_sizes[src], index);
+                hmac::sign(block + i * 32, keys[i], message.data(), message.size());
+            }
+
+            type t[8], u[8];
+            load_state(block, u);
+            memcpy(t, u, sizeof(t));
+            iterate(t, u, vinner, vouter, iterations);
+            hash::save_state(block, t[0], t[1], t[2], t[3], t[4], t[5], t[6], t[7]);
+
+            size_t offset = (index - 1) * 32;
+            size_t size = dk_size - offset < 32 ? dk_size - offset : 32;
+            for (size_t i = 0; i < count; i++) {
+                memcpy((uint8_t *)out + i * dk_size + offset, block + i * 32, size);
+            }
+        }
+        return true;
+    }
+};
+
+} // namespace fingera
@@ -15,6 +15,13 @@ template<typename Instrinsic>
 class ripemd160 {
 public:
     using type = typename Instrinsic::type;
+    using instrinsic = Instrinsic;
+
+    enum {
+        block_size = 64,
+        hash_size = 20,
+        state_size = 5,
+    };
 protected:
     static inline type vector_mirror(uint32_t x) {
         return Instrinsic::vector_mirror(x);
@@ -345,24 +352,107 @@ public:
 #undef __R52
     }
 
-    static void process_trunk(void *out, const void *blocks, int count = 1) {
-        type a = vector_mirror(0x67452301ul);
-        type b = vector_mirror(0xEFCDAB89ul);
-        type c = vector_mirror(0x98BADCFEul);
-        type d = vector_mirror(0x10325476ul);
-        type e = vector_mirror(0xC3D2E1F0ul);
+    static inline void init(type &a, type &b, type &c, type &d, type &e) {
+        a = vector_mirror(0x67452301ul);
+        b = vector_mirror(0xEFCDAB89ul);
+        c = vector_mirror(0x98BADCFEul);
+        d = vector_mirror(0x10325476ul);
+        e = vector_mirror(0xC3D2E1F0ul);
+    }
 
+    // state of every lane as a little endian digest, hash_size bytes apart
+    static inline void load_state(
+            const void *in,
+            type &a, type &b, type &c, type &d, type &e,
+            size_t hash_size = 20) {
+        a = Instrinsic::load_le(in,  0, hash_size);
+        b = Instrinsic::load_le(in,  4, hash_size);
+        c = Instrinsic::load_le(in,  8, hash_size);
+        d = Instrinsic::load_le(in, 12, hash_size);
+        e = Instrinsic::load_le(in, 16, hash_size);
+    }
+    static inline void save_state(
+            void *out,
+            type a, type b, type c, type d, type e,
+            size_t hash_size = 20) {
+        Instrinsic::save_le(out,  0, a, hash_size);
+        Instrinsic::save_le(out,  4, b, hash_size);
+        Instrinsic::save_le(out,  8, c, hash_size);
+        Instrinsic::save_le(out, 12, d, hash_size);
+        Instrinsic::save_le(out, 16, e, hash_size);
+    }
+
+    static inline void process_blocks(
+            type &a, type &b, type &c, type &d, type &e,
+            const void *blocks, int count) {
         char *cur_block = (char *)blocks;
         while (count--) {
             process_block(a, b, c, d, e, cur_block);
             cur_block += 64 * way();
         }
+    }
+
+    // same as above with the state in an array of state_size vectors
+    static inline void init(type *s) {
+        init(s[0], s[1], s[2], s[3], s[4]);
+    }
+    static inline void load_state(const void *in, type *s, size_t hash_size = 20) {
+        load_state(in, s[0], s[1], s[2], s[3], s[4], hash_size);
+    }
+    static inline void save_state(void *out, const type *s, size_t hash_size = 20) {
+        save_state(out, s[0], s[1], s[2], s[3], s[4], hash_size);
+    }
+    static inline void process_blocks(type *s, const void *blocks, int count) {
+        process_blocks(s[0], s[1], s[2], s[3], s[4], blocks, count);
+    }
+
+    // digest word index as it appears in the state
+    static inline uint32_t digest_word(const void *digest, int index) {
+        return read_le32(digest, index * 4);
+    }
+    // digest of a single lane
+    static inline void save_lane(void *out, const type *s, size_t lane) {
+        for (int i = 0; i < state_size; i++) {
+            write_le32(out, i * 4, Instrinsic::extract(s[i], lane));
+        }
+    }
+
+    static inline size_t block_count(size_t size) {
+        return (size + 8) / 64 + 1;
+    }
+    // the blocks after the full ones of a size byte message: its last
+    // size % 64 bytes from left, 0x80, zeros and the bit length
+    // tail: 128 bytes, returns the number of blocks, 1 or 2
+    static int pad_tail(void *tail, const void *left, uint64_t size) {
+        size_t n = size % 64;
+        int count = n + 9 > 64 ? 2 : 1;
+        memset(tail, 0, 128);
+        memcpy(tail, left, n);
+        ((uint8_t *)tail)[n] = 0x80;
+        write_le64(tail, count * 64 - 8, size * 8);
+        return count;
+    }
+    // pad one message into a lane of a trunk, returns the number of blocks
+    static int fill_lane(void *trunk, size_t lane, const void *data, size_t size) {
+        int full = (int)(size / 64);
+        uint8_t tail[128];
+        int count = full + pad_tail(tail, (const char *)data + full * 64, size);
+
+        for (int i = 0; i < full; i++) {
+            memcpy((char *)trunk + 64 * (i * way() + lane), (const char *)data + i * 64, 64);
+        }
+        for (int i = full; i < count; i++) {
+            memcpy((char *)trunk + 64 * (i * way() + lane), tail + (i - full) * 64, 64);
+        }
+        return count;
+    }
+
+    static void process_trunk(void *out, const void *blocks, int count = 1) {
+        type a, b, c, d, e;
 
-        Instrinsic::save_le(out,  0, a, 20);
-        Instrinsic::save_le(out,  4, b, 20);
-        Instrinsic::save_le(out,  8, c, 20);
-        Instrinsic::save_le(out, 12, d, 20);
-        Instrinsic::save_le(out, 16, e, 20);
+        init(a, b, c, d, e);
+        process_blocks(a, b, c, d, e, blocks, count);
+        save_state(out, a, b, c, d, e);
     }
 };
 
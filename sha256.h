@@ -15,6 +15,13 @@ template<typename Instrinsic>
 class sha256 {
 public:
     using type = typename Instrinsic::type;
+    using instrinsic = Instrinsic;
+
+    enum {
+        block_size = 64,
+        hash_size = 32,
+        state_size = 8,
+    };
 protected:
 
     static inline type vector_mirror(uint32_t x) {
@@ -122,12 +129,85 @@ public:
         return sizeof(type) / sizeof(uint32_t);
     }
 
+    static inline void init(
+            type &a, type &b, type &c, type &d,
+            type &e, type &f, type &g, type &h) {
+        a = vector_mirror(0x6a09e667ul);
+        b = vector_mirror(0xbb67ae85ul);
+        c = vector_mirror(0x3c6ef372ul);
+        d = vector_mirror(0xa54ff53aul);
+        e = vector_mirror(0x510e527ful);
+        f = vector_mirror(0x9b05688cul);
+        g = vector_mirror(0x1f83d9abul);
+        h = vector_mirror(0x5be0cd19ul);
+    }
+
+    // state of every lane as a big endian digest, hash_size bytes apart
+    static inline void load_state(
+            const void *in,
+            type &a, type &b, type &c, type &d,
+            type &e, type &f, type &g, type &h,
+            size_t hash_size = 32) {
+        a = Instrinsic::load(in,  0, hash_size);
+        b = Instrinsic::load(in,  4, hash_size);
+        c = Instrinsic::load(in,  8, hash_size);
+        d = Instrinsic::load(in, 12, hash_size);
+        e = Instrinsic::load(in, 16, hash_size);
+        f = Instrinsic::load(in, 20, hash_size);
+        g = Instrinsic::load(in, 24, hash_size);
+        h = Instrinsic::load(in, 28, hash_size);
+    }
+    static inline void save_state(
+            void *out,
+            type a, type b, type c, type d,
+            type e, type f, type g, type h,
+            size_t hash_size = 32) {
+        Instrinsic::save(out,  0, a, hash_size);
+        Instrinsic::save(out,  4, b, hash_size);
+        Instrinsic::save(out,  8, c, hash_size);
+        Instrinsic::save(out, 12, d, hash_size);
+        Instrinsic::save(out, 16, e, hash_size);
+        Instrinsic::save(out, 20, f, hash_size);
+        Instrinsic::save(out, 24, g, hash_size);
+        Instrinsic::save(out, 28, h, hash_size);
+    }
+
     static inline void process_block(
             type &a, type &b, type &c, type &d, 
             type &e, type &f, type &g, type &h,
             const void *block) {
+        type w[16];
+
+        w[0] = Instrinsic::load(block, 0);
+        w[1] = Instrinsic::load(block, 4);
+        w[2] = Instrinsic::load(block, 8);
+        w[3] = Instrinsic::load(block, 12);
+        w[4] = Instrinsic::load(block, 16);
+        w[5] = Instrinsic::load(block, 20);
+        w[6] = Instrinsic::load(block, 24);
+        w[7] = Instrinsic::load(block, 28);
+        w[8] = Instrinsic::load(block, 32);
+        w[9] = Instrinsic::load(block, 36);
+        w[10] = Instrinsic::load(block, 40);
+        w[11] = Instrinsic::load(block, 44);
+        w[12] = Instrinsic::load(block, 48);
+        w[13] = Instrinsic::load(block, 52);
+        w[14] = Instrinsic::load(block, 56);
+        w[15] = Instrinsic::load(block, 60);
+
+        process_words(a, b, c, d, e, f, g, h, w);
+    }
 
-        type w0, w1, w2, w3, w4, w5, w6, w7, w8, w9, w10, w11, w12, w13, w14, w15;
+    // w: the 16 message words of one block, already in lanes
+    static inline void process_words(
+            type &a, type &b, type &c, type &d,
+            type &e, type &f, type &g, type &h,
+            const type *w) {
+
+        type w0 = w[0], w1 = w[1], w2 = w[2], w3 = w[3];
+        type w4 = w[4], w5 = w[5], w6 = w[6], w7 = w[7];
+        type w8 = w[8], w9 = w[9], w10 = w[10], w11 = w[11];
+        type w12 = w[12], w13 = w[13], w14 = w[14], w15 = w[15];
 
         type oa = a;
         type ob = b;
@@ -138,25 +218,25 @@ public:
         type og = g;
         type oh = h;
 
-        round(a, b, c, d, e, f, g, h, vector_add(vector_mirror(0x428a2f98ul), w0 = Instrinsic::load(block, 0)));
-        round(h, a, b, c, d, e, f, g, vector_add(vector_mirror(0x71374491ul), w1 = Instrinsic::load(block, 4)));
-        round(g, h, a, b, c, d, e, f, vector_add(vector_mirror(0xb5c0fbcful), w2 = Instrinsic::load(block, 8)));
-        round(f, g, h, a, b, c, d, e, vector_add(vector_mirror(0xe9b5dba5ul), w3 = Instrinsic::load(block, 12)));
+        round(a, b, c, d, e, f, g, h, vector_add(vector_mirror(0x428a2f98ul), w0));
+        round(h, a, b, c, d, e, f, g, vector_add(vector_mirror(0x71374491ul), w1));
+        round(g, h, a, b, c, d, e, f, vector_add(vector_mirror(0xb5c0fbcful), w2));
+        round(f, g, h, a, b, c, d, e, vector_add(vector_mirror(0xe9b5dba5ul), w3));
 
-        round(e, f, g, h, a, b, c, d, vector_add(vector_mirror(0x3956c25bul), w4 = Instrinsic::load(block, 16)));
-        round(d, e, f, g, h, a, b, c, vector_add(vector_mirror(0x59f111f1ul), w5 = Instrinsic::load(block, 20)));
-        round(c, d, e, f, g, h, a, b, vector_add(vector_mirror(0x923f82a4ul), w6 = Instrinsic::load(block, 24)));
-        round(b, c, d, e, f, g, h, a, vector_add(vector_mirror(0xab1c5ed5ul), w7 = Instrinsic::load(block, 28)));
+        round(e, f, g, h, a, b, c, d, vector_add(vector_mirror(0x3956c25bul), w4));
+        round(d, e, f, g, h, a, b, c, vector_add(vector_mirror(0x59f111f1ul), w5));
+        round(c, d, e, f, g, h, a, b, vector_add(vector_mirror(0x923f82a4ul), w6));
+        round(b, c, d, e, f, g, h, a, vector_add(vector_mirror(0xab1c5ed5ul), w7));
 
-        round(a, b, c, d, e, f, g, h, vector_add(vector_mirror(0xd807aa98ul), w8 = Instrinsic::load(block, 32)));
-        round(h, a, b, c, d, e, f, g, vector_add(vector_mirror(0x12835b01ul), w9 = Instrinsic::load(block, 36)));
-        round(g, h, a, b, c, d, e, f, vector_add(vector_mirror(0x243185beul), w10 = Instrinsic::load(block, 40)));
-        round(f, g, h, a, b, c, d, e, vector_add(vector_mirror(0x550c7dc3ul), w11 = Instrinsic::load(block, 44)));
+        round(a, b, c, d, e, f, g, h, vector_add(vector_mirror(0xd807aa98ul), w8));
+        round(h, a, b, c, d, e, f, g, vector_add(vector_mirror(0x12835b01ul), w9));
+        round(g, h, a, b, c, d, e, f, vector_add(vector_mirror(0x243185beul), w10));
+        round(f, g, h, a, b, c, d, e, vector_add(vector_mirror(0x550c7dc3ul), w11));
 
-        round(e, f, g, h, a, b, c, d, vector_add(vector_mirror(0x72be5d74ul), w12 = Instrinsic::load(block, 48)));
-        round(d, e, f, g, h, a, b, c, vector_add(vector_mirror(0x80deb1feul), w13 = Instrinsic::load(block, 52)));
-        round(c, d, e, f, g, h, a, b, vector_add(vector_mirror(0x9bdc06a7ul), w14 = Instrinsic::load(block, 56)));
-        round(b, c, d, e, f, g, h, a, vector_add(vector_mirror(0xc19bf174ul), w15 = Instrinsic::load(block, 60)));
+        round(e, f, g, h, a, b, c, d, vector_add(vector_mirror(0x72be5d74ul), w12));
+        round(d, e, f, g, h, a, b, c, vector_add(vector_mirror(0x80deb1feul), w13));
+        round(c, d, e, f, g, h, a, b, vector_add(vector_mirror(0x9bdc06a7ul), w14));
+        round(b, c, d, e, f, g, h, a, vector_add(vector_mirror(0xc19bf174ul), w15));
 
         round(a, b, c, d, e, f, g, h, vector_add(vector_mirror(0xe49b69c1ul), vector_inc(w0, sigma1(w14), w9, sigma0(w1))));
         round(h, a, b, c, d, e, f, g, vector_add(vector_mirror(0xefbe4786ul), vector_inc(w1, sigma1(w15), w10, sigma0(w2))));
@@ -228,30 +308,79 @@ public:
         h = vector_add(h, oh);
     }
 
-    static void process_trunk(void *out, const void *blocks, int count = 1) {
-        type a = vector_mirror(0x6a09e667ul);
-        type b = vector_mirror(0xbb67ae85ul);
-        type c = vector_mirror(0x3c6ef372ul);
-        type d = vector_mirror(0xa54ff53aul);
-        type e = vector_mirror(0x510e527ful);
-        type f = vector_mirror(0x9b05688cul);
-        type g = vector_mirror(0x1f83d9abul);
-        type h = vector_mirror(0x5be0cd19ul);
-
+    static inline void process_blocks(
+            type &a, type &b, type &c, type &d,
+            type &e, type &f, type &g, type &h,
+            const void *blocks, int count) {
         char *cur_block = (char *)blocks;
         while (count--) {
             process_block(a, b, c, d, e, f, g, h, cur_block);
             cur_block += 64 * way();
         }
+    }
+
+    // same as above with the state in an array of state_size vectors
+    static inline void init(type *s) {
+        init(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7]);
+    }
+    static inline void load_state(const void *in, type *s, size_t hash_size = 32) {
+        load_state(in, s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], hash_size);
+    }
+    static inline void save_state(void *out, const type *s, size_t hash_size = 32) {
+        save_state(out, s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], hash_size);
+    }
+    static inline void process_blocks(type *s, const void *blocks, int count) {
+        process_blocks(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], blocks, count);
+    }
+
+    // digest word index as it appears in the state
+    static inline uint32_t digest_word(const void *digest, int index) {
+        return read_be32(digest, index * 4);
+    }
+    // digest of a single lane
+    static inline void save_lane(void *out, const type *s, size_t lane) {
+        for (int i = 0; i < state_size; i++) {
+            write_be32(out, i * 4, Instrinsic::extract(s[i], lane));
+        }
+    }
+
+    static inline size_t block_count(size_t size) {
+        return (size + 8) / 64 + 1;
+    }
+    // the blocks after the full ones of a size byte message: its last
+    // size % 64 bytes from left, 0x80, zeros and the bit length
+    // tail: 128 bytes, returns the number of blocks, 1 or 2
+    static int pad_tail(void *tail, const void *left, uint64_t size) {
+        size_t n = size % 64;
+        int count = n + 9 > 64 ? 2 : 1;
+        memset(tail, 0, 128);
+        memcpy(tail, left, n);
+        ((uint8_t *)tail)[n] = 0x80;
+        write_be64(tail, count * 64 - 8, size * 8);
+        return count;
+    }
+    // pad one message into a lane of a trunk, returns the number of blocks
+    // lanes: the way() of the kernel the trunk is for
+    static int fill_lane(void *trunk, size_t lane, const void *data, size_t size, size_t lanes = way()) {
+        int full = (int)(size / 64);
+        uint8_t tail[128];
+        int count = full + pad_tail(tail, (const char *)data + full * 64, size);
+
+        for (int i = 0; i < full; i++) {
+            memcpy((char *)trunk + 64 * (i * lanes + lane), (const char *)data + i * 64, 64);
+        }
+        for (int i = full; i < count; i++) {
+            memcpy((char *)trunk + 64 * (i * lanes + lane), tail + (i - full) * 64, 64);
+        }
+        return count;
+    }
+
+    static void process_trunk(void *out, const void *blocks, int count = 1) {
+        type a, b, c, d, e, f, g, h;
 
-        Instrinsic::save(out,  0, a);
-        Instrinsic::save(out,  4, b);
-        Instrinsic::save(out,  8, c);
-        Instrinsic::save(out, 12, d);
-        Instrinsic::save(out, 16, e);
-        Instrinsic::save(out, 20, f);
-        Instrinsic::save(out, 24, g);
-        Instrinsic::save(out, 28, h);
+        init(a, b, c, d, e, f, g, h);
+        process_blocks(a, b, c, d, e, f, g, h, blocks, count);
+        save_state(out, a, b, c, d, e, f, g, h);
     }
 };
 
@@ -0,0 +1,180 @@
+/**
+ * @file sha256_pipeline.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-01
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#include "compact.h"
+#include "sha256.h"
+
+namespace fingera {
+
+// sha256 of large batches of equal length messages, software pipelined
+//
+// a step is one block of way() messages. while step t compresses, the
+// words of step t + 1 are transposed into the other half of a double
+// buffer and the lines of step t + prefetch_distance are prefetched, so
+// trunk boundaries do not wait on memory. full blocks are read where the
+// messages are, only the padded tail goes through a staging block, and
+// digests leave with non temporal stores
+//
+// on one core it runs level with trunk_arena, the rounds bound both. what
+// it saves is the copy of every message into a trunk, and it reads records
+// at a stride inside a larger buffer, which trunk_arena can not
+template<typename Instrinsic>
+class sha256_pipeline {
+public:
+    using type = typename Instrinsic::type;
+    using hash = sha256<Instrinsic>;
+
+    enum { prefetch_distance = 4 };
+
+    static inline size_t way() {
+        return hash::way();
+    }
+
+    // count messages of size bytes, message i at data + stride * i (stride 0: size)
+    // digest i at out + 32 * i
+    static void process(void *out, const void *data, size_t size, size_t count, size_t stride = 0) {
+        enum { lanes = sizeof(type) / sizeof(uint32_t) };
+        if (count == 0) {
+            return;
+        }
+        pipeline p;
+        p.data = (const uint8_t *)data;
+        p.size = size;
+        p.count = count;
+        p.stride = stride ? stride : size;
+        p.blocks = (int)hash::block_count(size);
+        p.full = (int)(size / 64);
+
+        const size_t steps = (count + way() - 1) / way() * p.blocks;
+        alignas(64) uint8_t digests[lanes * 32];
+        type w[2][16];
+        type s[8];
+
+        for (size_t t = 0; t < prefetch_distance && t < steps; t++) {
+            p.prefetch(t);
+        }
+        p.transpose(0, w[0]);
+        for (size_t t = 0; t < steps; t++) {
+            size_t batch = t / p.blocks;
+            int block = (int)(t % p.blocks);
+            if (block == 0) {
+                hash::init(s);
+            }
+            if (t + prefetch_distance < steps) {
+                p.prefetch(t + prefetch_distance);
+            }
+            if (t + 1 < steps) {
+                p.transpose(t + 1, w[(t + 1) & 1]);
+            }
+            hash::process_words(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], w[t & 1]);
+
+            if (block == p.blocks - 1) {
+                size_t first = batch * way();
+                size_t n = count - first < way() ? count - first : way();
+                hash::save_state(digests, s);
+                stream_copy((uint8_t *)out + 32 * first, digests, 32 * n);
+            }
+        }
+        _mm_sfence();
+    }
+
+    // size bytes from src, 16 byte chunks with non temporal stores when dst is aligned
+    static inline void stream_copy(uint8_t *dst, const uint8_t *src, size_t size) {
+        if (((uintptr_t)dst & 15) != 0) {
+            memcpy(dst, src, size);
+            return;
+        }
+        size_t i = 0;
+        for (; i + 16 <= size; i += 16) {
+            _mm_stream_si128((__m128i *)(dst + i), _mm_load_si128((const __m128i *)(src + i)));
+        }
+        memcpy(dst + i, src + i, size - i);
+    }
+
+private:
+    struct pipeline {
+        enum { lanes = sizeof(type) / sizeof(uint32_t) };
+
+        const uint8_t *data;
+        size_t size;
+        size_t count;
+        size_t stride;
+        int blocks;
+        int full;
+        // padded tail blocks of the batch being transposed
+        alignas(64) uint8_t staging[lanes][128];
+
+        // first message of the batch of step t and how many lanes it fills
+        const uint8_t *batch(size_t t, size_t &n) const {
+            size_t first = t / blocks * way();
+            n = count - first < way() ? count - first : way();
+            return data + stride * first;
+        }
+
+        void prefetch(size_t t) const {
+            int block = (int)(t % blocks);
+            if (block >= full) {
+                return;
+            }
+            size_t n;
+            const uint8_t *p = batch(t, n) + 64 * block;
+            for (size_t l = 0; l < n; l++, p += stride) {
+                _mm_prefetch((const char *)p, _MM_HINT_NTA);
+                _mm_prefetch((const char *)p + 63, _MM_HINT_NTA);
+            }
+        }
+
+        // words of step t, lane l of w[i] is word i of lane l's block
+        void transpose(size_t t, type *w) {
+            static const uint8_t zero[64] = { 0 };
+            int block = (int)(t % blocks);
+            if (block == full && size % 64 == 0) {
+                // the same padding block for every lane
+                w[0] = Instrinsic::vector_mirror(0x80000000ul);
+                for (int i = 1; i < 14; i++) {
+                    w[i] = Instrinsic::vector_mirror(0);
+                }
+                w[14] = Instrinsic::vector_mirror((uint32_t)((uint64_t)size * 8 >> 32));
+                w[15] = Instrinsic::vector_mirror((uint32_t)(size * 8));
+                return;
+            }
+            size_t n;
+            const uint8_t *p = batch(t, n);
+            const void *ptrs[lanes];
+            for (size_t l = 0; l < way(); l++, p += stride) {
+                if (l >= n) {
+                    ptrs[l] = zero;
+                } else if (block < full) {
+                    ptrs[l] = p + 64 * block;
+                } else {
+                    if (block == full) {
+                        pad(staging[l], p);
+                    }
+                    ptrs[l] = staging[l] + 64 * (block - full);
+                }
+            }
+            for (int i = 0; i < 16; i++) {
+                w[i] = Instrinsic::load_lanes(ptrs, i * 4);
+            }
+        }
+
+        // the blocks after the full ones, tail, 0x80, zeros and the bit length
+        void pad(uint8_t *tail, const uint8_t *message) const {
+            size_t left = size % 64;
+            memset(tail, 0, 128);
+            memcpy(tail, message + 64 * full, left);
+            tail[left] = 0x80;
+            write_be64(tail, (blocks - full) * 64 - 8, (uint64_t)size * 8);
+        }
+    };
+};
+
+} // namespace fingera
@@ -0,0 +1,148 @@
+/**
+ * @file sha256_refill.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-03
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include "compact.h"
+#include "sha256.h"
+
+namespace fingera {
+
+// multi buffer sha256 of messages of any lengths, a lane is refilled as soon
+// as its message is done
+//
+// every lane keeps its own message and block counter, step() compresses one
+// block on all lanes. the state of a lane that takes a new message is reset
+// with a select, so long messages do not hold the short ones back the way a
+// batch of equal length messages would. the padded tail of a message is
+// built once when it is submitted, the full blocks are read in place
+template<typename Instrinsic>
+class sha256_refill {
+public:
+    using type = typename Instrinsic::type;
+    using hash = sha256<Instrinsic>;
+
+    static inline size_t way() {
+        return hash::way();
+    }
+
+    sha256_refill() : busy_(0), fresh_(0) {
+        for (size_t l = 0; l < lanes; l++) {
+            lane_[l].data = nullptr;
+        }
+        hash::init(s_);
+    }
+
+    size_t busy() const {
+        return busy_;
+    }
+    bool full() const {
+        return busy_ == way();
+    }
+    bool idle() const {
+        return busy_ == 0;
+    }
+
+    // data stays valid until the digest comes back, tag is given back with it
+    // only when !full()
+    void submit(const void *data, size_t size, uint64_t tag) {
+        size_t l = 0;
+        while (lane_[l].data) {
+            l++;
+        }
+        lane &x = lane_[l];
+        x.data = (const uint8_t *)data;
+        x.tag = tag;
+        x.full = (int)(size / 64);
+        x.blocks = (int)hash::block_count(size);
+        x.next = 0;
+
+        size_t left = size % 64;
+        memset(x.tail, 0, sizeof(x.tail));
+        memcpy(x.tail, x.data + 64 * x.full, left);
+        x.tail[left] = 0x80;
+        write_be64(x.tail, (x.blocks - x.full) * 64 - 8, (uint64_t)size * 8);
+
+        fresh_ |= 1u << l;
+        busy_++;
+    }
+
+    // one block on every lane, done(tag, digest) for the messages that finish
+    template<typename Done>
+    void step(Done done) {
+        static const uint8_t zero[64] = { 0 };
+        static const uint32_t ones = 0xFFFFFFFFul, none = 0;
+        if (fresh_) {
+            const void *mask[lanes];
+            for (size_t l = 0; l < lanes; l++) {
+                mask[l] = (fresh_ >> l) & 1 ? (const void *)&ones : (const void *)&none;
+            }
+            type reset = Instrinsic::load_lanes(mask, 0);
+            type iv[8];
+            hash::init(iv);
+            for (int i = 0; i < 8; i++) {
+                s_[i] = Instrinsic::vector_select(reset, iv[i], s_[i]);
+            }
+            fresh_ = 0;
+        }
+
+        const void *blocks[lanes];
+        for (size_t l = 0; l < lanes; l++) {
+            const lane &x = lane_[l];
+            if (!x.data) {
+                blocks[l] = zero;
+            } else if (x.next < x.full) {
+                blocks[l] = x.data + 64 * x.next;
+            } else {
+                blocks[l] = x.tail + 64 * (x.next - x.full);
+            }
+        }
+        type w[16];
+        for (int i = 0; i < 16; i++) {
+            w[i] = Instrinsic::load_lanes(blocks, i * 4);
+        }
+        hash::process_words(s_[0], s_[1], s_[2], s_[3], s_[4], s_[5], s_[6], s_[7], w);
+
+        for (size_t l = 0; l < lanes; l++) {
+            lane &x = lane_[l];
+            if (x.data && ++x.next == x.blocks) {
+                uint8_t digest[32];
+                hash::save_lane(digest, s_, l);
+                x.data = nullptr;
+                busy_--;
+                done(x.tag, digest);
+            }
+        }
+    }
+
+    // steps until every submitted message is done
+    template<typename Done>
+    void drain(Done done) {
+        while (busy_) {
+            step(done);
+        }
+    }
+
+private:
+    enum { lanes = sizeof(type) / sizeof(uint32_t) };
+
+    struct lane {
+        const uint8_t *data;    // null: free
+        uint64_t tag;
+        int full;
+        int blocks;
+        int next;
+        uint8_t tail[128];
+    };
+
+    type s_[8];
+    lane lane_[lanes];
+    size_t busy_;
+    uint32_t fresh_;
+};
+
+} // namespace fingera
@@ -0,0 +1,194 @@
+/**
+ * @file sha256_rorx.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-02
+ */
+#pragma once
+
+#include <cstdint>
+#include <immintrin.h>
+#include "compact.h"
+#include "sha256.h"
+#include "sha256_shani.h"
+#include "instrinsic_one.h"
+
+// rorx CPUID Flags: BMI2
+// _mm256_shuffle_epi8 _mm256_alignr_epi8 _mm256_xxx CPUID Flags: AVX2
+
+namespace fingera {
+
+// sha256 of one message for hosts without the SHA extensions
+//
+// the rounds stay scalar, rotations are rorx which neither touch the flags
+// nor overwrite their source. the message schedule of two consecutive
+// blocks runs in one 256 bit register, block i in the low half and block
+// i + 1 in the high one, 4 words of each per step. the steps interleave
+// with the rounds of block i, the rounds of block i + 1 only read the
+// words plus constants already stored
+class sha256_rorx {
+public:
+    using type = uint32_t;
+
+    enum {
+        block_size = 64,
+        hash_size = 32,
+        state_size = 8,
+    };
+
+private:
+    using vec = __m256i;
+
+    // a constant rotate, -mbmi2 makes it rorx
+    template<int N>
+    static inline uint32_t rorx(uint32_t x) {
+        return (x >> N) | (x << (32 - N));
+    }
+
+    static inline void round(uint32_t a, uint32_t b, uint32_t c, uint32_t &d,
+            uint32_t e, uint32_t f, uint32_t g, uint32_t &h, uint32_t wk) {
+        uint32_t t1 = h + wk + (rorx<6>(e) ^ rorx<11>(e) ^ rorx<25>(e)) + (((f ^ g) & e) ^ g);
+        uint32_t t2 = (rorx<2>(a) ^ rorx<13>(a) ^ rorx<22>(a)) + (((a ^ b) & (b ^ c)) ^ b);
+        d += t1;
+        h = t1 + t2;
+    }
+
+    // 4 rounds, wk: the 4 words plus constants. the next 4 take e f g h a b c d
+    static inline void quad(uint32_t &a, uint32_t &b, uint32_t &c, uint32_t &d,
+            uint32_t &e, uint32_t &f, uint32_t &g, uint32_t &h, const uint32_t *wk) {
+        round(a, b, c, d, e, f, g, h, wk[0]);
+        round(h, a, b, c, d, e, f, g, wk[1]);
+        round(g, h, a, b, c, d, e, f, wk[2]);
+        round(f, g, h, a, b, c, d, e, wk[3]);
+    }
+
+    template<int S>
+    static inline vec ror(vec x) {
+        return _mm256_or_si256(_mm256_srli_epi32(x, S), _mm256_slli_epi32(x, 32 - S));
+    }
+    static inline vec sigma0(vec x) {
+        return _mm256_xor_si256(_mm256_xor_si256(ror<7>(x), ror<18>(x)), _mm256_srli_epi32(x, 3));
+    }
+    static inline vec sigma1(vec x) {
+        return _mm256_xor_si256(_mm256_xor_si256(ror<17>(x), ror<19>(x)), _mm256_srli_epi32(x, 10));
+    }
+
+    // W[t .. t + 3] of both blocks from x0 = W[t - 16 ..], x1, x2, x3 = W[t - 4 ..]
+    static inline vec schedule(vec x0, vec x1, vec x2, vec x3) {
+        // W[t - 16] + sigma0(W[t - 15]) + W[t - 7]
+        vec w = _mm256_add_epi32(x0, sigma0(_mm256_alignr_epi8(x1, x0, 4)));
+        w = _mm256_add_epi32(w, _mm256_alignr_epi8(x3, x2, 4));
+        // sigma1(W[t - 2]) only exists for the first 2 words, the last 2 need those
+        vec low = sigma1(_mm256_shuffle_epi32(x3, 0xFE));
+        w = _mm256_add_epi32(w, _mm256_blend_epi32(low, _mm256_setzero_si256(), 0xCC));
+        vec high = sigma1(_mm256_shuffle_epi32(w, 0x40));
+        return _mm256_add_epi32(w, _mm256_blend_epi32(high, _mm256_setzero_si256(), 0x33));
+    }
+
+    // words plus constants of group G, both blocks: wk + 8 * G low, wk + 8 * G + 4 high
+    template<int G>
+    static inline void store(uint32_t *wk, vec x) {
+        vec k = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(sha256_shani::constants() + 4 * G)));
+        _mm256_store_si256((vec *)(wk + 8 * G), _mm256_add_epi32(x, k));
+    }
+
+    // schedule of group G + 4 from the 4 groups before it, next to the rounds of group G
+    template<int G>
+    static inline void expand(vec *x, uint32_t *wk) {
+        x[G & 3] = schedule(x[G & 3], x[(G + 1) & 3], x[(G + 2) & 3], x[(G + 3) & 3]);
+        store<G + 4>(wk, x[G & 3]);
+    }
+
+    static inline void add_state(uint32_t *s, uint32_t a, uint32_t b, uint32_t c, uint32_t d,
+            uint32_t e, uint32_t f, uint32_t g, uint32_t h) {
+        s[0] += a; s[1] += b; s[2] += c; s[3] += d;
+        s[4] += e; s[5] += f; s[6] += g; s[7] += h;
+    }
+
+    // first: block i, second: block i + 1 or null for a single block
+    static inline void process_pair(uint32_t *s, const void *first, const void *second) {
+        const vec mask = _mm256_set_epi64x(
+            0x0c0d0e0f08090a0bull, 0x0405060700010203ull, 0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+        alignas(32) uint32_t wk[128];
+        vec x[4];
+        for (int i = 0; i < 4; i++) {
+            __m128i low = _mm_loadu_si128((const __m128i *)first + i);
+            __m128i high = second ? _mm_loadu_si128((const __m128i *)second + i) : _mm_setzero_si128();
+            x[i] = _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(low), high, 1), mask);
+        }
+        store<0>(wk, x[0]);
+        store<1>(wk, x[1]);
+        store<2>(wk, x[2]);
+        store<3>(wk, x[3]);
+
+        uint32_t a = s[0], b = s[1], c = s[2], d = s[3];
+        uint32_t e = s[4], f = s[5], g = s[6], h = s[7];
+        quad(a, b, c, d, e, f, g, h, wk + 0);    expand<0>(x, wk);
+        quad(e, f, g, h, a, b, c, d, wk + 8);    expand<1>(x, wk);
+        quad(a, b, c, d, e, f, g, h, wk + 16);   expand<2>(x, wk);
+        quad(e, f, g, h, a, b, c, d, wk + 24);   expand<3>(x, wk);
+        quad(a, b, c, d, e, f, g, h, wk + 32);   expand<4>(x, wk);
+        quad(e, f, g, h, a, b, c, d, wk + 40);   expand<5>(x, wk);
+        quad(a, b, c, d, e, f, g, h, wk + 48);   expand<6>(x, wk);
+        quad(e, f, g, h, a, b, c, d, wk + 56);   expand<7>(x, wk);
+        quad(a, b, c, d, e, f, g, h, wk + 64);   expand<8>(x, wk);
+        quad(e, f, g, h, a, b, c, d, wk + 72);   expand<9>(x, wk);
+        quad(a, b, c, d, e, f, g, h, wk + 80);   expand<10>(x, wk);
+        quad(e, f, g, h, a, b, c, d, wk + 88);   expand<11>(x, wk);
+        quad(a, b, c, d, e, f, g, h, wk + 96);
+        quad(e, f, g, h, a, b, c, d, wk + 104);
+        quad(a, b, c, d, e, f, g, h, wk + 112);
+        quad(e, f, g, h, a, b, c, d, wk + 120);
+        add_state(s, a, b, c, d, e, f, g, h);
+        if (!second) {
+            return;
+        }
+
+        a = s[0], b = s[1], c = s[2], d = s[3];
+        e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int i = 0; i < 128; i += 16) {
+            quad(a, b, c, d, e, f, g, h, wk + i + 4);
+            quad(e, f, g, h, a, b, c, d, wk + i + 12);
+        }
+        add_state(s, a, b, c, d, e, f, g, h);
+    }
+
+public:
+    static inline size_t way() {
+        return 1;
+    }
+
+    static inline size_t block_count(size_t size) {
+        return sha256<instrinsic_one>::block_count(size);
+    }
+    static int pad_tail(void *tail, const void *left, uint64_t size) {
+        return sha256<instrinsic_one>::pad_tail(tail, left, size);
+    }
+    static int fill_lane(void *trunk, size_t lane, const void *data, size_t size) {
+        return sha256<instrinsic_one>::fill_lane(trunk, lane, data, size, way());
+    }
+
+    static inline void init(type *s) {
+        sha256<instrinsic_one>::init(s);
+    }
+    static inline void save_state(void *out, const type *s) {
+        sha256<instrinsic_one>::save_state(out, s);
+    }
+    static inline void process_blocks(type *s, const void *blocks, int count) {
+        const char *cur_block = (const char *)blocks;
+        for (; count >= 2; count -= 2, cur_block += 128) {
+            process_pair(s, cur_block, cur_block + 64);
+        }
+        if (count) {
+            process_pair(s, cur_block, nullptr);
+        }
+    }
+
+    static void process_trunk(void *out, const void *blocks, int count = 1) {
+        type s[state_size];
+        init(s);
+        process_blocks(s, blocks, count);
+        save_state(out, s);
+    }
+};
+
+} // namespace fingera
@@ -0,0 +1,177 @@
+/**
+ * @file sha256_scatter.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-31
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <vector>
+#include "compact.h"
+#include "sha256.h"
+
+namespace fingera {
+
+// a message made of a few byte ranges, hashed where they are
+//
+// a padded block that lies inside one range is read in place, only blocks
+// that straddle two ranges or hold the padding are assembled in a buffer
+class scatter_message {
+public:
+    enum { max_ranges = 4 };
+
+    scatter_message() : ranges_(0), size_(0) {}
+
+    void clear() {
+        ranges_ = 0;
+        size_ = 0;
+    }
+    // false when the message already has max_ranges ranges
+    bool add(const void *data, size_t size) {
+        if (ranges_ >= max_ranges) {
+            return false;
+        }
+        data_[ranges_] = (const uint8_t *)data;
+        begin_[ranges_] = size_;
+        size_ += size;
+        ranges_++;
+        return true;
+    }
+
+    size_t size() const {
+        return size_;
+    }
+    int block_count() const {
+        return (int)((size_ + 8) / 64 + 1);
+    }
+
+    // 64 bytes of block j of the padded message, in place or in staging
+    const uint8_t *block(int j, uint8_t *staging) const {
+        size_t offset = (size_t)j * 64;
+        for (int r = 0; r < ranges_; r++) {
+            size_t end = r + 1 < ranges_ ? begin_[r + 1] : size_;
+            if (offset >= begin_[r] && offset + 64 <= end) {
+                return data_[r] + (offset - begin_[r]);
+            }
+        }
+
+        memset(staging, 0, 64);
+        for (int r = 0; r < ranges_; r++) {
+            size_t end = r + 1 < ranges_ ? begin_[r + 1] : size_;
+            size_t from = std::max(offset, begin_[r]);
+            size_t to = std::min(offset + 64, end);
+            if (from < to) {
+                memcpy(staging + (from - offset), data_[r] + (from - begin_[r]), to - from);
+            }
+        }
+        if (size_ >= offset && size_ < offset + 64) {
+            staging[size_ - offset] = 0x80;
+        }
+        if (j == block_count() - 1) {
+            write_be64(staging, 56, (uint64_t)size_ * 8);
+        }
+        return staging;
+    }
+
+private:
+    int ranges_;
+    size_t size_;
+    const uint8_t *data_[max_ranges];
+    size_t begin_[max_ranges];
+};
+
+// sha256d of scatter messages on sha256<Instrinsic>
+template<typename Instrinsic>
+class sha256d_scatter {
+public:
+    using type = typename Instrinsic::type;
+    using hash = sha256<Instrinsic>;
+
+    static inline size_t way() {
+        return hash::way();
+    }
+
+    // way() messages, lane i hashes messages[order[i]], the sha256d state in s[8]
+    // n <= way() lanes are used, every lane stops after its own last block
+    static void hash_lanes(type *s, const scatter_message *messages, const uint32_t *order, size_t n) {
+        enum { lanes = sizeof(type) / sizeof(uint32_t) };
+        static const uint8_t zero[64] = { 0 };
+        uint8_t staging[lanes][64];
+        uint32_t first[lanes][8];
+        const void *blocks[lanes];
+        int counts[lanes];
+        memset(first, 0, sizeof(first));
+
+        int max_count = 0;
+        for (size_t l = 0; l < way(); l++) {
+            counts[l] = l < n ? messages[order[l]].block_count() : 0;
+            max_count = counts[l] > max_count ? counts[l] : max_count;
+            blocks[l] = zero;
+        }
+
+        hash::init(s);
+        for (int j = 0; j < max_count; j++) {
+            for (size_t l = 0; l < n; l++) {
+                blocks[l] = j < counts[l] ? messages[order[l]].block(j, staging[l]) : zero;
+            }
+            type w[16];
+            for (int i = 0; i < 16; i++) {
+                w[i] = Instrinsic::load_lanes(blocks, i * 4);
+            }
+            hash::process_words(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], w);
+
+            for (size_t l = 0; l < n; l++) {
+                if (counts[l] == j + 1) {
+                    for (int i = 0; i < 8; i++) {
+                        first[l][i] = Instrinsic::extract(s[i], l);
+                    }
+                }
+            }
+        }
+
+        // second pass: the 32 byte digests padded into one block
+        type w[16];
+        for (int i = 0; i < 8; i++) {
+            w[i] = Instrinsic::load_le(first, i * 4, 32);
+        }
+        w[8] = Instrinsic::vector_mirror(0x80000000ul);
+        for (int i = 9; i < 15; i++) {
+            w[i] = Instrinsic::vector_mirror(0);
+        }
+        w[15] = Instrinsic::vector_mirror(256);
+        hash::init(s);
+        hash::process_words(s[0], s[1], s[2], s[3], s[4], s[5], s[6], s[7], w);
+    }
+
+    // as hash_lanes, lane i writes its digest to out[order[i]]
+    static void process_lanes(uint8_t *const *out, const scatter_message *messages, const uint32_t *order, size_t n) {
+        enum { lanes = sizeof(type) / sizeof(uint32_t) };
+        type s[8];
+        hash_lanes(s, messages, order, n);
+
+        uint8_t digests[lanes * 32];
+        hash::save_state(digests, s);
+        for (size_t l = 0; l < n; l++) {
+            memcpy(out[order[l]], digests + 32 * l, 32);
+        }
+    }
+
+    // any number of messages, similar lengths share a batch
+    static void process(uint8_t *const *out, const scatter_message *messages, size_t count) {
+        std::vector<uint32_t> order(count);
+        for (size_t i = 0; i < count; i++) {
+            order[i] = (uint32_t)i;
+        }
+        std::sort(order.begin(), order.end(), [messages](uint32_t x, uint32_t y) {
+            return messages[x].block_count() < messages[y].block_count();
+        });
+        for (size_t begin = 0; begin < count; begin += way()) {
+            size_t n = count - begin < way() ? count - begin : way();
+            process_lanes(out, messages, order.data() + begin, n);
+        }
+    }
+};
+
+} // namespace fingera
@@ -0,0 +1,184 @@
+/**
+ * @file sha256_shani.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-28
+ */
+#pragma once
+
+#include <cstdint>
+#include <immintrin.h>
+#include "compact.h"
+#include "sha256.h"
+#include "instrinsic_one.h"
+
+// _mm_sha256rnds2_epu32 _mm_sha256msg1_epu32 _mm_sha256msg2_epu32 CPUID Flags: SHA
+// _mm_shuffle_epi8 _mm_alignr_epi8 CPUID Flags: SSSE3
+// _mm_blend_epi16 CPUID Flags: SSE4.1
+// _mm256_zeroupper CPUID Flags: AVX
+
+namespace fingera {
+
+// two messages per call on the SHA extensions, trunk layout as sha256<>
+class sha256_shani {
+public:
+    using type = __m128i;
+
+    enum {
+        block_size = 64,
+        hash_size = 32,
+        state_size = 4,
+    };
+
+    static inline const uint32_t *constants() {
+        static const uint32_t k[64] = {
+            0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+            0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+            0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul, 0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+            0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul, 0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+            0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul, 0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+            0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul, 0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+            0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul, 0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+            0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul, 0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul,
+        };
+        return k;
+    }
+
+    // one stream: state in ABEF / CDGH order, message words of the current block
+    struct stream {
+        type abef, cdgh;
+        type save_abef, save_cdgh;
+        type m0, m1, m2, m3;
+    };
+
+    // the rounds are legacy SSE encoded, they stall while the upper halves
+    // of the vector registers are dirty, call before the first block
+    static inline void clean_upper() {
+#ifdef __AVX__
+        _mm256_zeroupper();
+#endif
+    }
+
+    static inline void init(stream &s) {
+        s.abef = _mm_set_epi32(0x6a09e667ul, 0xbb67ae85ul, 0x510e527ful, 0x9b05688cul);
+        s.cdgh = _mm_set_epi32(0x3c6ef372ul, 0xa54ff53aul, 0x1f83d9abul, 0x5be0cd19ul);
+    }
+
+    static inline void begin(stream &s, const void *block) {
+        const type mask = _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+        s.save_abef = s.abef;
+        s.save_cdgh = s.cdgh;
+        s.m0 = _mm_shuffle_epi8(_mm_loadu_si128((const type *)block + 0), mask);
+        s.m1 = _mm_shuffle_epi8(_mm_loadu_si128((const type *)block + 1), mask);
+        s.m2 = _mm_shuffle_epi8(_mm_loadu_si128((const type *)block + 2), mask);
+        s.m3 = _mm_shuffle_epi8(_mm_loadu_si128((const type *)block + 3), mask);
+    }
+
+    // rounds 4 * G .. 4 * G + 3
+    template<int G>
+    static inline void quad(stream &s) {
+        type &m = G % 4 == 0 ? s.m0 : G % 4 == 1 ? s.m1 : G % 4 == 2 ? s.m2 : s.m3;
+        if (G >= 4) {
+            // W[t] = sigma1(W[t - 2]) + W[t - 7] + sigma0(W[t - 15]) + W[t - 16]
+            type &m1 = G % 4 == 0 ? s.m1 : G % 4 == 1 ? s.m2 : G % 4 == 2 ? s.m3 : s.m0;
+            type &m2 = G % 4 == 0 ? s.m2 : G % 4 == 1 ? s.m3 : G % 4 == 2 ? s.m0 : s.m1;
+            type &m3 = G % 4 == 0 ? s.m3 : G % 4 == 1 ? s.m0 : G % 4 == 2 ? s.m1 : s.m2;
+            type t = _mm_sha256msg1_epu32(m, m1);
+            t = _mm_add_epi32(t, _mm_alignr_epi8(m3, m2, 4));
+            m = _mm_sha256msg2_epu32(t, m3);
+        }
+        type k = _mm_add_epi32(m, _mm_loadu_si128((const type *)(constants() + G * 4)));
+        s.cdgh = _mm_sha256rnds2_epu32(s.cdgh, s.abef, k);
+        s.abef = _mm_sha256rnds2_epu32(s.abef, s.cdgh, _mm_shuffle_epi32(k, 0x0E));
+    }
+
+    static inline void end(stream &s) {
+        s.abef = _mm_add_epi32(s.abef, s.save_abef);
+        s.cdgh = _mm_add_epi32(s.cdgh, s.save_cdgh);
+    }
+
+    static inline void save(void *out, const stream &s) {
+        // ABEF / CDGH back to ABCD / EFGH, big endian
+        const type mask = _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull);
+        type feba = _mm_shuffle_epi32(s.abef, 0x1B);
+        type dchg = _mm_shuffle_epi32(s.cdgh, 0xB1);
+        type abcd = _mm_blend_epi16(feba, dchg, 0xF0);
+        type efgh = _mm_alignr_epi8(dchg, feba, 8);
+        _mm_storeu_si128((type *)out, _mm_shuffle_epi8(abcd, mask));
+        _mm_storeu_si128((type *)out + 1, _mm_shuffle_epi8(efgh, mask));
+    }
+
+    static inline void process_block(stream &x, stream &y, const void *bx, const void *by) {
+        begin(x, bx);
+        begin(y, by);
+        quad<0>(x);  quad<0>(y);  quad<1>(x);  quad<1>(y);
+        quad<2>(x);  quad<2>(y);  quad<3>(x);  quad<3>(y);
+        quad<4>(x);  quad<4>(y);  quad<5>(x);  quad<5>(y);
+        quad<6>(x);  quad<6>(y);  quad<7>(x);  quad<7>(y);
+        quad<8>(x);  quad<8>(y);  quad<9>(x);  quad<9>(y);
+        quad<10>(x); quad<10>(y); quad<11>(x); quad<11>(y);
+        quad<12>(x); quad<12>(y); quad<13>(x); quad<13>(y);
+        quad<14>(x); quad<14>(y); quad<15>(x); quad<15>(y);
+        end(x);
+        end(y);
+    }
+
+public:
+    static inline size_t way() {
+        return 2;
+    }
+
+    static inline size_t block_count(size_t size) {
+        return sha256<instrinsic_one>::block_count(size);
+    }
+    static int pad_tail(void *tail, const void *left, uint64_t size) {
+        return sha256<instrinsic_one>::pad_tail(tail, left, size);
+    }
+    static int fill_lane(void *trunk, size_t lane, const void *data, size_t size) {
+        return sha256<instrinsic_one>::fill_lane(trunk, lane, data, size, way());
+    }
+
+    // the state of both streams as abef, cdgh, abef, cdgh, enough for trunk_arena
+    static inline void init(type *s) {
+        stream x;
+        clean_upper();
+        init(x);
+        s[0] = s[2] = x.abef;
+        s[1] = s[3] = x.cdgh;
+    }
+    static inline void save_state(void *out, const type *s) {
+        stream x, y;
+        x.abef = s[0];
+        x.cdgh = s[1];
+        y.abef = s[2];
+        y.cdgh = s[3];
+        save(out, x);
+        save((char *)out + 32, y);
+    }
+    static inline void process_blocks(type *s, const void *blocks, int count) {
+        stream x, y;
+        x.abef = s[0];
+        x.cdgh = s[1];
+        y.abef = s[2];
+        y.cdgh = s[3];
+
+        const char *cur_block = (const char *)blocks;
+        while (count--) {
+            process_block(x, y, cur_block, cur_block + 64);
+            cur_block += 64 * way();
+        }
+
+        s[0] = x.abef;
+        s[1] = x.cdgh;
+        s[2] = y.abef;
+        s[3] = y.cdgh;
+    }
+
+    static void process_trunk(void *out, const void *blocks, int count = 1) {
+        type s[state_size];
+        init(s);
+        process_blocks(s, blocks, count);
+        save_state(out, s);
+    }
+};
+
+} // namespace fingera
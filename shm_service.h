@@ -0,0 +1,647 @@
+/**
+ * @file shm_service.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-03
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+#include "compact.h"
+#include "sha256.h"
+#include "sha256_refill.h"
+#include "ripemd160.h"
+#include "trunk_arena.h"
+
+namespace fingera {
+
+// what a client and hashd share
+//
+// every client gets its own ring, a memfd of a 64 byte header and slots
+// of slot_size bytes: 64 bytes of state, algorithm, size and digest, then
+// the message. the client writes the message into the slot and marks it
+// ready, the daemon hashes it where it is and writes the digest back into
+// the slot. one doorbell page is shared by all clients, its sequence word
+// is what a sleeping daemon waits on. the words are waited on with
+// process shared futexes
+struct shm_ring {
+    enum {
+        magic = 0x676e6972,     // "ring"
+        version = 1,
+    };
+    enum {
+        sha256_id = 1,
+        ripemd160_id = 2,
+    };
+    // slot states: idle -> ready -> (waiting) -> done / failed -> idle
+    enum {
+        idle = 0,
+        ready = 1,
+        waiting = 2,            // ready, the client sleeps on the state
+        done = 3,
+        failed = 4,             // unknown algorithm or size over capacity
+    };
+
+    struct header {
+        uint32_t magic;
+        uint32_t version;
+        uint32_t slots;
+        uint32_t slot_size;
+        std::atomic<uint32_t> submitted;
+        uint8_t reserved[44];
+    };
+    struct slot {
+        std::atomic<uint32_t> state;
+        uint32_t algorithm;
+        uint32_t size;
+        uint32_t reserved;
+        uint8_t digest[32];
+        uint8_t pad[16];
+
+        uint8_t *data() {
+            return (uint8_t *)(this + 1);
+        }
+    };
+    struct doorbell {
+        std::atomic<uint32_t> seq;
+        std::atomic<uint32_t> sleeping;
+    };
+
+    static size_t map_size(size_t slots, size_t slot_size) {
+        return sizeof(header) + slots * slot_size;
+    }
+    static slot *at(uint8_t *map, size_t slot_size, size_t i) {
+        return (slot *)(map + sizeof(header) + i * slot_size);
+    }
+
+    // not FUTEX_PRIVATE, the word is in a MAP_SHARED mapping
+    static void wait(std::atomic<uint32_t> *word, uint32_t expected, long timeout_ns = -1) {
+        struct timespec ts;
+        ts.tv_sec = timeout_ns / 1000000000;
+        ts.tv_nsec = timeout_ns % 1000000000;
+        syscall(SYS_futex, (uint32_t *)word, FUTEX_WAIT, expected, timeout_ns < 0 ? nullptr : &ts, nullptr, 0);
+    }
+    static void wake(std::atomic<uint32_t> *word, int count = 1) {
+        syscall(SYS_futex, (uint32_t *)word, FUTEX_WAKE, count, nullptr, nullptr, 0);
+    }
+};
+
+// one ring of hashd, for one thread
+// a message is written into data(i) in place, submit(i) hands it over and
+// wait(i) points at the digest inside the slot until release(i)
+class shm_hash_client {
+public:
+    shm_hash_client() : sock_(-1), map_(nullptr), map_size_(0), bell_(nullptr) {}
+    ~shm_hash_client() {
+        close();
+    }
+    shm_hash_client(const shm_hash_client &) = delete;
+    shm_hash_client &operator=(const shm_hash_client &) = delete;
+
+    // false when hashd does not answer on path
+    bool connect(const std::string &path) {
+        close();
+        struct sockaddr_un addr;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            return false;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, path.c_str(), path.size());
+        sock_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (sock_ < 0 || ::connect(sock_, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+            close();
+            return false;
+        }
+
+        int fds[2];
+        if (!receive_fds(fds)) {
+            close();
+            return false;
+        }
+        struct stat st;
+        bool ok = fstat(fds[0], &st) == 0 && (size_t)st.st_size >= sizeof(shm_ring::header);
+        if (ok) {
+            map_size_ = st.st_size;
+            void *ring = mmap(nullptr, map_size_, PROT_READ | PROT_WRITE, MAP_SHARED, fds[0], 0);
+            void *bell = mmap(nullptr, sizeof(shm_ring::doorbell), PROT_READ | PROT_WRITE, MAP_SHARED, fds[1], 0);
+            map_ = ring == MAP_FAILED ? nullptr : (uint8_t *)ring;
+            bell_ = bell == MAP_FAILED ? nullptr : (shm_ring::doorbell *)bell;
+        }
+        ::close(fds[0]);
+        ::close(fds[1]);
+        const shm_ring::header *h = head();
+        if (!map_ || !bell_ || h->magic != shm_ring::magic || h->version != shm_ring::version ||
+                h->slot_size <= sizeof(shm_ring::slot) ||
+                shm_ring::map_size(h->slots, h->slot_size) > map_size_) {
+            close();
+            return false;
+        }
+        busy_.assign(h->slots, false);
+        return true;
+    }
+    void close() {
+        if (map_) {
+            munmap(map_, map_size_);
+            map_ = nullptr;
+            map_size_ = 0;
+        }
+        if (bell_) {
+            munmap(bell_, sizeof(shm_ring::doorbell));
+            bell_ = nullptr;
+        }
+        if (sock_ >= 0) {
+            ::close(sock_);
+            sock_ = -1;
+        }
+        busy_.clear();
+    }
+
+    bool is_open() const {
+        return map_ != nullptr;
+    }
+    size_t slots() const {
+        return busy_.size();
+    }
+    // largest message
+    size_t capacity() const {
+        return head()->slot_size - sizeof(shm_ring::slot);
+    }
+
+    // a free slot, -1 when every slot is in use
+    int reserve() {
+        for (size_t i = 0; i < busy_.size(); i++) {
+            if (!busy_[i]) {
+                busy_[i] = true;
+                return (int)i;
+            }
+        }
+        return -1;
+    }
+    uint8_t *data(int i) {
+        return at(i)->data();
+    }
+
+    // size bytes of data(i) are hashed with algorithm (shm_ring::sha256_id ...)
+    void submit(int i, uint32_t algorithm, size_t size) {
+        shm_ring::slot *s = at(i);
+        s->algorithm = algorithm;
+        s->size = (uint32_t)size;
+        s->state.store(shm_ring::ready, std::memory_order_release);
+        head()->submitted.fetch_add(1);
+        bell_->seq.fetch_add(1);
+        if (bell_->sleeping.load()) {
+            shm_ring::wake(&bell_->seq);
+        }
+    }
+
+    // the digest in the slot, null when hashd refused the message or is gone
+    const uint8_t *wait(int i) {
+        shm_ring::slot *s = at(i);
+        uint32_t state = s->state.load(std::memory_order_acquire);
+        while (state == shm_ring::ready || state == shm_ring::waiting) {
+            if (state == shm_ring::ready &&
+                    !s->state.compare_exchange_weak(state, shm_ring::waiting, std::memory_order_acquire)) {
+                continue;
+            }
+            shm_ring::wait(&s->state, shm_ring::waiting, 100000000);
+            state = s->state.load(std::memory_order_acquire);
+            if (state == shm_ring::waiting && hung_up()) {
+                return nullptr;
+            }
+        }
+        return state == shm_ring::done ? s->digest : nullptr;
+    }
+    void release(int i) {
+        at(i)->state.store(shm_ring::idle, std::memory_order_relaxed);
+        busy_[i] = false;
+    }
+
+    // one message through a slot, false when it does not fit or is refused
+    bool hash(uint32_t algorithm, const void *data, size_t size, uint8_t *digest, size_t digest_size) {
+        int i = size <= capacity() ? reserve() : -1;
+        if (i < 0) {
+            return false;
+        }
+        memcpy(this->data(i), data, size);
+        submit(i, algorithm, size);
+        const uint8_t *result = wait(i);
+        if (result) {
+            memcpy(digest, result, digest_size);
+        }
+        release(i);
+        return result != nullptr;
+    }
+
+private:
+    shm_ring::header *head() const {
+        return (shm_ring::header *)map_;
+    }
+    shm_ring::slot *at(int i) const {
+        return shm_ring::at(map_, head()->slot_size, i);
+    }
+
+    bool hung_up() const {
+        struct pollfd fd = { sock_, POLLIN, 0 };
+        return poll(&fd, 1, 0) > 0 && (fd.revents & (POLLHUP | POLLERR));
+    }
+
+    bool receive_fds(int *fds) {
+        char byte;
+        struct iovec iov = { &byte, 1 };
+        char control[CMSG_SPACE(2 * sizeof(int))];
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        if (recvmsg(sock_, &msg, MSG_CMSG_CLOEXEC) != 1) {
+            return false;
+        }
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        if (!cm || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS ||
+                cm->cmsg_len != CMSG_LEN(2 * sizeof(int))) {
+            return false;
+        }
+        memcpy(fds, CMSG_DATA(cm), 2 * sizeof(int));
+        return true;
+    }
+
+    int sock_;
+    uint8_t *map_;
+    size_t map_size_;
+    shm_ring::doorbell *bell_;
+    std::vector<bool> busy_;
+};
+
+// hashd: the rings of all clients feed the lanes of one backend
+//
+// sha256 messages go to a sha256_refill and are read from the client's
+// slot in place, ripemd160 ones are padded into a trunk_arena. a batch is
+// stepped once its lanes are full or no message came for deadline. the
+// rings are sealed against resizing, and a ring whose client hung up is
+// only unmapped after its messages in flight are done
+template<typename Instrinsic>
+class shm_hash_daemon {
+public:
+    using sha = sha256_refill<Instrinsic>;
+    using rmd = ripemd160<Instrinsic>;
+
+    explicit shm_hash_daemon(size_t slots = 64, size_t slot_size = 4096,
+            std::chrono::nanoseconds deadline = std::chrono::microseconds(20))
+            : slots_(slots), slot_size_((slot_size + 63) / 64 * 64), deadline_(deadline),
+            listen_(-1), bell_fd_(-1), bell_(nullptr), next_id_(1),
+            rmd_(rmd::block_count(slot_size_ - sizeof(shm_ring::slot))), rmd_tags_(rmd::way()) {}
+    ~shm_hash_daemon() {
+        for (size_t i = 0; i < clients_.size(); i++) {
+            drop(*clients_[i]);
+        }
+        if (bell_) {
+            munmap(bell_, sizeof(shm_ring::doorbell));
+        }
+        if (bell_fd_ >= 0) {
+            ::close(bell_fd_);
+        }
+        if (listen_ >= 0) {
+            ::close(listen_);
+            unlink(path_.c_str());
+        }
+    }
+    shm_hash_daemon(const shm_hash_daemon &) = delete;
+    shm_hash_daemon &operator=(const shm_hash_daemon &) = delete;
+
+    static inline size_t way() {
+        return sha::way();
+    }
+    size_t clients() const {
+        return clients_.size();
+    }
+
+    // a stale socket file at path is replaced
+    bool listen(const std::string &path) {
+        struct sockaddr_un addr;
+        if (path.size() >= sizeof(addr.sun_path)) {
+            return false;
+        }
+        bell_fd_ = sealed(sizeof(shm_ring::doorbell), (void **)&bell_);
+        if (bell_fd_ < 0) {
+            return false;
+        }
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path, path.c_str(), path.size());
+        unlink(path.c_str());
+        listen_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+        if (listen_ < 0 || bind(listen_, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+                ::listen(listen_, 64) != 0) {
+            return false;
+        }
+        path_ = path;
+        return true;
+    }
+
+    // until stop, the messages taken by then are finished
+    void run(const std::atomic<bool> &stop) {
+        clock::time_point last = clock::now(), polled = last;
+        for (;;) {
+            if (!stop.load() && collect()) {
+                last = clock::now();
+            }
+            bool due = stop.load() || clock::now() - last >= deadline_;
+            if (sha_.full() || (!sha_.idle() && due)) {
+                sha_.step([this](uint64_t tag, const uint8_t *digest) {
+                    finish(tag, digest, 32);
+                });
+            }
+            if (rmd_.full() || (rmd_.size() && due)) {
+                flush_ripemd160();
+            }
+
+            // new and hung up clients once a millisecond, busy or not: the
+            // accept and poll syscalls cost more than a pass over the rings
+            bool busy = !sha_.idle() || rmd_.size();
+            clock::time_point now = clock::now();
+            if (now - polled >= std::chrono::milliseconds(1)) {
+                accept_clients();
+                reap_clients();
+                polled = now;
+            }
+            if (busy) {
+                if (!sha_.full() && !rmd_.full()) {
+                    std::this_thread::yield();
+                }
+                continue;
+            }
+            if (stop.load()) {
+                return;
+            }
+
+            // nothing in flight: sleep on the doorbell
+            bell_->sleeping.store(1);
+            uint32_t seq = bell_->seq.load();
+            if (!pending()) {
+                shm_ring::wait(&bell_->seq, seq, 10000000);
+            }
+            bell_->sleeping.store(0);
+        }
+    }
+
+private:
+    using clock = std::chrono::steady_clock;
+
+    struct client {
+        uint32_t id;
+        int sock;
+        int fd;
+        uint8_t *map;
+        uint32_t seen;              // submitted when the ring was last scanned in full
+        std::vector<bool> taken;
+        size_t inflight;
+        bool closed;
+    };
+
+    // a memfd of size bytes mapped at *map, sealed so no client can resize it
+    static int sealed(size_t size, void **map) {
+        int fd = memfd_create("fingera-hashd", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (fd < 0) {
+            return -1;
+        }
+        if (ftruncate(fd, size) != 0 ||
+                fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0) {
+            ::close(fd);
+            return -1;
+        }
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) {
+            ::close(fd);
+            return -1;
+        }
+        *map = p;
+        return fd;
+    }
+
+    static bool send_fds(int sock, int ring, int bell) {
+        char byte = 0;
+        struct iovec iov = { &byte, 1 };
+        char control[CMSG_SPACE(2 * sizeof(int))];
+        memset(control, 0, sizeof(control));
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+        struct cmsghdr *cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(2 * sizeof(int));
+        int fds[2] = { ring, bell };
+        memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+        return sendmsg(sock, &msg, MSG_NOSIGNAL) == 1;
+    }
+
+    void accept_clients() {
+        for (;;) {
+            int sock = accept4(listen_, nullptr, nullptr, SOCK_CLOEXEC | SOCK_NONBLOCK);
+            if (sock < 0) {
+                return;
+            }
+            std::unique_ptr<client> c(new client);
+            c->id = next_id_++;
+            c->sock = sock;
+            c->map = nullptr;
+            c->fd = sealed(shm_ring::map_size(slots_, slot_size_), (void **)&c->map);
+            if (c->fd < 0) {
+                ::close(sock);
+                continue;
+            }
+            shm_ring::header *h = (shm_ring::header *)c->map;
+            h->magic = shm_ring::magic;
+            h->version = shm_ring::version;
+            h->slots = (uint32_t)slots_;
+            h->slot_size = (uint32_t)slot_size_;
+            h->submitted.store(0);
+            c->seen = 0;
+            c->taken.assign(slots_, false);
+            c->inflight = 0;
+            c->closed = false;
+            if (!send_fds(sock, c->fd, bell_fd_)) {
+                drop(*c);
+                continue;
+            }
+            clients_.push_back(std::move(c));
+        }
+    }
+
+    // clients that hung up, unmapped once nothing of theirs is in flight
+    void reap_clients() {
+        std::vector<struct pollfd> fds(clients_.size());
+        for (size_t i = 0; i < clients_.size(); i++) {
+            fds[i].fd = clients_[i]->sock;
+            fds[i].events = POLLIN;
+            fds[i].revents = 0;
+        }
+        if (!fds.empty() && poll(fds.data(), fds.size(), 0) > 0) {
+            for (size_t i = 0; i < clients_.size(); i++) {
+                char buffer[64];
+                if (fds[i].revents && read(fds[i].fd, buffer, sizeof(buffer)) <= 0) {
+                    clients_[i]->closed = true;
+                }
+            }
+        }
+        for (size_t i = 0; i < clients_.size();) {
+            if (clients_[i]->closed && clients_[i]->inflight == 0) {
+                drop(*clients_[i]);
+                clients_.erase(clients_.begin() + i);
+            } else {
+                i++;
+            }
+        }
+    }
+
+    void drop(client &c) {
+        if (c.map) {
+            munmap(c.map, shm_ring::map_size(slots_, slot_size_));
+            c.map = nullptr;
+        }
+        if (c.fd >= 0) {
+            ::close(c.fd);
+            c.fd = -1;
+        }
+        if (c.sock >= 0) {
+            ::close(c.sock);
+            c.sock = -1;
+        }
+    }
+
+    bool pending() const {
+        for (size_t i = 0; i < clients_.size(); i++) {
+            const client &c = *clients_[i];
+            if (!c.closed && ((shm_ring::header *)c.map)->submitted.load() != c.seen) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // ready slots into the lanes, true when any was taken
+    bool collect() {
+        bool any = false;
+        for (size_t i = 0; i < clients_.size(); i++) {
+            client &c = *clients_[i];
+            if (c.closed) {
+                continue;
+            }
+            uint32_t submitted = ((shm_ring::header *)c.map)->submitted.load();
+            if (submitted == c.seen) {
+                continue;
+            }
+            bool complete = true;
+            for (size_t s = 0; s < slots_; s++) {
+                shm_ring::slot *x = shm_ring::at(c.map, slot_size_, s);
+                uint32_t state = x->state.load(std::memory_order_acquire);
+                if (c.taken[s] || (state != shm_ring::ready && state != shm_ring::waiting)) {
+                    continue;
+                }
+                // read once, the client may write them again
+                uint32_t algorithm = __atomic_load_n(&x->algorithm, __ATOMIC_RELAXED);
+                size_t size = __atomic_load_n(&x->size, __ATOMIC_RELAXED);
+                uint64_t tag = (uint64_t)c.id << 32 | s;
+                if (size > slot_size_ - sizeof(shm_ring::slot)) {
+                    algorithm = 0;
+                }
+                if (algorithm == shm_ring::sha256_id) {
+                    if (sha_.full()) {
+                        complete = false;
+                        continue;
+                    }
+                    sha_.submit(x->data(), size, tag);
+                } else if (algorithm == shm_ring::ripemd160_id) {
+                    if (rmd_.full()) {
+                        complete = false;
+                        continue;
+                    }
+                    rmd_tags_[rmd_.size()] = tag;
+                    rmd_.add(x->data(), size);
+                } else {
+                    c.taken[s] = true;
+                    c.inflight++;
+                    finish(tag, nullptr, 0);
+                    continue;
+                }
+                c.taken[s] = true;
+                c.inflight++;
+                any = true;
+            }
+            if (complete) {
+                c.seen = submitted;
+            }
+        }
+        return any;
+    }
+
+    void flush_ripemd160() {
+        rmd_.process();
+        for (size_t i = 0; i < rmd_.size(); i++) {
+            finish(rmd_tags_[i], rmd_.digest(i), rmd::hash_size);
+        }
+        rmd_.clear();
+    }
+
+    // digest into the slot of tag and the client woken, null: failed
+    void finish(uint64_t tag, const uint8_t *digest, size_t size) {
+        uint32_t id = (uint32_t)(tag >> 32), s = (uint32_t)tag;
+        for (size_t i = 0; i < clients_.size(); i++) {
+            client &c = *clients_[i];
+            if (c.id != id) {
+                continue;
+            }
+            c.taken[s] = false;
+            c.inflight--;
+            if (c.closed) {
+                return;
+            }
+            shm_ring::slot *x = shm_ring::at(c.map, slot_size_, s);
+            if (digest) {
+                memcpy(x->digest, digest, size);
+            }
+            uint32_t old = x->state.exchange(digest ? shm_ring::done : shm_ring::failed, std::memory_order_release);
+            if (old == shm_ring::waiting) {
+                shm_ring::wake(&x->state);
+            }
+            return;
+        }
+    }
+
+    size_t slots_;
+    size_t slot_size_;
+    std::chrono::nanoseconds deadline_;
+    std::string path_;
+    int listen_;
+    int bell_fd_;
+    shm_ring::doorbell *bell_;
+    uint32_t next_id_;
+    std::vector<std::unique_ptr<client> > clients_;
+    sha sha_;
+    trunk_arena<rmd> rmd_;
+    std::vector<uint64_t> rmd_tags_;    // of the rmd_ lanes, sized once
+};
+
+} // namespace fingera
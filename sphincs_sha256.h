@@ -0,0 +1,373 @@
+/**
+ * @file sphincs_sha256.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-08-04
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "compact.h"
+#include "sha256.h"
+#include "instrinsic_one.h"
+
+namespace fingera {
+
+// the 22 byte compressed ADRS of SPHINCS+-SHA2 (ADRSc)
+// layer 1 byte, tree 8, type 1, then the 3 words the type gives a meaning
+struct sphincs_address {
+    enum {
+        wots_hash = 0,
+        wots_pk = 1,
+        tree = 2,
+        fors_tree = 3,
+        fors_roots = 4,
+        wots_prf = 5,
+        fors_prf = 6,
+    };
+
+    uint8_t bytes[22];
+
+    sphincs_address() {
+        memset(bytes, 0, sizeof(bytes));
+    }
+
+    void set_layer(uint32_t layer) {
+        bytes[0] = (uint8_t)layer;
+    }
+    void set_tree(uint64_t tree) {
+        write_be64(bytes, 1, tree);
+    }
+    // clears the 3 words, as setTypeAndClear
+    void set_type(uint32_t type) {
+        bytes[9] = (uint8_t)type;
+        memset(bytes + 10, 0, 12);
+    }
+    void set_keypair(uint32_t keypair) {
+        write_be32(bytes, 10, keypair);
+    }
+    void set_chain(uint32_t chain) {
+        write_be32(bytes, 14, chain);
+    }
+    void set_hash(uint32_t hash) {
+        write_be32(bytes, 18, hash);
+    }
+    void set_tree_height(uint32_t height) {
+        write_be32(bytes, 14, height);
+    }
+    void set_tree_index(uint32_t index) {
+        write_be32(bytes, 18, index);
+    }
+};
+
+// the tweakable hashes of SPHINCS+-SHA2-128 simple (n = 16, w = 16) on the
+// lanes of sha256<Instrinsic>
+//
+// every call is sha256(pk_seed || 0^48 || ADRSc || m) cut to n bytes, the
+// first block is the same for all of them and is compressed once. chains()
+// runs one WOTS+ chain per lane: the value stays in the state registers
+// from step to step, F of one step is a single block built with shifts
+// from the 4 words left by the previous one. a lane whose chain is done
+// takes the next job, so chains of different lengths do not wait for the
+// longest one. the other hashes pad their messages into a trunk
+template<typename Instrinsic>
+class sphincs_sha256 {
+public:
+    using type = typename Instrinsic::type;
+    using hash = sha256<Instrinsic>;
+
+    enum {
+        n = 16,
+        w = 16,
+        len1 = 32,
+        len2 = 3,
+        len = 35,           // chains of a WOTS+ key
+    };
+
+    // value: n bytes, replaced by chain(value, start, steps) under address
+    // (type wots_hash, its keypair and chain set)
+    struct chain_job {
+        uint8_t *value;
+        sphincs_address address;
+        uint32_t start;
+        uint32_t steps;
+    };
+
+    static inline size_t way() {
+        return hash::way();
+    }
+
+    explicit sphincs_sha256(const uint8_t *pk_seed) {
+        uint8_t block[64];
+        memset(block, 0, sizeof(block));
+        memcpy(block, pk_seed, n);
+        scalar::init(seeded_);
+        scalar::process_blocks(seeded_, block, 1);
+    }
+
+    // count calls of count addresses, in: count * blocks * n bytes, out: count * n
+    // F with blocks = 1, H with 2, T_len with len
+    void thash(uint8_t *out, const sphincs_address *address, const uint8_t *in, size_t blocks, size_t count) const {
+        size_t size = sizeof(address->bytes) + blocks * n;
+        int trunk_blocks = (int)((size + 8) / 64 + 1);
+        std::vector<uint8_t> trunk(64 * way() * trunk_blocks);
+        std::vector<uint8_t> digests(32 * way());
+        std::vector<uint8_t> message(64 * trunk_blocks);
+        for (size_t first = 0; first < count; first += way()) {
+            size_t used = count - first < way() ? count - first : way();
+            for (size_t l = 0; l < used; l++) {
+                memset(message.data(), 0, message.size());
+                memcpy(message.data(), address[first + l].bytes, sizeof(address->bytes));
+                memcpy(message.data() + sizeof(address->bytes), in + (first + l) * blocks * n, blocks * n);
+                message[size] = 0x80;
+                write_be64(message.data(), 64 * trunk_blocks - 8, (uint64_t)(64 + size) * 8);
+                for (int i = 0; i < trunk_blocks; i++) {
+                    memcpy(&trunk[64 * (i * way() + l)], &message[64 * i], 64);
+                }
+            }
+            type s[8];
+            seeded(s);
+            hash::process_blocks(s, trunk.data(), trunk_blocks);
+            hash::save_state(digests.data(), s);
+            for (size_t l = 0; l < used; l++) {
+                memcpy(out + (first + l) * n, &digests[32 * l], n);
+            }
+        }
+    }
+
+    void chains(chain_job *jobs, size_t count) const {
+        lanes_state x;
+        size_t next = 0;
+        size_t active = 0;
+        for (size_t l = 0; l < lanes; l++) {
+            active += take(x, l, jobs, count, next);
+        }
+
+        type mid[8];
+        seeded(mid);
+        while (active) {
+            uint32_t steps = 0xFFFFFFFFul;
+            for (size_t l = 0; l < lanes; l++) {
+                if (x.left[l] && x.left[l] < steps) {
+                    steps = x.left[l];
+                }
+            }
+
+            type address[5], hash_address, value[4];
+            for (int i = 0; i < 5; i++) {
+                address[i] = Instrinsic::load_le(x.words[i], 0, 4);
+            }
+            hash_address = Instrinsic::load_le(x.words[5], 0, 4);
+            for (int i = 0; i < 4; i++) {
+                value[i] = Instrinsic::load_le(x.words[6 + i], 0, 4);
+            }
+            for (uint32_t i = 0; i < steps; i++) {
+                step(mid, address, hash_address, value);
+            }
+            Instrinsic::save_le(x.words[5], 0, hash_address, 4);
+            for (int i = 0; i < 4; i++) {
+                Instrinsic::save_le(x.words[6 + i], 0, value[i], 4);
+            }
+
+            for (size_t l = 0; l < lanes; l++) {
+                if (!x.left[l]) {
+                    continue;
+                }
+                x.left[l] -= steps;
+                if (!x.left[l]) {
+                    for (int i = 0; i < 4; i++) {
+                        write_be32(jobs[x.job[l]].value, 4 * i, x.words[6 + i][l]);
+                    }
+                    active -= 1 - take(x, l, jobs, count, next);
+                }
+            }
+        }
+    }
+
+    // WOTS+ public keys of count keypairs from first on, address: layer and tree
+    // out: count * n
+    void wots_pkgen(uint8_t *out, const uint8_t *sk_seed, const sphincs_address &address,
+            uint32_t first, size_t count) const {
+        std::vector<uint8_t> values(count * len * n);
+        private_keys(values.data(), sk_seed, address, first, count);
+        std::vector<chain_job> jobs(count * len);
+        for (size_t k = 0; k < count; k++) {
+            for (int i = 0; i < len; i++) {
+                set_job(jobs[k * len + i], &values[(k * len + i) * n], address, first + (uint32_t)k, i, 0, w - 1);
+            }
+        }
+        chains(jobs.data(), jobs.size());
+        compress(out, values.data(), address, first, count);
+    }
+
+    // len * n bytes of signature of the n byte message
+    void wots_sign(uint8_t *sig, const uint8_t *message, const uint8_t *sk_seed,
+            const sphincs_address &address, uint32_t keypair) const {
+        int digits[len];
+        base_w(digits, message);
+        private_keys(sig, sk_seed, address, keypair, 1);
+        chain_job jobs[len];
+        for (int i = 0; i < len; i++) {
+            set_job(jobs[i], sig + i * n, address, keypair, i, 0, digits[i]);
+        }
+        chains(jobs, len);
+    }
+
+    // the public key a signature of message belongs to
+    void wots_pk_from_sig(uint8_t *pk, const uint8_t *sig, const uint8_t *message,
+            const sphincs_address &address, uint32_t keypair) const {
+        int digits[len];
+        base_w(digits, message);
+        uint8_t values[len * n];
+        memcpy(values, sig, sizeof(values));
+        chain_job jobs[len];
+        for (int i = 0; i < len; i++) {
+            set_job(jobs[i], values + i * n, address, keypair, i, digits[i], w - 1 - digits[i]);
+        }
+        chains(jobs, len);
+        compress(pk, values, address, keypair, 1);
+    }
+
+    // root of the tree over 2^height leaves, address: layer and tree
+    // leaves are kept, the levels above go through H on all lanes
+    void tree_root(uint8_t *root, const uint8_t *leaves, int height, const sphincs_address &address) const {
+        std::vector<uint8_t> level(leaves, leaves + (n << height));
+        std::vector<sphincs_address> nodes((size_t)1 << height);
+        for (int z = 1; z <= height; z++) {
+            size_t count = (size_t)1 << (height - z);
+            for (size_t i = 0; i < count; i++) {
+                nodes[i] = address;
+                nodes[i].set_type(sphincs_address::tree);
+                nodes[i].set_tree_height(z);
+                nodes[i].set_tree_index((uint32_t)i);
+            }
+            thash(level.data(), nodes.data(), level.data(), 2, count);
+        }
+        memcpy(root, level.data(), n);
+    }
+
+private:
+    using scalar = sha256<instrinsic_one>;
+    enum { lanes = sizeof(type) / sizeof(uint32_t) };
+
+    // per lane: the 5 address words, the hash address, the 4 value words
+    struct lanes_state {
+        uint32_t words[10][lanes];
+        uint32_t left[lanes];       // 0: idle
+        size_t job[lanes];
+    };
+
+    void seeded(type *s) const {
+        for (int i = 0; i < 8; i++) {
+            s[i] = Instrinsic::vector_mirror(seeded_[i]);
+        }
+    }
+
+    // the next job with steps into lane l, 0 when there is none
+    static size_t take(lanes_state &x, size_t l, chain_job *jobs, size_t count, size_t &next) {
+        while (next < count && jobs[next].steps == 0) {
+            next++;
+        }
+        if (next == count) {
+            x.left[l] = 0;
+            return 0;
+        }
+        const chain_job &j = jobs[next];
+        for (int i = 0; i < 5; i++) {
+            x.words[i][l] = read_be32(j.address.bytes, 4 * i);
+        }
+        x.words[5][l] = j.start;
+        for (int i = 0; i < 4; i++) {
+            x.words[6 + i][l] = read_be32(j.value, 4 * i);
+        }
+        x.left[l] = j.steps;
+        x.job[l] = next++;
+        return 1;
+    }
+
+    // one F on every lane, ADRSc || value at the byte offsets 0 and 22
+    static inline void step(const type *mid, const type *address, type &hash_address, type *value) {
+        type m[16];
+        m[0] = address[0];
+        m[1] = address[1];
+        m[2] = address[2];
+        m[3] = address[3];
+        // bytes 18 .. 19 of the hash address are 0, w - 1 fits in 16 bits
+        m[4] = address[4];
+        m[5] = Instrinsic::vector_or(Instrinsic::template vector_shl<16>(hash_address), Instrinsic::template vector_shr<16>(value[0]));
+        m[6] = Instrinsic::vector_or(Instrinsic::template vector_shl<16>(value[0]), Instrinsic::template vector_shr<16>(value[1]));
+        m[7] = Instrinsic::vector_or(Instrinsic::template vector_shl<16>(value[1]), Instrinsic::template vector_shr<16>(value[2]));
+        m[8] = Instrinsic::vector_or(Instrinsic::template vector_shl<16>(value[2]), Instrinsic::template vector_shr<16>(value[3]));
+        m[9] = Instrinsic::vector_or(Instrinsic::template vector_shl<16>(value[3]), Instrinsic::vector_mirror(0x8000));
+        m[10] = m[11] = m[12] = m[13] = m[14] = Instrinsic::vector_mirror(0);
+        m[15] = Instrinsic::vector_mirror((64 + 22 + n) * 8);
+
+        type a = mid[0], b = mid[1], c = mid[2], d = mid[3];
+        type e = mid[4], f = mid[5], g = mid[6], h = mid[7];
+        hash::process_words(a, b, c, d, e, f, g, h, m);
+        value[0] = a;
+        value[1] = b;
+        value[2] = c;
+        value[3] = d;
+        hash_address = Instrinsic::vector_add(hash_address, Instrinsic::vector_mirror(1));
+    }
+
+    static void set_job(chain_job &job, uint8_t *value, const sphincs_address &address,
+            uint32_t keypair, int chain, int start, int steps) {
+        job.value = value;
+        job.address = address;
+        job.address.set_type(sphincs_address::wots_hash);
+        job.address.set_keypair(keypair);
+        job.address.set_chain(chain);
+        job.start = start;
+        job.steps = steps;
+    }
+
+    // the len base w digits of message and of its checksum
+    static void base_w(int *digits, const uint8_t *message) {
+        int checksum = 0;
+        for (int i = 0; i < len1; i++) {
+            digits[i] = i & 1 ? message[i / 2] & 15 : message[i / 2] >> 4;
+            checksum += w - 1 - digits[i];
+        }
+        // shifted to the top of 2 bytes, the 3 nibbles from the top
+        checksum <<= 4;
+        digits[len1] = (checksum >> 12) & 15;
+        digits[len1 + 1] = (checksum >> 8) & 15;
+        digits[len1 + 2] = (checksum >> 4) & 15;
+    }
+
+    // the len chain starts of count keypairs, PRF on all lanes
+    void private_keys(uint8_t *out, const uint8_t *sk_seed, const sphincs_address &address,
+            uint32_t first, size_t count) const {
+        std::vector<sphincs_address> addresses(count * len);
+        std::vector<uint8_t> seeds(count * len * n);
+        for (size_t k = 0; k < count; k++) {
+            for (int i = 0; i < len; i++) {
+                sphincs_address &a = addresses[k * len + i];
+                a = address;
+                a.set_type(sphincs_address::wots_prf);
+                a.set_keypair(first + (uint32_t)k);
+                a.set_chain(i);
+                memcpy(&seeds[(k * len + i) * n], sk_seed, n);
+            }
+        }
+        thash(out, addresses.data(), seeds.data(), 1, count * len);
+    }
+
+    // T_len of the chain ends of count keypairs
+    void compress(uint8_t *out, const uint8_t *ends, const sphincs_address &address,
+            uint32_t first, size_t count) const {
+        std::vector<sphincs_address> addresses(count, address);
+        for (size_t k = 0; k < count; k++) {
+            addresses[k].set_type(sphincs_address::wots_pk);
+            addresses[k].set_keypair(first + (uint32_t)k);
+        }
+        thash(out, addresses.data(), ends, len, count);
+    }
+
+    uint32_t seeded_[8];
+};
+
+} // namespace fingera
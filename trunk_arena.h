@@ -0,0 +1,240 @@
+/**
+ * @file trunk_arena.h
+ * @author lyjstudy@gmail.com
+ * @date 2018-07-23
+ */
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#include <sys/mman.h>
+#include "compact.h"
+
+namespace fingera {
+
+enum {
+    cache_line_size = 64,
+    huge_page_size = 2 << 20,
+    // what a buffer_pool keeps: the largest buffer and the whole free list
+    max_pooled_chunk = 8 << 20,
+    max_pooled_bytes = 32 << 20,
+};
+
+// per thread free list of cache line aligned buffers
+class buffer_pool {
+public:
+    static buffer_pool &local() {
+        static thread_local buffer_pool pool;
+        return pool;
+    }
+
+    ~buffer_pool() {
+        trim();
+    }
+
+    // hugepage buffers are mmap'ed in 2MB units and advised for transparent hugepages
+    void *acquire(size_t size, bool hugepage = false) {
+        size = round_up(size, hugepage);
+        for (size_t i = 0; i < free_.size(); i++) {
+            if (free_[i].size == size && free_[i].hugepage == hugepage) {
+                void *ptr = free_[i].ptr;
+                pooled_ -= size;
+                free_[i] = free_.back();
+                free_.pop_back();
+                return ptr;
+            }
+        }
+        return allocate(size, hugepage);
+    }
+    // a buffer too large for the pool goes back to the system, one batch
+    // of long messages does not pin its trunk to the thread for good
+    void release(void *ptr, size_t size, bool hugepage = false) {
+        if (!ptr) {
+            return;
+        }
+        chunk c = { ptr, round_up(size, hugepage), hugepage };
+        if (c.size > max_pooled_chunk || pooled_ + c.size > max_pooled_bytes) {
+            deallocate(c);
+            return;
+        }
+        free_.push_back(c);
+        pooled_ += c.size;
+    }
+
+    void trim() {
+        for (size_t i = 0; i < free_.size(); i++) {
+            deallocate(free_[i]);
+        }
+        free_.clear();
+        pooled_ = 0;
+    }
+
+    // bytes in the free list
+    size_t pooled() const {
+        return pooled_;
+    }
+
+private:
+    struct chunk {
+        void *ptr;
+        size_t size;
+        bool hugepage;
+    };
+
+    buffer_pool() : pooled_(0) {
+        free_.reserve(16);
+    }
+    buffer_pool(const buffer_pool &) = delete;
+    buffer_pool &operator=(const buffer_pool &) = delete;
+
+    static size_t round_up(size_t size, bool hugepage) {
+        size_t unit = hugepage ? huge_page_size : cache_line_size;
+        size = size ? size : 1;
+        return (size + unit - 1) / unit * unit;
+    }
+
+    static void *allocate(size_t size, bool hugepage) {
+        void *ptr = nullptr;
+        if (hugepage) {
+            ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (ptr == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+#ifdef MADV_HUGEPAGE
+            madvise(ptr, size, MADV_HUGEPAGE);
+#endif
+            return ptr;
+        }
+        if (posix_memalign(&ptr, cache_line_size, size)) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+    static void deallocate(const chunk &c) {
+        if (c.hugepage) {
+            munmap(c.ptr, c.size);
+        } else {
+            free(c.ptr);
+        }
+    }
+
+    std::vector<chunk> free_;
+    size_t pooled_;
+};
+
+// staging buffers for one batch of Hash (sha256<> / ripemd160<>)
+// trunk: max_blocks blocks for each of way() lanes, digest: way() digests
+// buffers come from and return to the thread's buffer_pool, so a hashing
+// loop that creates an arena per batch does not touch the heap once warm
+template<typename Hash>
+class trunk_arena {
+public:
+    using type = typename Hash::type;
+
+    explicit trunk_arena(int max_blocks, bool hugepage = false)
+            : max_blocks_(max_blocks), hugepage_(hugepage), size_(0) {
+        buffer_pool &pool = buffer_pool::local();
+        trunk_ = (uint8_t *)pool.acquire(trunk_size(), hugepage_);
+        digest_ = (uint8_t *)pool.acquire(digest_size() * 2);
+        scratch_ = digest_ + digest_size();
+    }
+    ~trunk_arena() {
+        buffer_pool &pool = buffer_pool::local();
+        pool.release(trunk_, trunk_size(), hugepage_);
+        pool.release(digest_, digest_size() * 2);
+    }
+    trunk_arena(const trunk_arena &) = delete;
+    trunk_arena &operator=(const trunk_arena &) = delete;
+
+    static inline size_t way() {
+        return Hash::way();
+    }
+
+    size_t trunk_size() const {
+        return 64 * way() * max_blocks_;
+    }
+    size_t digest_size() const {
+        return Hash::hash_size * way();
+    }
+    int max_blocks() const {
+        return max_blocks_;
+    }
+    size_t size() const {
+        return size_;
+    }
+    bool full() const {
+        return size_ == way();
+    }
+
+    uint8_t *trunk() {
+        return trunk_;
+    }
+    uint8_t *digest() {
+        return digest_;
+    }
+    const uint8_t *digest(size_t lane) const {
+        return digest_ + lane * Hash::hash_size;
+    }
+
+    void clear() {
+        size_ = 0;
+    }
+
+    // pads the message into the next lane, false when the arena is full
+    // or the message needs more than max_blocks blocks
+    bool add(const void *data, size_t size) {
+        if (full() || Hash::block_count(size) > (size_t)max_blocks_) {
+            return false;
+        }
+        counts_[size_] = Hash::fill_lane(trunk_, size_, data, size);
+        size_++;
+        return true;
+    }
+
+    // hashes the lanes added since clear() into digest()
+    void process() {
+        int blocks = 0;
+        bool same = full();
+        for (size_t i = 0; i < size_; i++) {
+            same = same && counts_[i] == counts_[0];
+            blocks = counts_[i] > blocks ? counts_[i] : blocks;
+        }
+        if (same) {
+            Hash::process_trunk(digest_, trunk_, blocks);
+            return;
+        }
+
+        // lanes of different lengths: snapshot each lane after its last block
+        type s[Hash::state_size];
+        Hash::init(s);
+        for (int i = 0; i < blocks; i++) {
+            Hash::process_blocks(s, trunk_ + 64 * way() * i, 1);
+
+            bool saved = false;
+            for (size_t lane = 0; lane < size_; lane++) {
+                if (counts_[lane] != i + 1) {
+                    continue;
+                }
+                if (!saved) {
+                    Hash::save_state(scratch_, s);
+                    saved = true;
+                }
+                memcpy(digest_ + lane * Hash::hash_size, scratch_ + lane * Hash::hash_size, Hash::hash_size);
+            }
+        }
+    }
+
+private:
+    int max_blocks_;
+    bool hugepage_;
+    size_t size_;
+    uint8_t *trunk_;
+    uint8_t *digest_;
+    uint8_t *scratch_;
+    int counts_[sizeof(type) / sizeof(uint32_t)];
+};
+
+} // namespace fingera